@@ -4,6 +4,777 @@
 #include <queue>
 #include <mutex>
 #include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <random>
+#include <opencv2/core/hal/intrin.hpp>
+
+// Procedural pattern kernels shared by the generators below. Their patterns
+// only depend on x, y or x + y, so each term is evaluated once per column,
+// row or diagonal into a table instead of once per pixel. Rows are then
+// assembled from the tables in parallel bands, with cv::merge doing the SIMD
+// channel interleave. The tables use the same expressions and double math
+// as the old per-pixel loops, so the output is bit-exact.
+class ProceduralKernels {
+public:
+    // Coordinate a channel table is indexed by
+    enum class Axis { X, Y, Diagonal };
+
+    struct Channel {
+        Axis axis;
+        std::vector<uchar> table;
+    };
+
+    static constexpr int rowsPerBand = 16;
+
+    // Tabulates term(i) for every column, row or x + y diagonal
+    template <typename Term>
+    static Channel tabulate(Axis axis, int width, int height, Term term) {
+        Channel channel;
+        channel.axis = axis;
+        int size = axis == Axis::X ? width : (axis == Axis::Y ? height : width + height - 1);
+        channel.table.resize(std::max(size, 0));
+        for (int i = 0; i < size; ++i) {
+            channel.table[i] = term(i);
+        }
+        return channel;
+    }
+
+    // Constant channel (e.g. a colour component that is always 0)
+    static Channel constant(int width, uchar value) {
+        return Channel{Axis::X, std::vector<uchar>(width, value)};
+    }
+
+    // BGR frame whose pixel (x, y) takes each component from its channel table
+    static cv::Mat composeBGR(int width, int height, const Channel& b, const Channel& g, const Channel& r) {
+        cv::Mat frame(height, width, CV_8UC3);
+        if (frame.empty()) return frame;
+
+        cv::parallel_for_(cv::Range(0, height), [&](const cv::Range& rows) {
+            std::vector<uchar> fill[3];
+            for (int y = rows.start; y < rows.end; ++y) {
+                cv::Mat planes[3] = {
+                    channelRow(b, y, width, fill[0]),
+                    channelRow(g, y, width, fill[1]),
+                    channelRow(r, y, width, fill[2])
+                };
+                cv::Mat row = frame.row(y);
+                cv::merge(planes, 3, row);
+            }
+        }, bandCount(height));
+
+        return frame;
+    }
+
+    // Gray BGR frame with value (column[x] + row[y]) * scale + offset. Values
+    // outside 0..255 wrap, as the old static_cast<uchar> of a double did on x86.
+    static cv::Mat additiveGray(const std::vector<double>& column, const std::vector<double>& row,
+                                double scale, double offset) {
+        int width = static_cast<int>(column.size());
+        int height = static_cast<int>(row.size());
+        cv::Mat frame(height, width, CV_8UC3);
+        if (frame.empty()) return frame;
+
+        cv::parallel_for_(cv::Range(0, height), [&](const cv::Range& rows) {
+            std::vector<uchar> values(width);
+            for (int y = rows.start; y < rows.end; ++y) {
+                const double rowTerm = row[y];
+                for (int x = 0; x < width; ++x) {
+                    values[x] = static_cast<uchar>(static_cast<int>((column[x] + rowTerm) * scale + offset));
+                }
+                cv::Mat value(1, width, CV_8UC1, values.data());
+                cv::Mat planes[3] = {value, value, value};
+                cv::Mat dst = frame.row(y);
+                cv::merge(planes, 3, dst);
+            }
+        }, bandCount(height));
+
+        return frame;
+    }
+
+private:
+    static double bandCount(int height) {
+        return std::max(1, height / rowsPerBand);
+    }
+
+    // One row of a channel as a 1 x width plane (no copy for x / diagonal tables)
+    static cv::Mat channelRow(const Channel& channel, int y, int width, std::vector<uchar>& fill) {
+        uchar* table = const_cast<uchar*>(channel.table.data());
+        switch (channel.axis) {
+            case Axis::X:
+                return cv::Mat(1, width, CV_8UC1, table);
+            case Axis::Diagonal:
+                return cv::Mat(1, width, CV_8UC1, table + y);
+            case Axis::Y:
+            default:
+                if (fill.size() != static_cast<size_t>(width) || fill[0] != table[y]) {
+                    fill.assign(width, table[y]);
+                }
+                return cv::Mat(1, width, CV_8UC1, fill.data());
+        }
+    }
+};
+
+// Step-fused diffusion frames. Each refinement step adds factor(step) times
+// a wave that depends only on x, y or x + y, so a pixel's final value is a
+// function of its wave alone. All steps run back to back per wave value
+// with the accumulator in a register, once per column, row and diagonal,
+// and ProceduralKernels assembles the frame in parallel bands. Wrap
+// reproduces the old per-step static_cast<uchar> (x86 truncation mod 256)
+// bit for bit; Saturate clamps each step to 0..255 instead.
+class DiffusionEngine {
+public:
+    enum class Accumulation { Wrap, Saturate };
+
+    static Accumulation parseAccumulation(const std::string& name) {
+        return name == "saturate" ? Accumulation::Saturate : Accumulation::Wrap;
+    }
+
+    static cv::Mat render(int width, int height, int steps, double time, Accumulation accumulation) {
+        // Step-invariant: the refinement schedule, shared by every pixel
+        std::vector<double> factors(std::max(steps, 0));
+        for (int step = 0; step < steps; ++step) {
+            factors[step] = 1.0 - (static_cast<double>(step) / steps);
+        }
+
+        using Axis = ProceduralKernels::Axis;
+        auto b = ProceduralKernels::tabulate(Axis::X, width, height, [&](int x) {
+            return refine(std::sin(x * 0.01 + time), factors, accumulation);
+        });
+        auto g = ProceduralKernels::tabulate(Axis::Y, width, height, [&](int y) {
+            return refine(std::cos(y * 0.01 + time), factors, accumulation);
+        });
+        auto r = ProceduralKernels::tabulate(Axis::Diagonal, width, height, [&](int d) {
+            return refine(std::sin(d * 0.01 + time), factors, accumulation);
+        });
+        return ProceduralKernels::composeBGR(width, height, b, g, r);
+    }
+
+private:
+    // Every step for one wave value; same expression order as the old loop
+    static uchar refine(double wave, const std::vector<double>& factors, Accumulation accumulation) {
+        int value = 0;
+        if (accumulation == Accumulation::Wrap) {
+            for (double factor : factors) {
+                value = static_cast<uchar>(static_cast<int>(value + factor * wave * 255));
+            }
+        } else {
+            for (double factor : factors) {
+                value = std::min(255, std::max(0, static_cast<int>(value + factor * wave * 255)));
+            }
+        }
+        return static_cast<uchar>(value);
+    }
+};
+
+// Perlin noise engine for procedural generators and effects. Samples are
+// evaluated in float32 across SIMD lanes with OpenCV universal intrinsics
+// (SSE/AVX2/AVX-512 or NEON, whatever the build targets; scalar otherwise).
+// fBm octaves, turbulence and domain warping are layered on top, and
+// render() fills whole frames in parallel row bands.
+class NoiseEngine {
+public:
+    struct Settings {
+        int octaves = 1;
+        float lacunarity = 2.0f;     // frequency multiplier per octave
+        float gain = 0.5f;           // amplitude multiplier per octave
+        bool turbulence = false;     // sum |noise| (billowy) instead of signed noise
+        float warpStrength = 0.0f;   // domain warp offset, in noise-space units
+        float warpFrequency = 1.0f;  // warp field frequency relative to the base
+    };
+
+    // Seed 0 keeps Ken Perlin's reference permutation
+    explicit NoiseEngine(uint32_t seed = 0) {
+        static const int reference[256] = {
+            151,160,137,91,90,15,131,13,201,95,96,53,194,233,7,225,140,36,103,30,69,142,8,99,37,240,21,10,23,
+            190,6,148,247,120,234,75,0,26,197,62,94,252,219,203,117,35,11,32,57,177,33,88,237,149,56,87,174,
+            20,125,136,171,168,68,175,74,165,71,134,139,48,27,166,77,146,158,231,83,111,229,122,60,211,133,
+            230,220,105,92,41,55,46,245,40,244,102,143,54,65,25,63,161,1,216,80,73,209,76,132,187,208,89,18,
+            169,200,196,135,130,116,188,159,86,164,100,109,198,173,186,3,64,52,217,226,250,124,123,5,202,38,
+            147,118,126,255,82,85,212,207,206,59,227,47,16,58,17,182,189,28,42,223,183,170,213,119,248,152,2,
+            44,154,163,70,221,153,101,155,167,43,172,9,129,22,39,253,19,98,108,110,79,113,224,232,178,185,112,
+            104,218,246,97,228,251,34,242,193,238,210,144,12,191,179,162,241,81,51,145,235,249,14,239,107,49,
+            192,214,31,181,199,106,157,184,84,204,176,115,121,50,45,127,4,150,254,138,236,205,93,222,114,67,29,
+            24,72,243,141,128,195,78,66,215,61,156,180
+        };
+
+        std::copy(reference, reference + 256, perm);
+        if (seed != 0) {
+            std::mt19937 rng(seed);
+            std::shuffle(perm, perm + 256, rng);
+        }
+        std::copy(perm, perm + 256, perm + 256);
+    }
+
+    // Engine with the reference permutation, shared by all generators
+    static const NoiseEngine& shared() {
+        static const NoiseEngine engine;
+        return engine;
+    }
+
+    // Single-octave signed noise, roughly in [-1, 1], at (xs[i], ys[i], z)
+    void evaluate(const float* xs, const float* ys, float z, float* out, int count) const {
+        int i = 0;
+
+#if CV_SIMD
+        const int lanes = cv::v_float32::nlanes;
+        const float zFloor = std::floor(z);
+        const float zf = z - zFloor;
+        const cv::v_int32 zi = cv::vx_setall_s32(static_cast<int>(zFloor) & 255);
+        const cv::v_int32 one = cv::vx_setall_s32(1);
+        const cv::v_int32 mask = cv::vx_setall_s32(255);
+        const cv::v_float32 fOne = cv::vx_setall_f32(1.0f);
+        const cv::v_float32 vz = cv::vx_setall_f32(zf);
+        const cv::v_float32 vz1 = cv::vx_setall_f32(zf - 1.0f);
+        const cv::v_float32 w = cv::vx_setall_f32(fade(zf));
+
+        for (; i <= count - lanes; i += lanes) {
+            cv::v_float32 x = cv::vx_load(xs + i);
+            cv::v_float32 y = cv::vx_load(ys + i);
+            cv::v_int32 xFloor = cv::v_floor(x);
+            cv::v_int32 yFloor = cv::v_floor(y);
+            cv::v_float32 xf = x - cv::v_cvt_f32(xFloor);
+            cv::v_float32 yf = y - cv::v_cvt_f32(yFloor);
+            cv::v_int32 xi = xFloor & mask;
+            cv::v_int32 yi = yFloor & mask;
+            cv::v_float32 u = fadeLanes(xf);
+            cv::v_float32 v = fadeLanes(yf);
+            cv::v_float32 xf1 = xf - fOne;
+            cv::v_float32 yf1 = yf - fOne;
+
+            cv::v_int32 a = cv::v_lut(perm, xi) + yi;
+            cv::v_int32 b = cv::v_lut(perm, xi + one) + yi;
+            cv::v_int32 aa = cv::v_lut(perm, a) + zi;
+            cv::v_int32 ab = cv::v_lut(perm, a + one) + zi;
+            cv::v_int32 ba = cv::v_lut(perm, b) + zi;
+            cv::v_int32 bb = cv::v_lut(perm, b + one) + zi;
+
+            cv::v_float32 x1 = lerpLanes(gradLanes(cv::v_lut(perm, aa), xf, yf, vz),
+                                         gradLanes(cv::v_lut(perm, ba), xf1, yf, vz), u);
+            cv::v_float32 x2 = lerpLanes(gradLanes(cv::v_lut(perm, ab), xf, yf1, vz),
+                                         gradLanes(cv::v_lut(perm, bb), xf1, yf1, vz), u);
+            cv::v_float32 x3 = lerpLanes(gradLanes(cv::v_lut(perm, aa + one), xf, yf, vz1),
+                                         gradLanes(cv::v_lut(perm, ba + one), xf1, yf, vz1), u);
+            cv::v_float32 x4 = lerpLanes(gradLanes(cv::v_lut(perm, ab + one), xf, yf1, vz1),
+                                         gradLanes(cv::v_lut(perm, bb + one), xf1, yf1, vz1), u);
+
+            cv::v_store(out + i, lerpLanes(lerpLanes(x1, x2, v), lerpLanes(x3, x4, v), w));
+        }
+#endif
+
+        for (; i < count; ++i) {
+            out[i] = noise(xs[i], ys[i], z);
+        }
+    }
+
+    // Layered noise normalised to [0, 1]
+    void sample(const float* xs, const float* ys, float z, float* out, int count, const Settings& settings) const {
+        float px[blockSize], py[blockSize], sx[blockSize], sy[blockSize];
+        float octave[blockSize], total[blockSize];
+
+        for (int start = 0; start < count; start += blockSize) {
+            const int n = std::min(blockSize, count - start);
+            std::copy(xs + start, xs + start + n, px);
+            std::copy(ys + start, ys + start + n, py);
+
+            if (settings.warpStrength != 0.0f) {
+                // Two decorrelated noise fields displace the sample position
+                for (int i = 0; i < n; ++i) {
+                    sx[i] = px[i] * settings.warpFrequency;
+                    sy[i] = py[i] * settings.warpFrequency;
+                }
+                evaluate(sx, sy, z + 31.7f, octave, n);
+                for (int i = 0; i < n; ++i) {
+                    sx[i] += 5.2f;
+                    sy[i] += 1.3f;
+                }
+                evaluate(sx, sy, z + 31.7f, total, n);
+                for (int i = 0; i < n; ++i) {
+                    px[i] += settings.warpStrength * octave[i];
+                    py[i] += settings.warpStrength * total[i];
+                }
+            }
+
+            std::fill(total, total + n, 0.0f);
+            float frequency = 1.0f;
+            float amplitude = 1.0f;
+            float amplitudeSum = 0.0f;
+            for (int o = 0; o < std::max(1, settings.octaves); ++o) {
+                for (int i = 0; i < n; ++i) {
+                    sx[i] = px[i] * frequency;
+                    sy[i] = py[i] * frequency;
+                }
+                evaluate(sx, sy, z * frequency, octave, n);
+                if (settings.turbulence) {
+                    for (int i = 0; i < n; ++i) total[i] += amplitude * std::fabs(octave[i]);
+                } else {
+                    for (int i = 0; i < n; ++i) total[i] += amplitude * octave[i];
+                }
+                amplitudeSum += amplitude;
+                frequency *= settings.lacunarity;
+                amplitude *= settings.gain;
+            }
+
+            for (int i = 0; i < n; ++i) {
+                float value = total[i] / amplitudeSum;
+                out[start + i] = settings.turbulence ? value : (value + 1.0f) * 0.5f;
+            }
+        }
+    }
+
+    // CV_32F field in [0, 1]; pixel (x, y) samples (x * scale, y * scale, z)
+    cv::Mat render(int width, int height, float scale, float z, const Settings& settings) const {
+        cv::Mat field(height, width, CV_32F);
+        if (field.empty()) return field;
+
+        cv::parallel_for_(cv::Range(0, height), [&](const cv::Range& rows) {
+            std::vector<float> xs(width), ys(width);
+            for (int x = 0; x < width; ++x) {
+                xs[x] = x * scale;
+            }
+            for (int y = rows.start; y < rows.end; ++y) {
+                std::fill(ys.begin(), ys.end(), y * scale);
+                sample(xs.data(), ys.data(), z, field.ptr<float>(y), width, settings);
+            }
+        }, std::max(1, height / ProceduralKernels::rowsPerBand));
+
+        return field;
+    }
+
+    // Scalar reference, also used for the lanes left over after the SIMD loop
+    float noise(float x, float y, float z) const {
+        float xFloor = std::floor(x), yFloor = std::floor(y), zFloor = std::floor(z);
+        int xi = static_cast<int>(xFloor) & 255;
+        int yi = static_cast<int>(yFloor) & 255;
+        int zi = static_cast<int>(zFloor) & 255;
+        float xf = x - xFloor, yf = y - yFloor, zf = z - zFloor;
+        float u = fade(xf), v = fade(yf), w = fade(zf);
+
+        int a = perm[xi] + yi, b = perm[xi + 1] + yi;
+        int aa = perm[a] + zi, ab = perm[a + 1] + zi;
+        int ba = perm[b] + zi, bb = perm[b + 1] + zi;
+
+        float x1 = lerp(grad(perm[aa], xf, yf, zf), grad(perm[ba], xf - 1, yf, zf), u);
+        float x2 = lerp(grad(perm[ab], xf, yf - 1, zf), grad(perm[bb], xf - 1, yf - 1, zf), u);
+        float x3 = lerp(grad(perm[aa + 1], xf, yf, zf - 1), grad(perm[ba + 1], xf - 1, yf, zf - 1), u);
+        float x4 = lerp(grad(perm[ab + 1], xf, yf - 1, zf - 1), grad(perm[bb + 1], xf - 1, yf - 1, zf - 1), u);
+        return lerp(lerp(x1, x2, v), lerp(x3, x4, v), w);
+    }
+
+private:
+    static constexpr int blockSize = 256;
+
+    int perm[512];
+
+    static float fade(float t) { return t * t * t * (t * (t * 6 - 15) + 10); }
+    static float lerp(float a, float b, float t) { return a + t * (b - a); }
+    static float grad(int hash, float x, float y, float z) {
+        int h = hash & 15;
+        float u = h < 8 ? x : y;
+        float v = h < 4 ? y : (h == 12 || h == 14 ? x : z);
+        return ((h & 1) == 0 ? u : -u) + ((h & 2) == 0 ? v : -v);
+    }
+
+#if CV_SIMD
+    static cv::v_float32 fadeLanes(const cv::v_float32& t) {
+        cv::v_float32 inner = t * (t * cv::vx_setall_f32(6.0f) - cv::vx_setall_f32(15.0f)) + cv::vx_setall_f32(10.0f);
+        return t * t * t * inner;
+    }
+
+    static cv::v_float32 lerpLanes(const cv::v_float32& a, const cv::v_float32& b, const cv::v_float32& t) {
+        return a + t * (b - a);
+    }
+
+    // Branch-free grad(): the hash bits pick components and signs through lane masks
+    static cv::v_float32 gradLanes(const cv::v_int32& hash, const cv::v_float32& x,
+                                   const cv::v_float32& y, const cv::v_float32& z) {
+        const cv::v_int32 h = hash & cv::vx_setall_s32(15);
+        const cv::v_int32 zero = cv::vx_setzero_s32();
+        const cv::v_float32 fZero = cv::vx_setzero_f32();
+
+        cv::v_float32 u = cv::v_select(cv::v_reinterpret_as_f32(h < cv::vx_setall_s32(8)), x, y);
+        cv::v_int32 useX = (h == cv::vx_setall_s32(12)) | (h == cv::vx_setall_s32(14));
+        cv::v_float32 v = cv::v_select(cv::v_reinterpret_as_f32(h < cv::vx_setall_s32(4)), y,
+                                       cv::v_select(cv::v_reinterpret_as_f32(useX), x, z));
+
+        u = cv::v_select(cv::v_reinterpret_as_f32((h & cv::vx_setall_s32(1)) == zero), u, fZero - u);
+        v = cv::v_select(cv::v_reinterpret_as_f32((h & cv::vx_setall_s32(2)) == zero), v, fZero - v);
+        return u + v;
+    }
+#endif
+};
+
+// Renders a frame as a grid of cache-sized tiles spread over all cores
+class TileRenderer {
+public:
+    // 512x64 BGR tiles (~96 KB) fit in L2 alongside their lookup tables
+    static cv::Size defaultTileSize() { return cv::Size(512, 64); }
+
+    template <typename RenderTile>
+    static void render(cv::Mat& frame, cv::Size tileSize, RenderTile renderTile) {
+        const int tilesX = (frame.cols + tileSize.width - 1) / tileSize.width;
+        const int tilesY = (frame.rows + tileSize.height - 1) / tileSize.height;
+
+        // One task per tile; idle workers steal tiles from busy ones
+        FiberOpticThreading::shared().parallelFor(0, tilesX * tilesY, 1, [&](int begin, int end) {
+            for (int t = begin; t < end; ++t) {
+                cv::Rect region((t % tilesX) * tileSize.width, (t / tilesX) * tileSize.height,
+                                tileSize.width, tileSize.height);
+                region &= cv::Rect(0, 0, frame.cols, frame.rows);
+                cv::Mat tile = frame(region);
+                renderTile(tile, region);
+            }
+        });
+    }
+};
+
+// Parallax animation of a still image. The depth map lives in one contiguous
+// CV_32F buffer computed once per photo, and camera motion is a parametric
+// displacement field: a pixel at depth d samples the photo at
+// (x + offsetX * d, y + offsetY * d). Each frame builds that field one row
+// band at a time in per-thread scratch and gathers it with cv::remap
+// (bilinear, SIMD), with bands spread over the scheduler. Edges clamp, as the
+// old per-pixel loops did. Rendering into a frame the caller keeps across
+// frames allocates nothing once the first frame exists.
+class ParallaxEngine {
+public:
+    static constexpr int rowsPerBand = 32;
+
+    // Camera offset in pixels per unit of depth
+    struct Camera {
+        double offsetX;
+        double offsetY;
+
+        // The gentle circular drift the 3D photo generators use
+        static Camera orbit(double time, double radius = 10.0) {
+            return Camera{std::sin(time) * radius, std::cos(time) * radius};
+        }
+    };
+
+    // depth is CV_32F at the photo's size; empty moves every pixel by the
+    // camera offset as if at depth 1
+    ParallaxEngine(const cv::Mat& photo, const cv::Mat& depth) : photo(photo), depth(depth) {
+        if (!depth.empty() && (depth.size() != photo.size() || depth.type() != CV_32F)) {
+            throw std::runtime_error("Parallax depth map must be CV_32F at the photo size");
+        }
+        columns.create(1, photo.cols, CV_32F);
+        float* column = columns.ptr<float>();
+        for (int x = 0; x < photo.cols; ++x) {
+            column[x] = static_cast<float>(x);
+        }
+    }
+
+    void render(const Camera& camera, cv::Mat& frame) const {
+        frame.create(photo.size(), photo.type());
+        const int bands = (photo.rows + rowsPerBand - 1) / rowsPerBand;
+
+        FiberOpticThreading::shared().parallelFor(0, bands, 1, [&](int begin, int end) {
+            static thread_local cv::Mat mapX, mapY;
+            for (int band = begin; band < end; ++band) {
+                const int top = band * rowsPerBand;
+                const int rows = std::min(rowsPerBand, photo.rows - top);
+                mapX.create(rows, photo.cols, CV_32F);
+                mapY.create(rows, photo.cols, CV_32F);
+
+                for (int r = 0; r < rows; ++r) {
+                    const int y = top + r;
+                    cv::Mat rowX = mapX.row(r);
+                    cv::Mat rowY = mapY.row(r);
+                    if (depth.empty()) {
+                        columns.convertTo(rowX, CV_32F, 1.0, camera.offsetX);
+                        rowY.setTo(cv::Scalar(y + camera.offsetY));
+                    } else {
+                        cv::scaleAdd(depth.row(y), camera.offsetX, columns, rowX);
+                        depth.row(y).convertTo(rowY, CV_32F, camera.offsetY, y);
+                    }
+                }
+
+                cv::Mat target = frame.rowRange(top, top + rows);
+                cv::remap(photo, target, mapX, mapY, cv::INTER_LINEAR, cv::BORDER_REPLICATE);
+            }
+        });
+    }
+
+    cv::Mat render(const Camera& camera) const {
+        cv::Mat frame;
+        render(camera, frame);
+        return frame;
+    }
+
+private:
+    cv::Mat photo;
+    cv::Mat depth;
+    cv::Mat columns;    // 0, 1, ..., cols - 1: the identity field's x
+};
+
+// Text for lyric, title and scene cards. Each distinct string and style is
+// rasterised once into a tight layer (an alpha mask plus the colour
+// premultiplied by it) and cached. Frames composite layers over just their
+// bounding rectangle, and placement, fade (opacity) and a karaoke wipe are
+// applied at composite time, so animating text never re-rasterises it.
+// Hershey glyphs sit at fractional pen positions, so a layer is rasterised
+// with putText as a whole string rather than stitched from per-glyph
+// bitmaps; that keeps cards pixel-identical to direct putText at opacity 1.
+class TextRenderer {
+public:
+    struct Style {
+        int fontFace;
+        double fontScale;
+        int thickness;
+        cv::Scalar color;
+        int lineType;
+
+        Style(double fontScale = 1.0, int thickness = 1, cv::Scalar color = cv::Scalar(255, 255, 255),
+              int fontFace = cv::FONT_HERSHEY_SIMPLEX, int lineType = cv::LINE_8)
+            : fontFace(fontFace), fontScale(fontScale), thickness(thickness), color(color), lineType(lineType) {}
+    };
+
+    struct Layer {
+        cv::Mat alpha;          // CV_8U coverage
+        cv::Mat premultiplied;  // CV_8UC3 style colour * alpha
+        cv::Point offset;       // From the text origin (baseline, left) to the layer's top-left
+        cv::Size textSize;      // As cv::getTextSize reports it
+        int baseline;
+    };
+
+    struct Placement {
+        cv::Point origin;       // Baseline-left, like putText's org
+        double opacity;         // Fade, 0..1
+        double wipe;            // Karaoke progress, 0..1 of the text width in wipeColor
+        cv::Scalar wipeColor;
+
+        Placement(cv::Point origin, double opacity = 1.0, double wipe = 0.0,
+                  cv::Scalar wipeColor = cv::Scalar(0, 215, 255))
+            : origin(origin), opacity(opacity), wipe(wipe), wipeColor(wipeColor) {}
+    };
+
+    static constexpr size_t maxCachedLayers = 512;
+
+    static TextRenderer& shared() {
+        static TextRenderer renderer;
+        return renderer;
+    }
+
+    // Cached layer for text in style, rasterised on first use
+    std::shared_ptr<const Layer> layer(const std::string& text, const Style& style) {
+        std::string key = cacheKey(text, style);
+        {
+            std::lock_guard<std::mutex> lock(cacheMutex);
+            auto it = layers.find(key);
+            if (it != layers.end()) return it->second;
+        }
+
+        std::shared_ptr<const Layer> rasterised = rasterise(text, style);
+
+        std::lock_guard<std::mutex> lock(cacheMutex);
+        if (layers.size() >= maxCachedLayers) {
+            layers.clear(); // Cards come and go in bursts; start over rather than track recency
+        }
+        layers.emplace(key, rasterised);
+        return rasterised;
+    }
+
+    // Origin that centres the text box in the frame, as the card generators place it
+    static cv::Point centered(const Layer& layer, cv::Size frameSize) {
+        return cv::Point((frameSize.width - layer.textSize.width) / 2,
+                         (frameSize.height + layer.textSize.height) / 2);
+    }
+
+    // Blends the layer into a CV_8UC3 frame and returns the rectangle it
+    // touched. Nothing outside that rectangle is read or written.
+    static cv::Rect composite(cv::Mat& frame, const Layer& layer, const Placement& placement) {
+        CV_Assert(frame.type() == CV_8UC3);
+        cv::Rect target(placement.origin + layer.offset, layer.alpha.size());
+        cv::Rect visible = target & cv::Rect(0, 0, frame.cols, frame.rows);
+        if (visible.empty()) return visible;
+
+        const int opacity = cvRound(std::min(1.0, std::max(0.0, placement.opacity)) * 255);
+        const int wipeX = placement.origin.x +
+            cvRound(std::min(1.0, std::max(0.0, placement.wipe)) * layer.textSize.width);
+        const int wipeColor[3] = {
+            cv::saturate_cast<uchar>(placement.wipeColor[0]),
+            cv::saturate_cast<uchar>(placement.wipeColor[1]),
+            cv::saturate_cast<uchar>(placement.wipeColor[2])
+        };
+
+        for (int y = visible.y; y < visible.y + visible.height; ++y) {
+            const uchar* alpha = layer.alpha.ptr<uchar>(y - target.y) + (visible.x - target.x);
+            const cv::Vec3b* color = layer.premultiplied.ptr<cv::Vec3b>(y - target.y) + (visible.x - target.x);
+            cv::Vec3b* pixel = frame.ptr<cv::Vec3b>(y) + visible.x;
+
+            for (int i = 0; i < visible.width; ++i) {
+                const int coverage = (alpha[i] * opacity + 127) / 255;
+                if (coverage == 0) continue;
+                const bool wiped = visible.x + i < wipeX;
+                for (int c = 0; c < 3; ++c) {
+                    const int source = wiped ? (wipeColor[c] * alpha[i] + 127) / 255 : color[i][c];
+                    pixel[i][c] = static_cast<uchar>((source * opacity + pixel[i][c] * (255 - coverage) + 127) / 255);
+                }
+            }
+        }
+        return visible;
+    }
+
+private:
+    std::mutex cacheMutex;
+    std::unordered_map<std::string, std::shared_ptr<const Layer>> layers;
+
+    static std::string cacheKey(const std::string& text, const Style& style) {
+        std::ostringstream key;
+        key << style.fontFace << '/' << style.fontScale << '/' << style.thickness << '/' << style.lineType << '/'
+            << style.color[0] << ',' << style.color[1] << ',' << style.color[2] << '/' << text;
+        return key.str();
+    }
+
+    static std::shared_ptr<const Layer> rasterise(const std::string& text, const Style& style) {
+        auto layer = std::make_shared<Layer>();
+        layer->baseline = 0;
+        layer->textSize = cv::getTextSize(text, style.fontFace, style.fontScale, style.thickness, &layer->baseline);
+
+        // Strokes reach past the text box by about half the thickness
+        const int pad = style.thickness + 2;
+        cv::Mat mask = cv::Mat::zeros(layer->textSize.height + layer->baseline + 2 * pad,
+                                      layer->textSize.width + 2 * pad, CV_8U);
+        cv::Point origin(pad, pad + layer->textSize.height);
+        cv::putText(mask, text, origin, style.fontFace, style.fontScale, cv::Scalar(255), style.thickness, style.lineType);
+
+        cv::Rect inked = cv::boundingRect(mask);
+        if (inked.empty()) inked = cv::Rect(0, 0, 1, 1);
+        layer->alpha = mask(inked).clone();
+        layer->offset = inked.tl() - origin;
+
+        cv::Mat color(layer->alpha.size(), CV_8UC3, style.color);
+        cv::Mat alpha3;
+        cv::cvtColor(layer->alpha, alpha3, cv::COLOR_GRAY2BGR);
+        cv::multiply(color, alpha3, layer->premultiplied, 1.0 / 255.0);
+        return layer;
+    }
+};
+
+// A frame that keeps a background and redraws only the rectangles text
+// covered, for card sequences where only the text changes
+class TextCompositor {
+public:
+    explicit TextCompositor(const cv::Mat& background) : background(background), frame(background.clone()) {}
+
+    const cv::Mat& draw(const TextRenderer::Layer& layer, const TextRenderer::Placement& placement) {
+        if (!dirty.empty()) {
+            background(dirty).copyTo(frame(dirty));
+        }
+        dirty = TextRenderer::composite(frame, layer, placement);
+        return frame;
+    }
+
+private:
+    cv::Mat background;
+    cv::Mat frame;
+    cv::Rect dirty;
+};
+
+// Renders frames into a fixed pool of buffers and hands them to a writer
+// thread in order, so encoding overlaps rendering of later frames. Only
+// framesInFlight buffers ever exist, which bounds peak memory.
+class FrameStreamer {
+public:
+    using RenderFunction = std::function<void(int frameNumber, cv::Mat& frame)>;
+    using WriteFunction = std::function<void(const cv::Mat& frame)>;
+
+    FrameStreamer(cv::Size frameSize, int frameType, int framesInFlight) {
+        for (int i = 0; i < std::max(1, framesInFlight); ++i) {
+            freeBuffers.emplace_back(frameSize, frameType);
+        }
+    }
+
+    void run(int frameCount, const RenderFunction& render, const WriteFunction& write) {
+        stopped = false;
+        rendering = true;
+        writeError = nullptr;
+        std::thread writer([this, &write]() { writerLoop(write); });
+
+        for (int frameNumber = 0; frameNumber < frameCount; ++frameNumber) {
+            cv::Mat buffer;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                bufferAvailable.wait(lock, [this]() { return !freeBuffers.empty() || stopped; });
+                if (stopped) break;
+                buffer = freeBuffers.back();
+                freeBuffers.pop_back();
+            }
+
+            try {
+                render(frameNumber, buffer);
+            } catch (...) {
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    freeBuffers.push_back(buffer);
+                }
+                finish(writer);
+                throw;
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                readyFrames.push_back(buffer);
+            }
+            frameReady.notify_one();
+        }
+
+        finish(writer);
+        if (writeError) {
+            std::rethrow_exception(writeError);
+        }
+    }
+
+private:
+    std::mutex mutex;
+    std::condition_variable bufferAvailable;
+    std::condition_variable frameReady;
+    std::vector<cv::Mat> freeBuffers;
+    std::deque<cv::Mat> readyFrames;
+    bool rendering = false;
+    bool stopped = false;
+    std::exception_ptr writeError;
+
+    void writerLoop(const WriteFunction& write) {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            frameReady.wait(lock, [this]() { return !readyFrames.empty() || !rendering; });
+            if (readyFrames.empty()) break;
+
+            cv::Mat frame = readyFrames.front();
+            readyFrames.pop_front();
+            lock.unlock();
+
+            try {
+                write(frame);
+            } catch (...) {
+                lock.lock();
+                writeError = std::current_exception();
+                stopped = true;
+                freeBuffers.push_back(frame);
+                freeBuffers.insert(freeBuffers.end(), readyFrames.begin(), readyFrames.end());
+                readyFrames.clear();
+                bufferAvailable.notify_all();
+                return;
+            }
+
+            lock.lock();
+            freeBuffers.push_back(frame);
+            bufferAvailable.notify_one();
+        }
+    }
+
+    // Lets the writer drain what was rendered, then joins it
+    void finish(std::thread& writer) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            rendering = false;
+        }
+        frameReady.notify_all();
+        writer.join();
+    }
+};
 
 // SI Model for Video Generation and Effects
 class SyntheticIntelligence {
@@ -14,18 +785,12 @@ public:
 
     // Generate a video frame procedurally
     cv::Mat generateFrame(int width, int height, double time) {
-        cv::Mat frame(height, width, CV_8UC3, cv::Scalar(0, 0, 0));
-
-        // Example: Procedural pattern using sine waves
-        for (int y = 0; y < height; ++y) {
-            for (int x = 0; x < width; ++x) {
-                uchar value = static_cast<uchar>(
-                    (std::sin(x * 0.1 + time) + std::cos(y * 0.1 + time)) * 127 + 128);
-                frame.at<cv::Vec3b>(y, x) = cv::Vec3b(value, value, value);
-            }
-        }
+        // Example: Procedural pattern using sine waves (sin of x plus cos of y)
+        std::vector<double> column(width), row(height);
+        for (int x = 0; x < width; ++x) column[x] = std::sin(x * 0.1 + time);
+        for (int y = 0; y < height; ++y) row[y] = std::cos(y * 0.1 + time);
 
-        return frame;
+        return ProceduralKernels::additiveGray(column, row, 127, 128);
     }
 
     // Apply effects to a video frame
@@ -40,7 +805,9 @@ public:
             result.convertTo(result, -1, contrast, 0);
         } else if (effect == "blur") {
             int kernelSize = static_cast<int>(params.at("kernelSize"));
-            cv::GaussianBlur(result, result, cv::Size(kernelSize, kernelSize), 0);
+            auto quality = params.find("quality");
+            FastBlur::gaussian(result, result, FastBlur::sigmaForKernel(kernelSize),
+                               quality != params.end() ? static_cast<int>(quality->second) : FastBlur::defaultPasses);
         }
 
         return result;
@@ -56,104 +823,39 @@ public:
 
     // Generate a single frame procedurally with advanced techniques
     cv::Mat generateFrame(int width, int height, double time) {
-        cv::Mat frame(height, width, CV_8UC3, cv::Scalar(0, 0, 0));
+        cv::Mat frame;
 
-        // Example: Procedural pattern using Perlin noise
-        for (int y = 0; y < height; ++y) {
-            for (int x = 0; x < width; ++x) {
-                double noiseValue = perlinNoise(x * 0.01, y * 0.01, time * 0.1);
-                uchar intensity = static_cast<uchar>(noiseValue * 255);
-                frame.at<cv::Vec3b>(y, x) = cv::Vec3b(intensity, intensity, intensity);
-            }
-        }
+        // Example: Procedural pattern using Perlin noise. Float32 lanes stay
+        // within one 8-bit level of the old double-precision loop.
+        cv::Mat field = noise.render(width, height, 0.01f, static_cast<float>(time * 0.1), NoiseEngine::Settings());
+        cv::Mat gray;
+        field.convertTo(gray, CV_8U, 255.0, -0.5);  // truncate like the old cast
+        cv::cvtColor(gray, frame, cv::COLOR_GRAY2BGR);
 
         return frame;
     }
 
     // Generate a full video procedurally
     void generateVideo(const std::string& outputPath, int width, int height, double duration, double frameRate) {
-        cv::VideoWriter writer(outputPath, cv::VideoWriter::fourcc('M', 'J', 'P', 'G'), frameRate, cv::Size(width, height));
+        FrameSink writer(FrameSink::Settings(outputPath, cv::Size(width, height), frameRate));
 
-        if (!writer.isOpened()) {
-            throw std::runtime_error("Failed to open video writer");
+        if (!writer.open()) {
+            throw std::runtime_error("Failed to open video writer: " + writer.getError());
         }
 
         for (int frameNumber = 0; frameNumber < duration * frameRate; ++frameNumber) {
             double time = frameNumber / frameRate;
             cv::Mat frame = generateFrame(width, height, time);
-            writer.write(frame);
+            writer.writeFrame(frame);
         }
 
-        writer.release();
+        if (!writer.close()) {
+            throw std::runtime_error("Failed to finish video: " + writer.getError());
+        }
     }
 
 private:
-    // Real Perlin noise function for procedural generation
-    double perlinNoise(double x, double y, double z) {
-        // Simple Perlin noise implementation
-        int xi = (int)floor(x) & 255;
-        int yi = (int)floor(y) & 255;
-        int zi = (int)floor(z) & 255;
-        double xf = x - floor(x);
-        double yf = y - floor(y);
-        double zf = z - floor(z);
-        
-        double u = fade(xf);
-        double v = fade(yf);
-        double w = fade(zf);
-        
-        int aaa = p[p[p[xi] + yi] + zi];
-        int aba = p[p[p[xi] + yi + 1] + zi];
-        int aab = p[p[p[xi] + yi] + zi + 1];
-        int abb = p[p[p[xi] + yi + 1] + zi + 1];
-        int baa = p[p[p[xi + 1] + yi] + zi];
-        int bba = p[p[p[xi + 1] + yi + 1] + zi];
-        int bab = p[p[p[xi + 1] + yi] + zi + 1];
-        int bbb = p[p[p[xi + 1] + yi + 1] + zi + 1];
-        
-        double x1 = lerp(grad(aaa, xf, yf, zf), grad(baa, xf - 1, yf, zf), u);
-        double x2 = lerp(grad(aba, xf, yf - 1, zf), grad(bba, xf - 1, yf - 1, zf), u);
-        double y1 = lerp(x1, x2, v);
-        
-        double x3 = lerp(grad(aab, xf, yf, zf - 1), grad(bab, xf - 1, yf, zf - 1), u);
-        double x4 = lerp(grad(abb, xf, yf - 1, zf - 1), grad(bbb, xf - 1, yf - 1, zf - 1), u);
-        double y2 = lerp(x3, x4, v);
-        
-        return (lerp(y1, y2, w) + 1.0) / 2.0; // Normalize to [0,1]
-    }
-    
-    double fade(double t) { return t * t * t * (t * (t * 6 - 15) + 10); }
-    double lerp(double a, double b, double t) { return a + t * (b - a); }
-    double grad(int hash, double x, double y, double z) {
-        int h = hash & 15;
-        double u = h < 8 ? x : y;
-        double v = h < 4 ? y : h == 12 || h == 14 ? x : z;
-        return ((h & 1) == 0 ? u : -u) + ((h & 2) == 0 ? v : -v);
-    }
-    
-    int p[512] = {
-        151,160,137,91,90,15,131,13,201,95,96,53,194,233,7,225,140,36,103,30,69,142,8,99,37,240,21,10,23,
-        190,6,148,247,120,234,75,0,26,197,62,94,252,219,203,117,35,11,32,57,177,33,88,237,149,56,87,174,
-        20,125,136,171,168,68,175,74,165,71,134,139,48,27,166,77,146,158,231,83,111,229,122,60,211,133,
-        230,220,105,92,41,55,46,245,40,244,102,143,54,65,25,63,161,1,216,80,73,209,76,132,187,208,89,18,
-        169,200,196,135,130,116,188,159,86,164,100,109,198,173,186,3,64,52,217,226,250,124,123,5,202,38,
-        147,118,126,255,82,85,212,207,206,59,227,47,16,58,17,182,189,28,42,223,183,170,213,119,248,152,2,
-        44,154,163,70,221,153,101,155,167,43,172,9,129,22,39,253,19,98,108,110,79,113,224,232,178,185,112,
-        104,218,246,97,228,251,34,242,193,238,210,144,12,191,179,162,241,81,51,145,235,249,14,239,107,49,
-        192,214,31,181,199,106,157,184,84,204,176,115,121,50,45,127,4,150,254,138,236,205,93,222,114,67,29,
-        24,72,243,141,128,195,78,66,215,61,156,180,
-        // Repeat the array
-        151,160,137,91,90,15,131,13,201,95,96,53,194,233,7,225,140,36,103,30,69,142,8,99,37,240,21,10,23,
-        190,6,148,247,120,234,75,0,26,197,62,94,252,219,203,117,35,11,32,57,177,33,88,237,149,56,87,174,
-        20,125,136,171,168,68,175,74,165,71,134,139,48,27,166,77,146,158,231,83,111,229,122,60,211,133,
-        230,220,105,92,41,55,46,245,40,244,102,143,54,65,25,63,161,1,216,80,73,209,76,132,187,208,89,18,
-        169,200,196,135,130,116,188,159,86,164,100,109,198,173,186,3,64,52,217,226,250,124,123,5,202,38,
-        147,118,126,255,82,85,212,207,206,59,227,47,16,58,17,182,189,28,42,223,183,170,213,119,248,152,2,
-        44,154,163,70,221,153,101,155,167,43,172,9,129,22,39,253,19,98,108,110,79,113,224,232,178,185,112,
-        104,218,246,97,228,251,34,242,193,238,210,144,12,191,179,162,241,81,51,145,235,249,14,239,107,49,
-        192,214,31,181,199,106,157,184,84,204,176,115,121,50,45,127,4,150,254,138,236,205,93,222,114,67,29,
-        24,72,243,141,128,195,78,66,215,61,156,180
-    };
+    const NoiseEngine& noise = NoiseEngine::shared();
 };
 
 // Enhanced SI Model for Ultra Hi-Definition and Photo-Based Video Generation
@@ -163,22 +865,62 @@ public:
         LOG_INFO("AdvancedSyntheticIntelligence initialized");
     }
 
+    static constexpr int width8K = 7680;
+    static constexpr int height8K = 4320;
+    static constexpr int maxFramesInFlight = 4;     // Rendering, encoding, and two queued to absorb jitter
+
     // Generate a single 8K frame procedurally with photorealistic effects
     cv::Mat generate8KFrame(double time) {
-        int width = 7680;
-        int height = 4320;
-        cv::Mat frame(height, width, CV_8UC3, cv::Scalar(0, 0, 0));
+        cv::Mat frame(height8K, width8K, CV_8UC3);
+        render8KFrame(time, frame);
+        return frame;
+    }
 
-        // Example: Ray tracing-like lighting simulation
-        for (int y = 0; y < height; ++y) {
-            for (int x = 0; x < width; ++x) {
-                double intensity = std::sin(x * 0.0001 + time) * std::cos(y * 0.0001 + time);
-                uchar color = static_cast<uchar>((intensity + 1.0) * 127.5);
-                frame.at<cv::Vec3b>(y, x) = cv::Vec3b(color, color, color);
+    // Renders into an existing 8K BGR buffer, tile by tile on all cores
+    void render8KFrame(double time, cv::Mat& frame) {
+        // Example: Ray tracing-like lighting simulation, sin(x) * cos(y),
+        // with both factors evaluated once per column / row
+        std::vector<double> column(frame.cols), row(frame.rows);
+        for (int x = 0; x < frame.cols; ++x) column[x] = std::sin(x * 0.0001 + time);
+        for (int y = 0; y < frame.rows; ++y) row[y] = std::cos(y * 0.0001 + time);
+
+        TileRenderer::render(frame, TileRenderer::defaultTileSize(), [&](cv::Mat& tile, const cv::Rect& region) {
+            for (int y = 0; y < tile.rows; ++y) {
+                const double rowTerm = row[region.y + y];
+                const double* columnTerm = column.data() + region.x;
+                uchar* out = tile.ptr<uchar>(y);
+                for (int x = 0; x < tile.cols; ++x) {
+                    uchar color = static_cast<uchar>((columnTerm[x] * rowTerm + 1.0) * 127.5);
+                    out[3 * x] = out[3 * x + 1] = out[3 * x + 2] = color;
+                }
             }
+        });
+    }
+
+    // Streams 8K frames to the writer while later frames render. Frames
+    // render one at a time, so beyond the one being rendered and the one
+    // being encoded, framesInFlight only bounds how many finished frames
+    // (~100 MB each) may queue ahead of the encoder. Requests are clamped to
+    // 1..maxFramesInFlight.
+    void generate8KVideo(const std::string& outputPath, double duration, double frameRate, int framesInFlight) {
+        framesInFlight = std::min(std::max(1, framesInFlight), maxFramesInFlight);
+
+        FrameSink writer(FrameSink::Settings(outputPath, cv::Size(width8K, height8K), frameRate));
+
+        if (!writer.open()) {
+            throw std::runtime_error("Failed to open video writer: " + writer.getError());
         }
 
-        return frame;
+        // Tile tasks are batch work; interactive requests go ahead of them
+        FiberOpticThreading::PriorityScope priority(FiberOpticThreading::Priority::Export);
+        FrameStreamer streamer(cv::Size(width8K, height8K), CV_8UC3, framesInFlight);
+        streamer.run(static_cast<int>(std::ceil(duration * frameRate)),
+            [&](int frameNumber, cv::Mat& frame) { render8KFrame(frameNumber / frameRate, frame); },
+            [&](const cv::Mat& frame) { writer.writeFrame(frame); });
+
+        if (!writer.close()) {
+            throw std::runtime_error("Failed to finish video: " + writer.getError());
+        }
     }
 
     // Step inside a photo and create a virtual environment
@@ -190,19 +932,21 @@ public:
 
         int width = photo.cols;
         int height = photo.rows;
-        cv::VideoWriter writer(outputPath, cv::VideoWriter::fourcc('M', 'J', 'P', 'G'), frameRate, cv::Size(width, height));
+        FrameSink writer(FrameSink::Settings(outputPath, cv::Size(width, height), frameRate));
 
-        if (!writer.isOpened()) {
-            throw std::runtime_error("Failed to open video writer");
+        if (!writer.open()) {
+            throw std::runtime_error("Failed to open video writer: " + writer.getError());
         }
 
         for (int frameNumber = 0; frameNumber < duration * frameRate; ++frameNumber) {
             double time = frameNumber / frameRate;
             cv::Mat frame = simulateEnvironment(photo, time, mode);
-            writer.write(frame);
+            writer.writeFrame(frame);
         }
 
-        writer.release();
+        if (!writer.close()) {
+            throw std::runtime_error("Failed to finish video: " + writer.getError());
+        }
     }
 
 private:
@@ -235,16 +979,22 @@ private:
             
         } else if (mode == "4D") {
             // Add dynamic lighting and particle effects for 4D
-            cv::Mat hsv;
-            cv::cvtColor(photo, hsv, cv::COLOR_BGR2HSV);
-            
-            // Dynamic hue shift
+            // Dynamic hue shift. The shift is whole HSV units, so there are
+            // only a few dozen distinct ones; each is baked into a LUT once.
             double hueShift = std::sin(time * 2.0) * 30;
-            hsv.forEach<cv::Vec3b>([hueShift](cv::Vec3b &pixel, const int *position) -> void {
-                pixel[0] = (pixel[0] + static_cast<uchar>(hueShift)) % 180;
+            uchar shift = static_cast<uchar>(static_cast<int>(hueShift));
+            auto lut = ColorLUT::cached("hue_shift:" + std::to_string(shift), [shift]() {
+                return ColorLUT::fromOperation([shift](const cv::Mat& lattice) {
+                    cv::Mat hsv, shifted;
+                    cv::cvtColor(lattice, hsv, cv::COLOR_BGR2HSV);
+                    hsv.forEach<cv::Vec3b>([shift](cv::Vec3b &pixel, const int *position) -> void {
+                        pixel[0] = (pixel[0] + shift) % 180;
+                    });
+                    cv::cvtColor(hsv, shifted, cv::COLOR_HSV2BGR);
+                    return shifted;
+                });
             });
-            
-            cv::cvtColor(hsv, environment, cv::COLOR_HSV2BGR);
+            lut->apply(photo, environment);
             
             // Add particle-like effects
             for (int i = 0; i < 50; ++i) {
@@ -278,50 +1028,46 @@ public:
         // Step 3: Create video writer
         int width = 1920;
         int height = 1080;
-        cv::VideoWriter writer(outputPath, cv::VideoWriter::fourcc('M', 'J', 'P', 'G'), frameRate, cv::Size(width, height));
+        FrameSink writer(FrameSink::Settings(outputPath, cv::Size(width, height), frameRate));
 
-        if (!writer.isOpened()) {
-            throw std::runtime_error("Failed to open video writer");
+        if (!writer.open()) {
+            throw std::runtime_error("Failed to open video writer: " + writer.getError());
         }
 
-        // Step 4: Generate frames for each lyric line
+        // Step 4: Generate frames for each lyric line. Cards share one
+        // buffer; only the previous line's rectangle is cleared.
+        TextCompositor cards(cv::Mat(height, width, CV_8UC3, cv::Scalar(0, 0, 0)));
         double timePerLyric = audioDuration / lyrics.size();
         for (size_t i = 0; i < lyrics.size(); ++i) {
             double startTime = i * timePerLyric;
             double endTime = (i + 1) * timePerLyric;
 
+            // The lyric card is static: render it once and hold it
+            int frameCount = 0;
             for (double t = startTime; t < endTime; t += 1.0 / frameRate) {
-                cv::Mat frame = generateLyricFrame(lyrics[i], width, height);
-                writer.write(frame);
+                ++frameCount;
+            }
+            if (frameCount > 0) {
+                auto layer = TextRenderer::shared().layer(lyrics[i], cardStyle());
+                writer.writeFrame(cards.draw(*layer, TextRenderer::centered(*layer, cv::Size(width, height))));
+                writer.repeatFrame(frameCount - 1);
             }
         }
 
-        writer.release();
+        if (!writer.close()) {
+            throw std::runtime_error("Failed to finish video: " + writer.getError());
+        }
     }
 
 private:
-    // Extract audio duration using FFmpeg
+    // Audio duration from the shared media probe
     double getAudioDuration(const std::string& audioPath) {
-        std::string command = "ffprobe -v quiet -print_format json -show_format \"" + audioPath + "\"";
-        FILE* pipe = popen(command.c_str(), "r");
-        if (!pipe) return 180.0; // fallback
-        
-        char buffer[128];
-        std::string result = "";
-        while (fgets(buffer, sizeof(buffer), pipe) != nullptr) {
-            result += buffer;
-        }
-        pclose(pipe);
-        
-        // Parse JSON for duration
-        Json::Value root;
-        Json::Reader reader;
-        if (reader.parse(result, root)) {
-            if (root.isMember("format") && root["format"].isMember("duration")) {
-                return root["format"]["duration"].asDouble();
-            }
+        MediaProbe::MediaInfo media = MediaProbe::shared().probe(audioPath);
+        if (!media.valid || media.duration <= 0.0) {
+            throw std::runtime_error("Failed to read audio duration: " +
+                                     (media.valid ? "no duration in " + audioPath : media.error));
         }
-        return 180.0; // fallback
+        return media.duration;
     }
 
     // Extract lyrics from the audio file (placeholder for real implementation)
@@ -330,21 +1076,8 @@ private:
         return {"This is the first line of the song", "This is the second line", "And so on..."};
     }
 
-    // Generate a frame with the given lyric text
-    cv::Mat generateLyricFrame(const std::string& lyric, int width, int height) {
-        cv::Mat frame(height, width, CV_8UC3, cv::Scalar(0, 0, 0));
-
-        // Add the lyric text to the frame
-        int fontFace = cv::FONT_HERSHEY_SIMPLEX;
-        double fontScale = 2.0;
-        int thickness = 3;
-        int baseline = 0;
-        cv::Size textSize = cv::getTextSize(lyric, fontFace, fontScale, thickness, &baseline);
-
-        cv::Point textOrg((width - textSize.width) / 2, (height + textSize.height) / 2);
-        cv::putText(frame, lyric, textOrg, fontFace, fontScale, cv::Scalar(255, 255, 255), thickness);
-
-        return frame;
+    static TextRenderer::Style cardStyle() {
+        return TextRenderer::Style(2.0, 3);
     }
 };
 
@@ -356,22 +1089,28 @@ void WebSocketServer::handleGenerateVideo(const Json::Value& request, Json::Valu
     double frameRate = request["params"].get("frameRate", 30.0).asDouble();
 
     SyntheticIntelligence si;
-    std::string outputPath = "generated_video.avi";
-    cv::VideoWriter writer(outputPath, cv::VideoWriter::fourcc('M', 'J', 'P', 'G'), frameRate, cv::Size(width, height));
+    std::string outputPath = "generated_video.mp4";
+    FrameSink::Settings sinkSettings(outputPath, cv::Size(width, height), frameRate);
+    sinkSettings.applyParams(request["params"]);
+    FrameSink writer(sinkSettings);
 
-    if (!writer.isOpened()) {
+    if (!writer.open()) {
         response["status"] = "error";
-        response["error"] = "Failed to open video writer";
+        response["error"] = "Failed to open video writer: " + writer.getError();
         return;
     }
 
     for (int frameNumber = 0; frameNumber < duration * frameRate; ++frameNumber) {
         double time = frameNumber / frameRate;
         cv::Mat frame = si.generateFrame(width, height, time);
-        writer.write(frame);
+        writer.writeFrame(frame);
     }
 
-    writer.release();
+    if (!writer.close()) {
+        response["status"] = "error";
+        response["error"] = "Failed to finish video: " + writer.getError();
+        return;
+    }
 
     response["status"] = "success";
     response["data"]["outputPath"] = outputPath;
@@ -379,7 +1118,7 @@ void WebSocketServer::handleGenerateVideo(const Json::Value& request, Json::Valu
 
 void WebSocketServer::handleApplyEffect(const Json::Value& request, Json::Value& response) {
     std::string inputPath = request["params"].get("inputPath", "").asString();
-    std::string outputPath = request["params"].get("outputPath", "output_effect.avi").asString();
+    std::string outputPath = request["params"].get("outputPath", "output_effect.mp4").asString();
     std::string effect = request["params"].get("effect", "").asString();
 
     if (inputPath.empty() || effect.empty()) {
@@ -399,10 +1138,12 @@ void WebSocketServer::handleApplyEffect(const Json::Value& request, Json::Value&
     int height = static_cast<int>(capture.get(cv::CAP_PROP_FRAME_HEIGHT));
     double frameRate = capture.get(cv::CAP_PROP_FPS);
 
-    cv::VideoWriter writer(outputPath, cv::VideoWriter::fourcc('M', 'J', 'P', 'G'), frameRate, cv::Size(width, height));
-    if (!writer.isOpened()) {
+    FrameSink::Settings sinkSettings(outputPath, cv::Size(width, height), frameRate);
+    sinkSettings.applyParams(request["params"]);
+    FrameSink writer(sinkSettings);
+    if (!writer.open()) {
         response["status"] = "error";
-        response["error"] = "Failed to open video writer";
+        response["error"] = "Failed to open video writer: " + writer.getError();
         return;
     }
 
@@ -415,11 +1156,15 @@ void WebSocketServer::handleApplyEffect(const Json::Value& request, Json::Value&
         }
 
         cv::Mat processedFrame = si.applyEffect(frame, effect, params);
-        writer.write(processedFrame);
+        writer.writeFrame(processedFrame);
     }
 
     capture.release();
-    writer.release();
+    if (!writer.close()) {
+        response["status"] = "error";
+        response["error"] = "Failed to finish video: " + writer.getError();
+        return;
+    }
 
     response["status"] = "success";
     response["data"]["outputPath"] = outputPath;
@@ -432,7 +1177,7 @@ void WebSocketServer::handleGenerateEnhancedVideo(const Json::Value& request, Js
     double duration = request["params"].get("duration", 5.0).asDouble();
     double frameRate = request["params"].get("frameRate", 30.0).asDouble();
 
-    std::string outputPath = "enhanced_generated_video.avi";
+    std::string outputPath = "enhanced_generated_video.mp4";
 
     try {
         EnhancedSyntheticIntelligence esi;
@@ -450,23 +1195,12 @@ void WebSocketServer::handleGenerateEnhancedVideo(const Json::Value& request, Js
 void WebSocketServer::handleGenerate8KVideo(const Json::Value& request, Json::Value& response) {
     double duration = request["params"].get("duration", 5.0).asDouble();
     double frameRate = request["params"].get("frameRate", 30.0).asDouble();
-    std::string outputPath = "8k_generated_video.avi";
+    int framesInFlight = request["params"].get("framesInFlight", 3).asInt();
+    std::string outputPath = "8k_generated_video.mp4";
 
     try {
         AdvancedSyntheticIntelligence asi;
-        cv::VideoWriter writer(outputPath, cv::VideoWriter::fourcc('M', 'J', 'P', 'G'), frameRate, cv::Size(7680, 4320));
-
-        if (!writer.isOpened()) {
-            throw std::runtime_error("Failed to open video writer");
-        }
-
-        for (int frameNumber = 0; frameNumber < duration * frameRate; ++frameNumber) {
-            double time = frameNumber / frameRate;
-            cv::Mat frame = asi.generate8KFrame(time);
-            writer.write(frame);
-        }
-
-        writer.release();
+        asi.generate8KVideo(outputPath, duration, frameRate, framesInFlight);
 
         response["status"] = "success";
         response["data"]["outputPath"] = outputPath;
@@ -478,7 +1212,7 @@ void WebSocketServer::handleGenerate8KVideo(const Json::Value& request, Json::Va
 
 void WebSocketServer::handlePhotoEnvironment(const Json::Value& request, Json::Value& response) {
     std::string photoPath = request["params"].get("photoPath", "").asString();
-    std::string outputPath = request["params"].get("outputPath", "photo_environment_video.avi").asString();
+    std::string outputPath = request["params"].get("outputPath", "photo_environment_video.mp4").asString();
     double duration = request["params"].get("duration", 5.0).asDouble();
     double frameRate = request["params"].get("frameRate", 30.0).asDouble();
     std::string mode = request["params"].get("mode", "2D").asString();
@@ -498,7 +1232,7 @@ void WebSocketServer::handlePhotoEnvironment(const Json::Value& request, Json::V
 // Extend WebSocketServer to handle audio-to-video requests
 void WebSocketServer::handleGenerateVideoFromAudio(const Json::Value& request, Json::Value& response) {
     std::string audioPath = request["params"].get("audioPath", "").asString();
-    std::string outputPath = request["params"].get("outputPath", "audio_to_video.avi").asString();
+    std::string outputPath = request["params"].get("outputPath", "audio_to_video.mp4").asString();
     double frameRate = request["params"].get("frameRate", 30.0).asDouble();
 
     try {
@@ -520,19 +1254,13 @@ public:
         LOG_INFO("NeuralSyntheticIntelligence initialized");
     }
 
-    // Lightweight neural network for feature extraction
-    std::vector<std::vector<float>> neuralNetwork(const cv::Mat& input) {
-        int rows = input.rows;
-        int cols = input.cols;
-        std::vector<std::vector<float>> features(rows, std::vector<float>(cols, 0.0f));
-
-        for (int y = 0; y < rows; ++y) {
-            for (int x = 0; x < cols; ++x) {
-                cv::Vec3b pixel = input.at<cv::Vec3b>(y, x);
-                features[y][x] = (pixel[0] + pixel[1] + pixel[2]) / 3.0f / 255.0f; // Normalize grayscale
-            }
-        }
-
+    // Lightweight neural network for feature extraction: normalised
+    // grayscale as one contiguous CV_32F map
+    cv::Mat neuralNetwork(const cv::Mat& input) {
+        cv::Mat pixels, features;
+        input.convertTo(pixels, CV_32F);
+        const float weight = 1.0f / 3.0f / 255.0f;
+        cv::transform(pixels, features, cv::Matx13f(weight, weight, weight));
         return features;
     }
 
@@ -544,49 +1272,35 @@ public:
         }
 
         // Extract features using the neural network
-        auto features = neuralNetwork(photo);
+        cv::Mat features = neuralNetwork(photo);
 
         // Generate a 3D mesh based on features (simplified example)
-        cv::Mat depthMap(photo.size(), CV_32F);
-        for (int y = 0; y < photo.rows; ++y) {
-            for (int x = 0; x < photo.cols; ++x) {
-                depthMap.at<float>(y, x) = features[y][x] * 100.0f; // Scale depth
-            }
-        }
+        cv::Mat depthMap = features * 100.0f; // Scale depth
+        ParallaxEngine parallax(photo, depthMap);
 
         // Create video writer
-        cv::VideoWriter writer(outputPath, cv::VideoWriter::fourcc('M', 'J', 'P', 'G'), frameRate, photo.size());
-        if (!writer.isOpened()) {
-            throw std::runtime_error("Failed to open video writer");
+        FrameSink writer(FrameSink::Settings(outputPath, photo.size(), frameRate));
+        if (!writer.open()) {
+            throw std::runtime_error("Failed to open video writer: " + writer.getError());
         }
 
-        // Simulate camera movement through the 3D environment
+        // Simulate camera movement through the 3D environment. The sink
+        // converts the frame before returning, so one buffer serves every frame.
+        cv::Mat frame;
         for (int frameNumber = 0; frameNumber < duration * frameRate; ++frameNumber) {
             double time = frameNumber / frameRate;
-            cv::Mat frame = render3DFrame(photo, depthMap, time);
-            writer.write(frame);
+            parallax.render(ParallaxEngine::Camera::orbit(time), frame);
+            writer.writeFrame(frame);
         }
 
-        writer.release();
+        if (!writer.close()) {
+            throw std::runtime_error("Failed to finish video: " + writer.getError());
+        }
     }
 
     // Render a single frame of the 3D environment
     cv::Mat render3DFrame(const cv::Mat& photo, const cv::Mat& depthMap, double time) {
-        cv::Mat frame = photo.clone();
-
-        // Apply a simple transformation to simulate camera movement
-        double offsetX = std::sin(time) * 10.0;
-        double offsetY = std::cos(time) * 10.0;
-
-        for (int y = 0; y < frame.rows; ++y) {
-            for (int x = 0; x < frame.cols; ++x) {
-                int newX = std::clamp(static_cast<int>(x + offsetX * depthMap.at<float>(y, x)), 0, frame.cols - 1);
-                int newY = std::clamp(static_cast<int>(y + offsetY * depthMap.at<float>(y, x)), 0, frame.rows - 1);
-                frame.at<cv::Vec3b>(y, x) = photo.at<cv::Vec3b>(newY, newX);
-            }
-        }
-
-        return frame;
+        return ParallaxEngine(photo, depthMap).render(ParallaxEngine::Camera::orbit(time));
     }
 
     // Semantic understanding for audio-driven video generation
@@ -601,44 +1315,36 @@ public:
 
         int width = 1920;
         int height = 1080;
-        cv::VideoWriter writer(outputPath, cv::VideoWriter::fourcc('M', 'J', 'P', 'G'), frameRate, cv::Size(width, height));
+        FrameSink writer(FrameSink::Settings(outputPath, cv::Size(width, height), frameRate));
 
-        if (!writer.isOpened()) {
-            throw std::runtime_error("Failed to open video writer");
+        if (!writer.open()) {
+            throw std::runtime_error("Failed to open video writer: " + writer.getError());
         }
 
+        int framesPerScene = static_cast<int>(std::ceil(frameRate * 5)); // 5 seconds per scene
+        TextCompositor cards(cv::Mat(height, width, CV_8UC3, cv::Scalar(0, 0, 0)));
         for (const auto& scene : scenes) {
-            for (int frameNumber = 0; frameNumber < frameRate * 5; ++frameNumber) { // 5 seconds per scene
-                cv::Mat frame = generateSceneFrame(scene, width, height);
-                writer.write(frame);
-            }
+            if (framesPerScene <= 0) break;
+            // Scene cards are static: render once and hold for the scene
+            auto layer = TextRenderer::shared().layer(scene, cardStyle());
+            writer.writeFrame(cards.draw(*layer, TextRenderer::centered(*layer, cv::Size(width, height))));
+            writer.repeatFrame(framesPerScene - 1);
         }
 
-        writer.release();
+        if (!writer.close()) {
+            throw std::runtime_error("Failed to finish video: " + writer.getError());
+        }
     }
 
-    // Generate a frame for a specific scene
-    cv::Mat generateSceneFrame(const std::string& scene, int width, int height) {
-        cv::Mat frame(height, width, CV_8UC3, cv::Scalar(0, 0, 0));
-
-        // Add scene description as text
-        int fontFace = cv::FONT_HERSHEY_SIMPLEX;
-        double fontScale = 2.0;
-        int thickness = 3;
-        int baseline = 0;
-        cv::Size textSize = cv::getTextSize(scene, fontFace, fontScale, thickness, &baseline);
-
-        cv::Point textOrg((width - textSize.width) / 2, (height + textSize.height) / 2);
-        cv::putText(frame, scene, textOrg, fontFace, fontScale, cv::Scalar(255, 255, 255), thickness);
-
-        return frame;
+    static TextRenderer::Style cardStyle() {
+        return TextRenderer::Style(2.0, 3);
     }
 };
 
 // Extend WebSocketServer to handle advanced SI requests
 void WebSocketServer::handleCreate3DEnvironment(const Json::Value& request, Json::Value& response) {
     std::string photoPath = request["params"].get("photoPath", "").asString();
-    std::string outputPath = request["params"].get("outputPath", "3d_environment_video.avi").asString();
+    std::string outputPath = request["params"].get("outputPath", "3d_environment_video.mp4").asString();
     double duration = request["params"].get("duration", 5.0).asDouble();
     double frameRate = request["params"].get("frameRate", 30.0).asDouble();
 
@@ -656,7 +1362,7 @@ void WebSocketServer::handleCreate3DEnvironment(const Json::Value& request, Json
 
 void WebSocketServer::handleGenerateSemanticVideo(const Json::Value& request, Json::Value& response) {
     std::string audioPath = request["params"].get("audioPath", "").asString();
-    std::string outputPath = request["params"].get("outputPath", "semantic_video.avi").asString();
+    std::string outputPath = request["params"].get("outputPath", "semantic_video.mp4").asString();
     double frameRate = request["params"].get("frameRate", 30.0).asDouble();
 
     try {
@@ -679,22 +1385,9 @@ public:
     }
 
     // Diffusion-based video generation
-    cv::Mat generateDiffusionFrame(int width, int height, int steps, double time) {
-        cv::Mat frame(height, width, CV_8UC3, cv::Scalar(0, 0, 0));
-
-        for (int step = 0; step < steps; ++step) {
-            double noiseFactor = 1.0 - (static_cast<double>(step) / steps);
-            for (int y = 0; y < height; ++y) {
-                for (int x = 0; x < width; ++x) {
-                    cv::Vec3b& pixel = frame.at<cv::Vec3b>(y, x);
-                    pixel[0] = static_cast<uchar>(pixel[0] + noiseFactor * std::sin(x * 0.01 + time) * 255);
-                    pixel[1] = static_cast<uchar>(pixel[1] + noiseFactor * std::cos(y * 0.01 + time) * 255);
-                    pixel[2] = static_cast<uchar>(pixel[2] + noiseFactor * std::sin((x + y) * 0.01 + time) * 255);
-                }
-            }
-        }
-
-        return frame;
+    cv::Mat generateDiffusionFrame(int width, int height, int steps, double time,
+                                   DiffusionEngine::Accumulation accumulation = DiffusionEngine::Accumulation::Wrap) {
+        return DiffusionEngine::render(width, height, steps, time, accumulation);
     }
 
     // SI Agent for depth estimation
@@ -764,18 +1457,22 @@ public:
         auto objects = recognizeObjects(photo);
         cv::Mat scene = generateScene(photo, depth, objects);
 
-        cv::VideoWriter writer(outputPath, cv::VideoWriter::fourcc('M', 'J', 'P', 'G'), frameRate, photo.size());
-        if (!writer.isOpened()) {
-            throw std::runtime_error("Failed to open video writer");
+        FrameSink writer(FrameSink::Settings(outputPath, photo.size(), frameRate));
+        if (!writer.open()) {
+            throw std::runtime_error("Failed to open video writer: " + writer.getError());
         }
 
-        for (int frameNumber = 0; frameNumber < duration * frameRate; ++frameNumber) {
-            double time = frameNumber / frameRate;
-            cv::Mat frame = applyRayTracing(scene, depth);
-            writer.write(frame);
+        // Nothing in the traced scene depends on time: trace it once and
+        // hold it for the whole clip
+        int frameCount = static_cast<int>(std::ceil(duration * frameRate));
+        if (frameCount > 0) {
+            writer.writeFrame(applyRayTracing(scene, depth));
+            writer.repeatFrame(frameCount - 1);
         }
 
-        writer.release();
+        if (!writer.close()) {
+            throw std::runtime_error("Failed to finish video: " + writer.getError());
+        }
     }
 };
 
@@ -786,23 +1483,29 @@ void WebSocketServer::handleGenerateDiffusionVideo(const Json::Value& request, J
     int steps = request["params"].get("steps", 100).asInt();
     double duration = request["params"].get("duration", 5.0).asDouble();
     double frameRate = request["params"].get("frameRate", 30.0).asDouble();
-    std::string outputPath = request["params"].get("outputPath", "diffusion_video.avi").asString();
+    std::string outputPath = request["params"].get("outputPath", "diffusion_video.mp4").asString();
+    DiffusionEngine::Accumulation accumulation =
+        DiffusionEngine::parseAccumulation(request["params"].get("accumulation", "wrap").asString());
 
     try {
         AdvancedNeuralSyntheticIntelligence ansi;
-        cv::VideoWriter writer(outputPath, cv::VideoWriter::fourcc('M', 'J', 'P', 'G'), frameRate, cv::Size(width, height));
+        FrameSink::Settings sinkSettings(outputPath, cv::Size(width, height), frameRate);
+        sinkSettings.applyParams(request["params"]);
+        FrameSink writer(sinkSettings);
 
-        if (!writer.isOpened()) {
-            throw std::runtime_error("Failed to open video writer");
+        if (!writer.open()) {
+            throw std::runtime_error("Failed to open video writer: " + writer.getError());
         }
 
         for (int frameNumber = 0; frameNumber < duration * frameRate; ++frameNumber) {
             double time = frameNumber / frameRate;
-            cv::Mat frame = ansi.generateDiffusionFrame(width, height, steps, time);
-            writer.write(frame);
+            cv::Mat frame = ansi.generateDiffusionFrame(width, height, steps, time, accumulation);
+            writer.writeFrame(frame);
         }
 
-        writer.release();
+        if (!writer.close()) {
+            throw std::runtime_error("Failed to finish video: " + writer.getError());
+        }
 
         response["status"] = "success";
         response["data"]["outputPath"] = outputPath;
@@ -814,7 +1517,7 @@ void WebSocketServer::handleGenerateDiffusionVideo(const Json::Value& request, J
 
 void WebSocketServer::handleGeneratePhotorealistic3D(const Json::Value& request, Json::Value& response) {
     std::string photoPath = request["params"].get("photoPath", "").asString();
-    std::string outputPath = request["params"].get("outputPath", "photorealistic_3d.avi").asString();
+    std::string outputPath = request["params"].get("outputPath", "photorealistic_3d.mp4").asString();
     double duration = request["params"].get("duration", 5.0).asDouble();
     double frameRate = request["params"].get("frameRate", 30.0).asDouble();
 
@@ -838,22 +1541,9 @@ public:
     }
 
     // Custom diffusion process for video generation
-    cv::Mat generateCustomDiffusionFrame(int width, int height, int steps, double time) {
-        cv::Mat frame(height, width, CV_8UC3, cv::Scalar(0, 0, 0));
-
-        for (int step = 0; step < steps; ++step) {
-            double refinementFactor = 1.0 - (static_cast<double>(step) / steps);
-            for (int y = 0; y < height; ++y) {
-                for (int x = 0; x < width; ++x) {
-                    cv::Vec3b& pixel = frame.at<cv::Vec3b>(y, x);
-                    pixel[0] = static_cast<uchar>(pixel[0] + refinementFactor * std::sin(x * 0.01 + time) * 255);
-                    pixel[1] = static_cast<uchar>(pixel[1] + refinementFactor * std::cos(y * 0.01 + time) * 255);
-                    pixel[2] = static_cast<uchar>(pixel[2] + refinementFactor * std::sin((x + y) * 0.01 + time) * 255);
-                }
-            }
-        }
-
-        return frame;
+    cv::Mat generateCustomDiffusionFrame(int width, int height, int steps, double time,
+                                         DiffusionEngine::Accumulation accumulation = DiffusionEngine::Accumulation::Wrap) {
+        return DiffusionEngine::render(width, height, steps, time, accumulation);
     }
 
     // Custom depth estimation agent
@@ -923,18 +1613,22 @@ public:
         auto objects = recognizeObjectsCustom(photo);
         cv::Mat scene = generateSceneCustom(photo, depth, objects);
 
-        cv::VideoWriter writer(outputPath, cv::VideoWriter::fourcc('M', 'J', 'P', 'G'), frameRate, photo.size());
-        if (!writer.isOpened()) {
-            throw std::runtime_error("Failed to open video writer");
+        FrameSink writer(FrameSink::Settings(outputPath, photo.size(), frameRate));
+        if (!writer.open()) {
+            throw std::runtime_error("Failed to open video writer: " + writer.getError());
         }
 
-        for (int frameNumber = 0; frameNumber < duration * frameRate; ++frameNumber) {
-            double time = frameNumber / frameRate;
-            cv::Mat frame = applyCustomRayTracing(scene, depth);
-            writer.write(frame);
+        // Nothing in the traced scene depends on time: trace it once and
+        // hold it for the whole clip
+        int frameCount = static_cast<int>(std::ceil(duration * frameRate));
+        if (frameCount > 0) {
+            writer.writeFrame(applyCustomRayTracing(scene, depth));
+            writer.repeatFrame(frameCount - 1);
         }
 
-        writer.release();
+        if (!writer.close()) {
+            throw std::runtime_error("Failed to finish video: " + writer.getError());
+        }
     }
 };
 
@@ -945,23 +1639,29 @@ void WebSocketServer::handleGenerateCustomDiffusionVideo(const Json::Value& requ
     int steps = request["params"].get("steps", 100).asInt();
     double duration = request["params"].get("duration", 5.0).asDouble();
     double frameRate = request["params"].get("frameRate", 30.0).asDouble();
-    std::string outputPath = request["params"].get("outputPath", "custom_diffusion_video.avi").asString();
+    std::string outputPath = request["params"].get("outputPath", "custom_diffusion_video.mp4").asString();
+    DiffusionEngine::Accumulation accumulation =
+        DiffusionEngine::parseAccumulation(request["params"].get("accumulation", "wrap").asString());
 
     try {
         CustomSyntheticIntelligence csi;
-        cv::VideoWriter writer(outputPath, cv::VideoWriter::fourcc('M', 'J', 'P', 'G'), frameRate, cv::Size(width, height));
+        FrameSink::Settings sinkSettings(outputPath, cv::Size(width, height), frameRate);
+        sinkSettings.applyParams(request["params"]);
+        FrameSink writer(sinkSettings);
 
-        if (!writer.isOpened()) {
-            throw std::runtime_error("Failed to open video writer");
+        if (!writer.open()) {
+            throw std::runtime_error("Failed to open video writer: " + writer.getError());
         }
 
         for (int frameNumber = 0; frameNumber < duration * frameRate; ++frameNumber) {
             double time = frameNumber / frameRate;
-            cv::Mat frame = csi.generateCustomDiffusionFrame(width, height, steps, time);
-            writer.write(frame);
+            cv::Mat frame = csi.generateCustomDiffusionFrame(width, height, steps, time, accumulation);
+            writer.writeFrame(frame);
         }
 
-        writer.release();
+        if (!writer.close()) {
+            throw std::runtime_error("Failed to finish video: " + writer.getError());
+        }
 
         response["status"] = "success";
         response["data"]["outputPath"] = outputPath;
@@ -973,7 +1673,7 @@ void WebSocketServer::handleGenerateCustomDiffusionVideo(const Json::Value& requ
 
 void WebSocketServer::handleGeneratePhotorealistic3DCustom(const Json::Value& request, Json::Value& response) {
     std::string photoPath = request["params"].get("photoPath", "").asString();
-    std::string outputPath = request["params"].get("outputPath", "custom_photorealistic_3d.avi").asString();
+    std::string outputPath = request["params"].get("outputPath", "custom_photorealistic_3d.mp4").asString();
     double duration = request["params"].get("duration", 5.0).asDouble();
     double frameRate = request["params"].get("frameRate", 30.0).asDouble();
 
@@ -1016,36 +1716,20 @@ public:
 
     // Procedural texture generation for detailed environments
     cv::Mat generateProceduralTexture(int width, int height) {
-        cv::Mat texture(height, width, CV_8UC3);
-
-        for (int y = 0; y < height; ++y) {
-            for (int x = 0; x < width; ++x) {
-                uchar r = static_cast<uchar>((std::sin(x * 0.01) + 1.0) * 127.5);
-                uchar g = static_cast<uchar>((std::cos(y * 0.01) + 1.0) * 127.5);
-                uchar b = static_cast<uchar>((std::sin((x + y) * 0.01) + 1.0) * 127.5);
-                texture.at<cv::Vec3b>(y, x) = cv::Vec3b(b, g, r);
-            }
-        }
+        using Axis = ProceduralKernels::Axis;
+        auto r = ProceduralKernels::tabulate(Axis::X, width, height,
+            [](int x) { return static_cast<uchar>((std::sin(x * 0.01) + 1.0) * 127.5); });
+        auto g = ProceduralKernels::tabulate(Axis::Y, width, height,
+            [](int y) { return static_cast<uchar>((std::cos(y * 0.01) + 1.0) * 127.5); });
+        auto b = ProceduralKernels::tabulate(Axis::Diagonal, width, height,
+            [](int d) { return static_cast<uchar>((std::sin(d * 0.01) + 1.0) * 127.5); });
 
-        return texture;
+        return ProceduralKernels::composeBGR(width, height, b, g, r);
     }
 
     // Dynamic interactivity: Simulate camera navigation
     cv::Mat simulateCameraNavigation(const cv::Mat& scene, double time) {
-        cv::Mat navigatedScene = scene.clone();
-
-        double offsetX = std::sin(time) * 10.0;
-        double offsetY = std::cos(time) * 10.0;
-
-        for (int y = 0; y < scene.rows; ++y) {
-            for (int x = 0; x < scene.cols; ++x) {
-                int newX = std::clamp(static_cast<int>(x + offsetX), 0, scene.cols - 1);
-                int newY = std::clamp(static_cast<int>(y + offsetY), 0, scene.rows - 1);
-                navigatedScene.at<cv::Vec3b>(y, x) = scene.at<cv::Vec3b>(newY, newX);
-            }
-        }
-
-        return navigatedScene;
+        return ParallaxEngine(scene, cv::Mat()).render(ParallaxEngine::Camera::orbit(time));
     }
 
     // Generate a video with semantic understanding and textures
@@ -1054,40 +1738,44 @@ public:
 
         int width = 1920;
         int height = 1080;
-        cv::VideoWriter writer(outputPath, cv::VideoWriter::fourcc('M', 'J', 'P', 'G'), frameRate, cv::Size(width, height));
+        FrameSink writer(FrameSink::Settings(outputPath, cv::Size(width, height), frameRate));
 
-        if (!writer.isOpened()) {
-            throw std::runtime_error("Failed to open video writer");
+        if (!writer.open()) {
+            throw std::runtime_error("Failed to open video writer: " + writer.getError());
         }
 
+        cv::Mat frame;
         for (const auto& sceneDescription : semantics) {
-            cv::Mat texture = generateProceduralTexture(width, height);
+            // Depends only on the size, so every scene shares one copy
+            auto texture = EffectResourceCache::shared().get<cv::Mat>(
+                "procedural_texture:" + std::to_string(width) + "x" + std::to_string(height),
+                [&]() { return generateProceduralTexture(width, height); });
+            ParallaxEngine navigation(*texture, cv::Mat());
+
+            // Scene description overlay, rasterised once per scene
+            auto caption = TextRenderer::shared().layer(sceneDescription, TextRenderer::Style(1.5, 2));
+            cv::Point captionOrigin((width - caption->textSize.width) / 2, height - 50);
 
             for (int frameNumber = 0; frameNumber < frameRate * 5; ++frameNumber) { // 5 seconds per scene
                 double time = frameNumber / frameRate;
-                cv::Mat frame = simulateCameraNavigation(texture, time);
-
-                // Add scene description as overlay text
-                int fontFace = cv::FONT_HERSHEY_SIMPLEX;
-                double fontScale = 1.5;
-                int thickness = 2;
-                int baseline = 0;
-                cv::Size textSize = cv::getTextSize(sceneDescription, fontFace, fontScale, thickness, &baseline);
-                cv::Point textOrg((width - textSize.width) / 2, height - 50);
-                cv::putText(frame, sceneDescription, textOrg, fontFace, fontScale, cv::Scalar(255, 255, 255), thickness);
-
-                writer.write(frame);
+                navigation.render(ParallaxEngine::Camera::orbit(time), frame);
+
+                TextRenderer::composite(frame, *caption, captionOrigin);
+
+                writer.writeFrame(frame);
             }
         }
 
-        writer.release();
+        if (!writer.close()) {
+            throw std::runtime_error("Failed to finish video: " + writer.getError());
+        }
     }
 };
 
 // Extend WebSocketServer to handle enhanced SI requests
 void WebSocketServer::handleGenerateSemanticVideoWithTextures(const Json::Value& request, Json::Value& response) {
     std::string input = request["params"].get("input", "").asString();
-    std::string outputPath = request["params"].get("outputPath", "semantic_video_with_textures.avi").asString();
+    std::string outputPath = request["params"].get("outputPath", "semantic_video_with_textures.mp4").asString();
     double duration = request["params"].get("duration", 5.0).asDouble();
     double frameRate = request["params"].get("frameRate", 30.0).asDouble();
 
@@ -1112,18 +1800,15 @@ public:
 
     // Advanced procedural world generation for immersive environments
     cv::Mat generateProceduralWorld(int width, int height, double time) {
-        cv::Mat world(height, width, CV_8UC3);
-
-        for (int y = 0; y < height; ++y) {
-            for (int x = 0; x < width; ++x) {
-                uchar r = static_cast<uchar>((std::sin(x * 0.005 + time) + 1.0) * 127.5);
-                uchar g = static_cast<uchar>((std::cos(y * 0.005 + time) + 1.0) * 127.5);
-                uchar b = static_cast<uchar>((std::sin((x + y) * 0.005 + time) + 1.0) * 127.5);
-                world.at<cv::Vec3b>(y, x) = cv::Vec3b(b, g, r);
-            }
-        }
+        using Axis = ProceduralKernels::Axis;
+        auto r = ProceduralKernels::tabulate(Axis::X, width, height,
+            [time](int x) { return static_cast<uchar>((std::sin(x * 0.005 + time) + 1.0) * 127.5); });
+        auto g = ProceduralKernels::tabulate(Axis::Y, width, height,
+            [time](int y) { return static_cast<uchar>((std::cos(y * 0.005 + time) + 1.0) * 127.5); });
+        auto b = ProceduralKernels::tabulate(Axis::Diagonal, width, height,
+            [time](int d) { return static_cast<uchar>((std::sin(d * 0.005 + time) + 1.0) * 127.5); });
 
-        return world;
+        return ProceduralKernels::composeBGR(width, height, b, g, r);
     }
 
     // Real-time adaptive lighting simulation
@@ -1147,26 +1832,28 @@ public:
     void generateFuturisticVideo(const std::string& outputPath, double duration, double frameRate) {
         int width = 1920;
         int height = 1080;
-        cv::VideoWriter writer(outputPath, cv::VideoWriter::fourcc('M', 'J', 'P', 'G'), frameRate, cv::Size(width, height));
+        FrameSink writer(FrameSink::Settings(outputPath, cv::Size(width, height), frameRate));
 
-        if (!writer.isOpened()) {
-            throw std::runtime_error("Failed to open video writer");
+        if (!writer.open()) {
+            throw std::runtime_error("Failed to open video writer: " + writer.getError());
         }
 
         for (int frameNumber = 0; frameNumber < duration * frameRate; ++frameNumber) {
             double time = frameNumber / frameRate;
             cv::Mat world = generateProceduralWorld(width, height, time);
             cv::Mat frame = simulateAdaptiveLighting(world, time);
-            writer.write(frame);
+            writer.writeFrame(frame);
         }
 
-        writer.release();
+        if (!writer.close()) {
+            throw std::runtime_error("Failed to finish video: " + writer.getError());
+        }
     }
 };
 
 // Extend WebSocketServer to handle futuristic SI requests
 void WebSocketServer::handleGenerateFuturisticVideo(const Json::Value& request, Json::Value& response) {
-    std::string outputPath = request["params"].get("outputPath", "futuristic_video.avi").asString();
+    std::string outputPath = request["params"].get("outputPath", "futuristic_video.mp4").asString();
     double duration = request["params"].get("duration", 5.0).asDouble();
     double frameRate = request["params"].get("frameRate", 30.0).asDouble();
 
@@ -1204,27 +1891,21 @@ public:
 
     // Generate a music video frame based on emotion
     cv::Mat generateEmotionFrame(const std::string& emotion, int width, int height, double time) {
-        cv::Mat frame(height, width, CV_8UC3);
-
-        for (int y = 0; y < height; ++y) {
-            for (int x = 0; x < width; ++x) {
-                uchar intensity = static_cast<uchar>((std::sin(x * 0.01 + time) + 1.0) * 127.5);
-                if (emotion == "Joyful") {
-                    frame.at<cv::Vec3b>(y, x) = cv::Vec3b(0, intensity, intensity); // Cyan tones
-                } else if (emotion == "Melancholic") {
-                    frame.at<cv::Vec3b>(y, x) = cv::Vec3b(intensity, intensity, 0); // Yellow tones
-                } else if (emotion == "Aggressive") {
-                    frame.at<cv::Vec3b>(y, x) = cv::Vec3b(intensity, 0, 0); // Red tones
-                } else {
-                    frame.at<cv::Vec3b>(y, x) = cv::Vec3b(intensity, intensity, intensity); // Neutral grayscale
-                }
-            }
+        auto intensity = ProceduralKernels::tabulate(ProceduralKernels::Axis::X, width, height,
+            [time](int x) { return static_cast<uchar>((std::sin(x * 0.01 + time) + 1.0) * 127.5); });
+        auto zero = ProceduralKernels::constant(width, 0);
+
+        if (emotion == "Joyful") {
+            return ProceduralKernels::composeBGR(width, height, zero, intensity, intensity); // Cyan tones
+        } else if (emotion == "Melancholic") {
+            return ProceduralKernels::composeBGR(width, height, intensity, intensity, zero); // Yellow tones
+        } else if (emotion == "Aggressive") {
+            return ProceduralKernels::composeBGR(width, height, intensity, zero, zero); // Red tones
         }
-
-        return frame;
+        return ProceduralKernels::composeBGR(width, height, intensity, intensity, intensity); // Neutral grayscale
     }
 
-    // Generate a music video based on lyrics and attach it to the audio
+    // Generate a music video based on lyrics, muxed with the audio in one pass
     void generateMusicVideo(const std::string& lyrics, const std::string& audioPath, const std::string& outputPath, double frameRate) {
         int width = 1920;
         int height = 1080;
@@ -1235,60 +1916,36 @@ public:
         // Extract audio duration
         double audioDuration = getAudioDuration(audioPath);
 
-        // Create video writer
-        cv::VideoWriter writer(outputPath, cv::VideoWriter::fourcc('M', 'J', 'P', 'G'), frameRate, cv::Size(width, height));
-        if (!writer.isOpened()) {
-            throw std::runtime_error("Failed to open video writer");
+        // Create video writer. The source audio is muxed as the frames are
+        // encoded: copied when the container takes its codec, re-encoded otherwise.
+        FrameSink::Settings sinkSettings(outputPath, cv::Size(width, height), frameRate);
+        sinkSettings.audioSourcePath = audioPath;
+        FrameSink writer(sinkSettings);
+        if (!writer.open()) {
+            throw std::runtime_error("Failed to open video writer: " + writer.getError());
         }
 
         // Generate frames for the video
         for (int frameNumber = 0; frameNumber < audioDuration * frameRate; ++frameNumber) {
             double time = frameNumber / frameRate;
             cv::Mat frame = generateEmotionFrame(emotion, width, height, time);
-            writer.write(frame);
+            writer.writeFrame(frame);
         }
 
-        writer.release();
-
-        // Attach audio to the video (using FFmpeg or similar tool)
-        attachAudioToVideo(audioPath, outputPath);
+        if (!writer.close()) {
+            throw std::runtime_error("Failed to finish video: " + writer.getError());
+        }
     }
 
 private:
-    // Extract audio duration (real implementation required)
+    // Audio duration from the shared media probe
     double getAudioDuration(const std::string& audioPath) {
-        // Use FFmpeg to extract duration
-        std::string command = "ffprobe -v quiet -print_format json -show_format \"" + audioPath + "\"";
-        FILE* pipe = popen(command.c_str(), "r");
-        if (!pipe) return 180.0;
-
-        char buffer[128];
-        std::string result = "";
-        while (!feof(pipe)) {
-            if (fgets(buffer, 128, pipe) != NULL)
-                result += buffer;
-        }
-        pclose(pipe);
-
-        Json::Value root;
-        Json::Reader reader;
-        if (reader.parse(result, root)) {
-            if (root.isMember("format") && root["format"].isMember("duration")) {
-                return root["format"]["duration"].asDouble();
-            }
-        }
-        return 180.0; // Fallback
-    }
-
-    // Attach audio to video (real implementation required)
-    void attachAudioToVideo(const std::string& audioPath, const std::string& videoPath) {
-        std::string outputPath = videoPath.substr(0, videoPath.find_last_of('.')) + "_with_audio.mp4";
-        std::string command = "ffmpeg -y -i \"" + videoPath + "\" -i \"" + audioPath + "\" -c:v copy -c:a aac -shortest \"" + outputPath + "\"";
-        int ret = system(command.c_str());
-        if (ret == 0) {
-            // Rename or move to original path if needed
-            std::rename(outputPath.c_str(), videoPath.c_str());
+        MediaProbe::MediaInfo media = MediaProbe::shared().probe(audioPath);
+        if (!media.valid || media.duration <= 0.0) {
+            throw std::runtime_error("Failed to read audio duration: " +
+                                     (media.valid ? "no duration in " + audioPath : media.error));
         }
+        return media.duration;
     }
 };
 
@@ -1296,7 +1953,7 @@ private:
 void WebSocketServer::handleGenerateMusicVideo(const Json::Value& request, Json::Value& response) {
     std::string lyrics = request["params"].get("lyrics", "").asString();
     std::string audioPath = request["params"].get("audioPath", "").asString();
-    std::string outputPath = request["params"].get("outputPath", "music_video.avi").asString();
+    std::string outputPath = request["params"].get("outputPath", "music_video.mp4").asString();
     double frameRate = request["params"].get("frameRate", 30.0).asDouble();
 
     try {
@@ -1337,37 +1994,35 @@ public:
         int width = 1920;
         int height = 1080;
 
-        cv::VideoWriter writer(outputPath, cv::VideoWriter::fourcc('M', 'J', 'P', 'G'), frameRate, cv::Size(width, height));
-        if (!writer.isOpened()) {
-            throw std::runtime_error("Failed to open video writer");
+        FrameSink writer(FrameSink::Settings(outputPath, cv::Size(width, height), frameRate));
+        if (!writer.open()) {
+            throw std::runtime_error("Failed to open video writer: " + writer.getError());
         }
 
-        FiberOpticThreading threadPool(std::thread::hardware_concurrency());
-
-        for (int frameNumber = 0; frameNumber < duration * frameRate; ++frameNumber) {
-            threadPool.enqueue([this, &writer, emotion, width, height, frameNumber, frameRate] {
-                double time = frameNumber / frameRate;
-                cv::Mat frame = generateEmotionFrame(emotion, width, height, time);
-                frame = gpuAcceleratedRender(frame);
-
-                {
-                    std::lock_guard<std::mutex> lock(queueMutex);
-                    writer.write(frame);
+        // Frames render in parallel and are written strictly in order
+        FiberOpticThreading& scheduler = FiberOpticThreading::shared();
+        OrderedSink<cv::Mat> frames(scheduler, static_cast<int>(scheduler.workerCount()) * 2,
+            [&writer](int frameNumber, cv::Mat& frame) {
+                if (!writer.writeFrame(frame)) {
+                    throw std::runtime_error("Failed to write frame " + std::to_string(frameNumber) + ": " + writer.getError());
                 }
             });
-        }
+        frames.run(static_cast<int>(std::ceil(duration * frameRate)), [&](int frameNumber) {
+            double time = frameNumber / frameRate;
+            cv::Mat frame = generateEmotionFrame(emotion, width, height, time);
+            return gpuAcceleratedRender(frame);
+        });
 
-        writer.release();
+        if (!writer.close()) {
+            throw std::runtime_error("Failed to finish video: " + writer.getError());
+        }
     }
-
-private:
-    std::mutex queueMutex;
 };
 
 // Extend WebSocketServer to handle optimized video generation requests
 void WebSocketServer::handleGenerateOptimizedVideo(const Json::Value& request, Json::Value& response) {
     std::string emotion = request["params"].get("emotion", "neutral").asString();
-    std::string outputPath = request["params"].get("outputPath", "optimized_video.avi").asString();
+    std::string outputPath = request["params"].get("outputPath", "optimized_video.mp4").asString();
     double duration = request["params"].get("duration", 5.0).asDouble();
     double frameRate = request["params"].get("frameRate", 30.0).asDouble();
 
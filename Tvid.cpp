@@ -4,6 +4,14 @@
             timeline.duration = std::max(timeline.duration, startTime + duration);
             
             isDirty = true;
+            Json::Value op;
+            op["op"] = "clipAdded";
+            op["kind"] = "audio";
+            op["clip"] = serializeAudioClip(*clip);
+            for (float sample : previewWaveform(*clip)) {
+                op["clip"]["waveform"].append(sample);
+            }
+            recordChange(op, &clip->waveform);
             LOG_INFO("Audio clip added: " + id);
             return id;
         }
@@ -12,80 +20,160 @@
         return "";
     }
     
+    // One entry of the timeline change log. The op has the same shape that is
+    // broadcast to timeline subscribers (clipAdded/clipRemoved/clipUpdated).
+    struct TimelineChange {
+        uint64_t revision;
+        Json::Value op;
+    };
+    
+    // Immutable published version of the timeline. Track vectors hold the
+    // same clip pointers as the version they were copied from, so unchanged
+    // clips are shared; edits replace a clip instead of mutating it.
+    struct TimelineSnapshot {
+        uint64_t revision;
+        Timeline timeline;
+    };
+    
     bool removeClip(const std::string& clipId) {
         std::lock_guard<std::mutex> lock(projectMutex);
         
-        // Remove from video tracks
-        auto videoIt = std::remove_if(timeline.videoTracks.begin(), timeline.videoTracks.end(),
-            [&clipId](const std::shared_ptr<VideoClip>& clip) {
-                return clip->id == clipId;
-            });
+        ClipLocation location;
+        if (!locateClip(clipId, location)) {
+            LOG_WARNING("Clip not found for removal: " + clipId);
+            return false;
+        }
         
-        if (videoIt != timeline.videoTracks.end()) {
-            timeline.videoTracks.erase(videoIt, timeline.videoTracks.end());
-            isDirty = true;
-            LOG_INFO("Removed video clip: " + clipId);
-            return true;
+        clipIndex.erase(clipId);
+        if (location.audio) {
+            timeline.audioTracks.erase(timeline.audioTracks.begin() + location.index);
+        } else {
+            timeline.videoTracks.erase(timeline.videoTracks.begin() + location.index);
         }
         
-        // Remove from audio tracks
-        auto audioIt = std::remove_if(timeline.audioTracks.begin(), timeline.audioTracks.end(),
-            [&clipId](const std::shared_ptr<AudioClip>& clip) {
-                return clip->id == clipId;
-            });
+        isDirty = true;
+        recordClipRemoved(clipId);
+        LOG_INFO(std::string("Removed ") + (location.audio ? "audio" : "video") + " clip: " + clipId);
+        return true;
+    }
+    
+    bool updateClip(const std::string& clipId, const Json::Value& updates) {
+        std::lock_guard<std::mutex> lock(projectMutex);
         
-        if (audioIt != timeline.audioTracks.end()) {
-            timeline.audioTracks.erase(audioIt, timeline.audioTracks.end());
-            isDirty = true;
-            LOG_INFO("Removed audio clip: " + clipId);
-            return true;
+        ClipLocation location;
+        if (!locateClip(clipId, location)) {
+            LOG_WARNING("Clip not found for update: " + clipId);
+            return false;
         }
         
-        LOG_WARNING("Clip not found for removal: " + clipId);
-        return false;
+        isDirty = true;
+        recordChange(applyClipUpdates(location, updates));
+        LOG_INFO(std::string("Updated ") + (location.audio ? "audio" : "video") + " clip: " + clipId);
+        return true;
     }
     
-    bool updateClip(const std::string& clipId, const Json::Value& updates) {
+    // Applies an ordered list of edits under a single lock and records them
+    // as one revision ({"op": "batch", "ops": [...]}). Each operation is
+    //   {"type": "add", "kind": "video"|"audio", "clip": {...}, "sourceClipId": optional}
+    //   {"type": "remove", "clipId": ...}
+    //   {"type": "update", "clipId": ..., "updates": {...}}
+    // results gets one entry per operation. With allOrNothing, any failure
+    // rolls the whole batch back and nothing is recorded.
+    bool batchEdit(const Json::Value& operations, bool allOrNothing, Json::Value& results) {
         std::lock_guard<std::mutex> lock(projectMutex);
         
-        // Update video clip
-        for (auto& clip : timeline.videoTracks) {
-            if (clip->id == clipId) {
-                if (updates.isMember("startTime")) clip->startTime = updates["startTime"].asDouble();
-                if (updates.isMember("duration")) clip->duration = updates["duration"].asDouble();
-                if (updates.isMember("inPoint")) clip->inPoint = updates["inPoint"].asDouble();
-                if (updates.isMember("outPoint")) clip->outPoint = updates["outPoint"].asDouble();
-                if (updates.isMember("enabled")) clip->enabled = updates["enabled"].asBool();
-                if (updates.isMember("opacity")) clip->opacity = updates["opacity"].asFloat();
-                
-                isDirty = true;
-                LOG_INFO("Updated video clip: " + clipId);
-                return true;
+        // Clips are copy-on-write, so the old track vectors are a full undo point
+        auto savedVideoTracks = timeline.videoTracks;
+        auto savedAudioTracks = timeline.audioTracks;
+        double savedDuration = timeline.duration;
+        
+        results = Json::Value(Json::arrayValue);
+        Json::Value changeOps(Json::arrayValue);
+        size_t failures = 0;
+        
+        for (Json::ArrayIndex i = 0; i < operations.size(); i++) {
+            Json::Value result;
+            result["index"] = static_cast<int>(i);
+            
+            std::string error;
+            Json::Value change = applyBatchOperation(operations[i], result, error);
+            if (error.empty()) {
+                result["status"] = "success";
+                changeOps.append(change);
+            } else {
+                result["status"] = "error";
+                result["error"] = error;
+                failures++;
             }
+            results.append(result);
         }
         
-        // Update audio clip
-        for (auto& clip : timeline.audioTracks) {
-            if (clip->id == clipId) {
-                if (updates.isMember("startTime")) clip->startTime = updates["startTime"].asDouble();
-                if (updates.isMember("duration")) clip->duration = updates["duration"].asDouble();
-                if (updates.isMember("volume")) clip->volume = updates["volume"].asFloat();
-                if (updates.isMember("enabled")) clip->enabled = updates["enabled"].asBool();
-                if (updates.isMember("muted")) clip->muted = updates["muted"].asBool();
-                
-                isDirty = true;
-                LOG_INFO("Updated audio clip: " + clipId);
-                return true;
+        // Removals only cleared their slots so that indices stayed valid
+        compactDetachedClips();
+        
+        if (allOrNothing && failures > 0) {
+            timeline.videoTracks = std::move(savedVideoTracks);
+            timeline.audioTracks = std::move(savedAudioTracks);
+            timeline.duration = savedDuration;
+            clipIndex.clear();
+            
+            for (auto& result : results) {
+                if (result["status"].asString() == "success") {
+                    result["status"] = "rolledBack";
+                }
             }
+            LOG_WARNING("Batch edit rolled back: " + std::to_string(failures) + " of " +
+                        std::to_string(operations.size()) + " operations failed");
+            return false;
         }
         
-        LOG_WARNING("Clip not found for update: " + clipId);
-        return false;
+        if (!changeOps.empty()) {
+            isDirty = true;
+            Json::Value op;
+            op["op"] = "batch";
+            op["ops"] = changeOps;
+            recordChange(op);
+        }
+        
+        LOG_INFO("Batch edit applied: " + std::to_string(changeOps.size()) + " of " +
+                 std::to_string(operations.size()) + " operations");
+        return failures == 0;
+    }
+    
+    // Binary container (.tvproj) save/load; JSON stays for interchange.
+    // Loading maps the file and reads clip metadata only; waveforms stay in
+    // the mapping until loadDeferredBlobs() is called by something that needs
+    // all of them. Previews are served from their own small blob meanwhile.
+    class BinaryContainer;
+    bool saveProjectBinary(const std::string& filePath);
+    bool loadProjectBinary(const std::string& filePath);
+    void loadDeferredBlobs();
+    std::vector<float> waveformPreview(const AudioClip& clip) const;
+    std::shared_ptr<const TimelineSnapshot> getCompleteSnapshot();
+    
+    // Write-ahead edit journal next to a .tvproj (<project>.journal). Every
+    // recorded change is appended and made durable in batches by a background
+    // thread, which also compacts the journal into a full snapshot now and then.
+    // Saving to the journaled path only waits for the journal to be durable.
+    class EditJournal;
+    
+    static bool isBinaryProjectPath(const std::string& filePath) {
+        const std::string extension = ".tvproj";
+        return filePath.size() >= extension.size() &&
+               filePath.compare(filePath.size() - extension.size(), extension.size(), extension) == 0;
     }
     
-    Timeline& getTimeline() { 
+    // Pins the current timeline version. Never waits on editors, and the
+    // returned snapshot stays valid and unchanged for as long as it is held.
+    std::shared_ptr<const TimelineSnapshot> getTimelineSnapshot() const {
+        auto snapshot = std::atomic_load(&publishedTimeline);
+        if (snapshot) return snapshot;
+        
         std::lock_guard<std::mutex> lock(projectMutex);
-        return timeline; 
+        if (!std::atomic_load(&publishedTimeline)) {
+            publishSnapshot();
+        }
+        return std::atomic_load(&publishedTimeline);
     }
     
     const Json::Value& getProjectData() const { 
@@ -114,658 +202,6128 @@
         info["isDirty"] = isDirty;
         info["lastSave"] = std::chrono::duration_cast<std::chrono::seconds>(
             lastSave.time_since_epoch()).count();
+        info["revision"] = static_cast<Json::UInt64>(revision);
         
         return info;
     }
-};
-
-// Render engine for final video export
-class RenderEngine {
-public:
-    struct ExportSettings {
-        std::string outputPath;
-        std::string videoCodec;
-        std::string audioCodec;
-        int width;
-        int height;
-        double frameRate;
-        int videoBitrate;
-        int audioBitrate;
-        int audioSampleRate;
-        std::string preset;
-        int crf;
-        std::string pixelFormat;
-        bool hardwareAcceleration;
-        
-        ExportSettings() : videoCodec("libx264"), audioCodec("aac"), width(1920), height(1080), 
-                         frameRate(30.0), videoBitrate(10000000), audioBitrate(192000), 
-                         audioSampleRate(44100), preset("medium"), crf(23), 
-                         pixelFormat("yuv420p"), hardwareAcceleration(true) {}
-    };
     
-    struct RenderProgress {
-        int currentFrame;
-        int totalFrames;
-        double percentage;
-        double estimatedTimeRemaining;
-        std::string currentOperation;
-        bool isComplete;
-        bool hasError;
-        std::string errorMessage;
+    uint64_t getRevision() const {
+        std::lock_guard<std::mutex> lock(projectMutex);
+        return revision;
+    }
+    
+    // Collects the changes after sinceRevision. Returns false when the log no
+    // longer reaches back that far, in which case a full snapshot is needed.
+    bool getChangesSince(uint64_t sinceRevision, std::vector<TimelineChange>& changes) const {
+        std::lock_guard<std::mutex> lock(projectMutex);
         
-        RenderProgress() : currentFrame(0), totalFrames(0), percentage(0.0), 
-                         estimatedTimeRemaining(0.0), isComplete(false), hasError(false) {}
-    };
+        if (sinceRevision > revision) return false;
+        if (sinceRevision == revision) return true;
+        if (changeLog.empty() || changeLog.front().revision > sinceRevision + 1) return false;
+        
+        for (const auto& change : changeLog) {
+            if (change.revision > sinceRevision) {
+                changes.push_back(change);
+            }
+        }
+        return true;
+    }
     
-private:
-    VideoEngine videoEngine;
-    AudioEngine audioEngine;
-    EffectProcessor effectProcessor;
-    std::atomic<bool> shouldCancel;
-    RenderProgress currentProgress;
-    std::mutex progressMutex;
-    std::function<void(const RenderProgress&)> progressCallback;
+    // Invoked with projectMutex held for every recorded change; the listener
+    // must not call back into ProjectManager
+    void setChangeListener(std::function<void(const TimelineChange&)> listener) {
+        std::lock_guard<std::mutex> lock(projectMutex);
+        changeListener = listener;
+    }
     
-public:
-    RenderEngine() : shouldCancel(false) {
-        LOG_DEBUG("RenderEngine initialized");
+    // The whole timeline was swapped (new or loaded project): deltas from
+    // before this point no longer apply, so subscribers must resync. A journal
+    // that belongs to a different project file than projectPath is detached.
+    void markTimelineReplaced(const std::string& projectPath = "") {
+        std::shared_ptr<EditJournal> detached;
+        {
+            std::lock_guard<std::mutex> lock(projectMutex);
+            changeLog.clear();
+            
+            if (journal && journalProjectPath != projectPath) {
+                detached = std::move(journal);
+                journalProjectPath.clear();
+            }
+            
+            Json::Value op;
+            op["op"] = "timelineReplaced";
+            recordChange(op);
+        }
+        // Joins the journal threads, which may need projectMutex to finish
+        detached.reset();
     }
     
-    ~RenderEngine() {
-        LOG_DEBUG("RenderEngine destroyed");
+    static Json::Value serializeVideoClip(const VideoClip& clip) {
+        Json::Value clipData;
+        clipData["id"] = clip.id;
+        clipData["filePath"] = clip.filePath;
+        clipData["startTime"] = clip.startTime;
+        clipData["duration"] = clip.duration;
+        clipData["inPoint"] = clip.inPoint;
+        clipData["outPoint"] = clip.outPoint;
+        clipData["trackIndex"] = clip.trackIndex;
+        clipData["enabled"] = clip.enabled;
+        clipData["opacity"] = clip.opacity;
+        return clipData;
     }
     
-    void setProgressCallback(std::function<void(const RenderProgress&)> callback) {
-        progressCallback = callback;
+    // Every 10th sample of the clip waveform, enough for timeline display
+    static std::vector<float> previewWaveform(const AudioClip& clip) {
+        std::vector<float> waveform;
+        waveform.reserve(clip.waveform.size() / 10 + 1);
+        for (size_t i = 0; i < clip.waveform.size(); i += 10) {
+            waveform.push_back(clip.waveform[i]);
+        }
+        return waveform;
     }
     
-    bool exportVideo(const Timeline& timeline, const ExportSettings& settings) {
-        LOG_INFO("Starting video export to: " + settings.outputPath);
+    // Waveform data is left to the caller, which picks JSON or binary framing
+    static Json::Value serializeAudioClip(const AudioClip& clip) {
+        Json::Value clipData;
+        clipData["id"] = clip.id;
+        clipData["filePath"] = clip.filePath;
+        clipData["startTime"] = clip.startTime;
+        clipData["duration"] = clip.duration;
+        clipData["volume"] = clip.volume;
+        clipData["trackIndex"] = clip.trackIndex;
+        clipData["enabled"] = clip.enabled;
+        clipData["muted"] = clip.muted;
+        return clipData;
+    }
+    
+private:
+    static constexpr size_t maxChangeLogEntries = 4096;
+    
+    uint64_t revision = 0;
+    std::deque<TimelineChange> changeLog;
+    std::function<void(const TimelineChange&)> changeListener;
+    mutable std::shared_ptr<const TimelineSnapshot> publishedTimeline;
+    
+    // Blobs of a loaded .tvproj that are still only in the mapped file
+    struct DeferredBlob {
+        uint64_t offset;
+        uint64_t size;
+        uint64_t previewOffset;
+        uint64_t previewSize;
+    };
+    std::shared_ptr<BinaryContainer> container;
+    std::unordered_map<std::string, DeferredBlob> deferredWaveforms;
+    
+    std::shared_ptr<EditJournal> journal;
+    std::string journalProjectPath;
+    bool replayingJournal = false;
+    
+    // Defined with EditJournal below; callers hold projectMutex
+    void journalChange(const TimelineChange& change, const std::vector<float>* waveform);
+    void attachJournal(const std::string& projectPath, uint64_t generation, uint64_t snapshotRevision);
+    void compactJournal(EditJournal& source);
+    uint64_t replayJournal(const std::string& projectPath, uint64_t generation, uint64_t snapshotRevision);
+    static uint64_t newGeneration();
+    static bool replaceFileDurably(const std::string& tempPath, const std::string& filePath);
+    std::vector<float> readDeferredWaveform(const std::string& clipId) const;
+    std::shared_ptr<const TimelineSnapshot> pinTimeline(std::shared_ptr<BinaryContainer>& source,
+                                                        std::unordered_map<std::string, DeferredBlob>& deferred);
+    void replayChange(const Json::Value& op, std::vector<float>& waveform);
+    void restoreClip(const Json::Value& op, std::vector<float>& waveform);
+    
+    // Callers hold projectMutex. Copies only the track vectors (clip
+    // pointers), then swaps the new version in atomically for readers.
+    void publishSnapshot() const {
+        auto snapshot = std::make_shared<TimelineSnapshot>();
+        snapshot->revision = revision;
+        snapshot->timeline = timeline;
+        std::atomic_store(&publishedTimeline, std::shared_ptr<const TimelineSnapshot>(std::move(snapshot)));
+    }
+    
+    // Callers hold projectMutex. waveform is the full sample data of an
+    // added audio clip, which the journal needs but broadcasts do not.
+    void recordChange(const Json::Value& op, const std::vector<float>* waveform = nullptr) {
+        TimelineChange change;
+        change.revision = ++revision;
+        change.op = op;
+        publishSnapshot();
+        
+        if (journal) {
+            journalChange(change, waveform);
+        }
         
-        shouldCancel = false;
-        updateProgress("Initializing export...", 0, 0, 0.0);
+        // Replayed edits belong to the project being loaded; subscribers
+        // resync from the timelineReplaced that follows the load
+        if (replayingJournal) return;
         
-        // Initialize FFmpeg muxer
-        AVFormatContext* outputFormat = nullptr;
-        int ret = avformat_alloc_output_context2(&outputFormat, nullptr, nullptr, settings.outputPath.c_str());
-        if (ret < 0) {
-            setError("Could not create output context");
-            return false;
+        changeLog.push_back(change);
+        if (changeLog.size() > maxChangeLogEntries) {
+            changeLog.pop_front();
         }
         
-        // Add video stream
-        AVStream* videoStream = avformat_new_stream(outputFormat, nullptr);
-        if (!videoStream) {
-            setError("Could not create video stream");
-            avformat_free_context(outputFormat);
-            return false;
+        if (changeListener) {
+            changeListener(change);
         }
-        
-        AVCodecContext* videoCodecCtx = setupVideoEncoder(videoStream, settings);
-        if (!videoCodecCtx) {
-            setError("Could not setup video encoder");
-            avformat_free_context(outputFormat);
-            return false;
+    }
+    
+    void recordClipRemoved(const std::string& clipId) {
+        recordChange(clipRemovedOp(clipId));
+    }
+    
+    static Json::Value clipRemovedOp(const std::string& clipId) {
+        Json::Value op;
+        op["op"] = "clipRemoved";
+        op["clipId"] = clipId;
+        return op;
+    }
+    
+    // Only the fields the update actually touched are sent, with their new values
+    static Json::Value clipUpdatedOp(const std::string& clipId, const Json::Value& clipData, const Json::Value& updates) {
+        Json::Value op;
+        op["op"] = "clipUpdated";
+        op["clipId"] = clipId;
+        for (const auto& key : updates.getMemberNames()) {
+            if (clipData.isMember(key)) {
+                op["fields"][key] = clipData[key];
+            }
         }
-        
-        // Add audio stream
-        AVStream* audioStream = avformat_new_stream(outputFormat, nullptr);
-        if (!audioStream) {
-            setError("Could not create audio stream");
-            avcodec_free_context(&videoCodecCtx);
-            avformat_free_context(outputFormat);
-            return false;
+        return op;
+    }
+    
+    // Position of a clip in its track vector. Kept up to date by the edit
+    // paths that go through it and validated on every lookup, so changes made
+    // elsewhere (loads, adds) only cost a rebuild on the next miss.
+    struct ClipLocation {
+        bool audio;
+        size_t index;
+    };
+    std::unordered_map<std::string, ClipLocation> clipIndex;
+    size_t detachedClips = 0;
+    uint64_t generatedClipIds = 0;
+    
+    void rebuildClipIndex() {
+        clipIndex.clear();
+        clipIndex.reserve(timeline.videoTracks.size() + timeline.audioTracks.size());
+        for (size_t i = 0; i < timeline.videoTracks.size(); i++) {
+            if (timeline.videoTracks[i]) clipIndex[timeline.videoTracks[i]->id] = {false, i};
         }
-        
-        AVCodecContext* audioCodecCtx = setupAudioEncoder(audioStream, settings);
-        if (!audioCodecCtx) {
-            setError("Could not setup audio encoder");
-            avcodec_free_context(&videoCodecCtx);
-            avformat_free_context(outputFormat);
-            return false;
+        for (size_t i = 0; i < timeline.audioTracks.size(); i++) {
+            if (timeline.audioTracks[i]) clipIndex[timeline.audioTracks[i]->id] = {true, i};
         }
-        
-        // Open output file
-        if (!(outputFormat->oformat->flags & AVFMT_NOFILE)) {
-            ret = avio_open(&outputFormat->pb, settings.outputPath.c_str(), AVIO_FLAG_WRITE);
-            if (ret < 0) {
-                setError("Could not open output file: " + settings.outputPath);
-                cleanup(outputFormat, videoCodecCtx, audioCodecCtx);
-                return false;
-            }
+    }
+    
+    bool indexEntryValid(const std::string& clipId, const ClipLocation& location) const {
+        if (location.audio) {
+            return location.index < timeline.audioTracks.size() && timeline.audioTracks[location.index] &&
+                   timeline.audioTracks[location.index]->id == clipId;
+        }
+        return location.index < timeline.videoTracks.size() && timeline.videoTracks[location.index] &&
+               timeline.videoTracks[location.index]->id == clipId;
+    }
+    
+    // Callers hold projectMutex
+    bool locateClip(const std::string& clipId, ClipLocation& location) {
+        auto it = clipIndex.find(clipId);
+        if (it != clipIndex.end() && indexEntryValid(clipId, it->second)) {
+            location = it->second;
+            return true;
         }
         
-        // Write header
-        ret = avformat_write_header(outputFormat, nullptr);
-        if (ret < 0) {
-            setError("Error writing header");
-            cleanup(outputFormat, videoCodecCtx, audioCodecCtx);
+        // A stale or incomplete index is rebuilt; a clean miss stays O(1)
+        size_t trackedClips = timeline.videoTracks.size() + timeline.audioTracks.size();
+        if (it == clipIndex.end() && clipIndex.size() + detachedClips == trackedClips) {
             return false;
         }
         
-        // Calculate frame information
-        double frameDuration = 1.0 / settings.frameRate;
-        int totalFrames = static_cast<int>(timeline.duration * settings.frameRate);
-        
-        updateProgress("Rendering frames...", 0, totalFrames, 0.0);
-        
-        auto startTime = std::chrono::steady_clock::now();
+        rebuildClipIndex();
+        it = clipIndex.find(clipId);
+        if (it == clipIndex.end()) return false;
+        location = it->second;
+        return true;
+    }
+    
+    // Copy-on-write update of one clip; returns the clipUpdated op
+    Json::Value applyClipUpdates(const ClipLocation& location, const Json::Value& updates) {
+        if (location.audio) {
+            auto& clip = timeline.audioTracks[location.index];
+            clip = std::make_shared<AudioClip>(*clip);
+            if (updates.isMember("startTime")) clip->startTime = updates["startTime"].asDouble();
+            if (updates.isMember("duration")) clip->duration = updates["duration"].asDouble();
+            if (updates.isMember("volume")) clip->volume = updates["volume"].asFloat();
+            if (updates.isMember("enabled")) clip->enabled = updates["enabled"].asBool();
+            if (updates.isMember("muted")) clip->muted = updates["muted"].asBool();
+            return clipUpdatedOp(clip->id, serializeAudioClip(*clip), updates);
+        }
         
-        // Render frames
-        for (int frameNumber = 0; frameNumber < totalFrames && !shouldCancel; frameNumber++) {
-            double currentTime = frameNumber * frameDuration;
+        auto& clip = timeline.videoTracks[location.index];
+        clip = std::make_shared<VideoClip>(*clip);
+        if (updates.isMember("startTime")) clip->startTime = updates["startTime"].asDouble();
+        if (updates.isMember("duration")) clip->duration = updates["duration"].asDouble();
+        if (updates.isMember("inPoint")) clip->inPoint = updates["inPoint"].asDouble();
+        if (updates.isMember("outPoint")) clip->outPoint = updates["outPoint"].asDouble();
+        if (updates.isMember("enabled")) clip->enabled = updates["enabled"].asBool();
+        if (updates.isMember("opacity")) clip->opacity = updates["opacity"].asFloat();
+        return clipUpdatedOp(clip->id, serializeVideoClip(*clip), updates);
+    }
+    
+    // One batchEdit operation; sets error instead of throwing. Removals clear
+    // the slot instead of erasing, compactDetachedClips() closes the gaps.
+    Json::Value applyBatchOperation(const Json::Value& operation, Json::Value& result, std::string& error) {
+        std::string type = operation.get("type", "").asString();
+        
+        if (type == "remove" || type == "update") {
+            std::string clipId = operation.get("clipId", "").asString();
+            result["clipId"] = clipId;
             
-            // Render video frame
-            cv::Mat frame = renderVideoFrame(timeline, currentTime, settings.width, settings.height);
-            if (!frame.empty()) {
-                if (!writeVideoFrame(outputFormat, videoCodecCtx, videoStream, frame, frameNumber)) {
-                    setError("Error writing video frame " + std::to_string(frameNumber));
-                    cleanup(outputFormat, videoCodecCtx, audioCodecCtx);
-                    return false;
-                }
+            ClipLocation location;
+            if (clipId.empty() || !locateClip(clipId, location)) {
+                error = "Clip not found: " + clipId;
+                return Json::Value();
             }
             
-            // Render audio samples for this frame
-            std::vector<float> audioSamples = renderAudioSamples(timeline, currentTime, frameDuration, settings.audioSampleRate);
-            if (!audioSamples.empty()) {
-                if (!writeAudioSamples(outputFormat, audioCodecCtx, audioStream, audioSamples, frameNumber)) {
-                    setError("Error writing audio samples for frame " + std::to_string(frameNumber));
-                    cleanup(outputFormat, videoCodecCtx, audioCodecCtx);
-                    return false;
-                }
+            if (type == "update") {
+                return applyClipUpdates(location, operation["updates"]);
             }
             
-            // Update progress
-            auto elapsed = std::chrono::steady_clock::now() - startTime;
-            double elapsedSeconds = std::chrono::duration<double>(elapsed).count();
-            double estimatedTotal = elapsedSeconds * totalFrames / (frameNumber + 1);
-            double remaining = estimatedTotal - elapsedSeconds;
-            
-            updateProgress("Rendering frame " + std::to_string(frameNumber + 1) + "/" + std::to_string(totalFrames),
-                         frameNumber + 1, totalFrames, remaining);
+            if (location.audio) {
+                timeline.audioTracks[location.index].reset();
+            } else {
+                timeline.videoTracks[location.index].reset();
+            }
+            clipIndex.erase(clipId);
+            detachedClips++;
+            return clipRemovedOp(clipId);
         }
         
-        if (shouldCancel) {
-            updateProgress("Export cancelled", 0, 0, 0.0);
-            cleanup(outputFormat, videoCodecCtx, audioCodecCtx);
-            // Remove incomplete file
-            std::remove(settings.outputPath.c_str());
-            return false;
+        if (type == "add") {
+            return applyBatchAdd(operation, result, error);
         }
         
-        updateProgress("Finalizing export...", totalFrames, totalFrames, 0.0);
-        
-        // Flush encoders
-        flushEncoder(outputFormat, videoCodecCtx, videoStream);
-        flushEncoder(outputFormat, audioCodecCtx, audioStream);
-        
-        // Write trailer
-        ret = av_write_trailer(outputFormat);
-        if (ret < 0) {
-            setError("Error writing trailer");
-            cleanup(outputFormat, videoCodecCtx, audioCodecCtx);
-            return false;
+        error = "Unknown operation type: " + type;
+        return Json::Value();
+    }
+    
+    // Adds a clip from its description, optionally starting from a copy of
+    // sourceClipId (paste/duplicate; audio keeps the source waveform)
+    Json::Value applyBatchAdd(const Json::Value& operation, Json::Value& result, std::string& error) {
+        const Json::Value& clipData = operation["clip"];
+        std::string kind = operation.get("kind", "video").asString();
+        std::string sourceClipId = operation.get("sourceClipId", "").asString();
+        
+        ClipLocation source{false, 0};
+        bool hasSource = !sourceClipId.empty();
+        if (hasSource && !locateClip(sourceClipId, source)) {
+            error = "Source clip not found: " + sourceClipId;
+            return Json::Value();
+        }
+        if (hasSource) {
+            kind = source.audio ? "audio" : "video";
         }
         
-        // Cleanup
-        cleanup(outputFormat, videoCodecCtx, audioCodecCtx);
+        if (!hasSource && clipData.get("filePath", "").asString().empty()) {
+            error = "File path is required";
+            return Json::Value();
+        }
         
-        updateProgress("Export complete!", totalFrames, totalFrames, 0.0);
-        {
-            std::lock_guard<std::mutex> lock(progressMutex);
-            currentProgress.isComplete = true;
+        std::string clipId = clipData.get("id", "").asString();
+        if (clipId.empty()) {
+            clipId = "clip_" + std::to_string(std::chrono::system_clock::now().time_since_epoch().count()) +
+                     "_" + std::to_string(++generatedClipIds);
+        }
+        ClipLocation existing;
+        if (locateClip(clipId, existing)) {
+            error = "Clip ID already exists: " + clipId;
+            return Json::Value();
+        }
+        result["clipId"] = clipId;
+        
+        Json::Value op;
+        op["op"] = "clipAdded";
+        op["kind"] = kind;
+        
+        if (kind == "audio") {
+            auto clip = hasSource ? std::make_shared<AudioClip>(*timeline.audioTracks[source.index])
+                                  : std::make_shared<AudioClip>();
+            // A source from an opened .tvproj may still have its samples in
+            // the mapping, which is keyed by the source id
+            if (hasSource && clip->waveform.empty()) {
+                clip->waveform = readDeferredWaveform(sourceClipId);
+            }
+            clip->id = clipId;
+            if (clipData.isMember("filePath")) clip->filePath = clipData["filePath"].asString();
+            clip->startTime = clipData.get("startTime", clip->startTime).asDouble();
+            clip->duration = clipData.get("duration", clip->duration).asDouble();
+            clip->volume = clipData.get("volume", hasSource ? clip->volume : 1.0f).asFloat();
+            clip->trackIndex = clipData.get("trackIndex", clip->trackIndex).asInt();
+            clip->enabled = clipData.get("enabled", hasSource ? clip->enabled : true).asBool();
+            clip->muted = clipData.get("muted", clip->muted).asBool();
+            
+            timeline.audioTracks.push_back(clip);
+            clipIndex[clipId] = {true, timeline.audioTracks.size() - 1};
+            timeline.duration = std::max(timeline.duration, clip->startTime + clip->duration);
+            
+            op["clip"] = serializeAudioClip(*clip);
+            for (float sample : previewWaveform(*clip)) {
+                op["clip"]["waveform"].append(sample);
+            }
+            return op;
         }
         
-        LOG_INFO("Video export completed successfully: " + settings.outputPath);
-        return true;
+        auto clip = hasSource ? std::make_shared<VideoClip>(*timeline.videoTracks[source.index])
+                              : std::make_shared<VideoClip>();
+        clip->id = clipId;
+        if (clipData.isMember("filePath")) clip->filePath = clipData["filePath"].asString();
+        clip->startTime = clipData.get("startTime", clip->startTime).asDouble();
+        clip->duration = clipData.get("duration", clip->duration).asDouble();
+        clip->inPoint = clipData.get("inPoint", clip->inPoint).asDouble();
+        clip->outPoint = clipData.get("outPoint", hasSource ? clip->outPoint : clip->duration).asDouble();
+        clip->trackIndex = clipData.get("trackIndex", clip->trackIndex).asInt();
+        clip->enabled = clipData.get("enabled", hasSource ? clip->enabled : true).asBool();
+        clip->opacity = clipData.get("opacity", hasSource ? clip->opacity : 1.0f).asFloat();
+        
+        timeline.videoTracks.push_back(clip);
+        clipIndex[clipId] = {false, timeline.videoTracks.size() - 1};
+        timeline.duration = std::max(timeline.duration, clip->startTime + clip->duration);
+        
+        op["clip"] = serializeVideoClip(*clip);
+        return op;
     }
     
-    void cancelExport() {
-        shouldCancel = true;
-        LOG_INFO("Export cancellation requested");
+    void compactDetachedClips() {
+        if (detachedClips == 0) return;
+        
+        timeline.videoTracks.erase(std::remove(timeline.videoTracks.begin(), timeline.videoTracks.end(), nullptr),
+                                   timeline.videoTracks.end());
+        timeline.audioTracks.erase(std::remove(timeline.audioTracks.begin(), timeline.audioTracks.end(), nullptr),
+                                   timeline.audioTracks.end());
+        detachedClips = 0;
+        rebuildClipIndex();
     }
+};
+
+// Read-only memory mapping of a whole file
+class MappedFile {
+public:
+    MappedFile() : data(nullptr), size(0) {}
     
-    RenderProgress getProgress() const {
-        std::lock_guard<std::mutex> lock(progressMutex);
-        return currentProgress;
+    ~MappedFile() {
+        close();
     }
     
-private:
-    void updateProgress(const std::string& operation, int frame, int total, double remaining) {
-        std::lock_guard<std::mutex> lock(progressMutex);
-        currentProgress.currentOperation = operation;
-        currentProgress.currentFrame = frame;
-        currentProgress.totalFrames = total;
-        currentProgress.percentage = total > 0 ? (static_cast<double>(frame) / total) * 100.0 : 0.0;
-        currentProgress.estimatedTimeRemaining = remaining;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    
+    bool open(const std::string& path) {
+        close();
         
-        if (progressCallback) {
-            progressCallback(currentProgress);
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        
+        struct stat st;
+        if (fstat(fd, &st) < 0 || st.st_size == 0) {
+            ::close(fd);
+            return false;
         }
+        
+        void* mapping = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (mapping == MAP_FAILED) return false;
+        
+        data = static_cast<const uint8_t*>(mapping);
+        size = static_cast<size_t>(st.st_size);
+        return true;
     }
     
-    void setError(const std::string& error) {
-        std::lock_guard<std::mutex> lock(progressMutex);
-        currentProgress.hasError = true;
-        currentProgress.errorMessage = error;
-        LOG_ERROR(error);
+    void close() {
+        if (data) {
+            munmap(const_cast<uint8_t*>(data), size);
+            data = nullptr;
+            size = 0;
+        }
     }
     
-    float getParam(const std::unordered_map<std::string, float>& params, 
-                   const std::string& key, float defaultValue) {
-        auto it = params.find(key);
-        return it != params.end() ? it->second : defaultValue;
-    }
+    const uint8_t* getData() const { return data; }
+    size_t getSize() const { return size; }
     
-    AVCodecContext* setupVideoEncoder(AVStream* stream, const ExportSettings& settings) {
-        const AVCodec* codec = avcodec_find_encoder_by_name(settings.videoCodec.c_str());
-        if (!codec) {
-            LOG_ERROR("Video codec not found: " + settings.videoCodec);
-            return nullptr;
-        }
+private:
+    const uint8_t* data;
+    size_t size;
+};
+
+// Binary project container (.tvproj), version 2
+//
+// [FileHeader 64B][SectionEntry x N][Meta JSON][String table][ClipRecord x M][Blobs]
+//
+// Meta holds the timeline settings as compact JSON. Clip records are fixed
+// size and reference the string table and the blob area by offset, so a
+// loader touches only the pages it needs. Blobs (waveforms as float32,
+// effect settings as JSON) are 64-byte aligned. Integers are host-endian;
+// the header carries a byte order mark and mismatching files are rejected.
+//
+// Version 2 appends the preview blob (every 10th waveform sample) to the
+// clip record; version 1 files are still read and preview from the waveform.
+class ProjectManager::BinaryContainer {
+public:
+    static constexpr uint32_t kVersion = 2;
+    static constexpr size_t kVersion1RecordSize = 104;
+    static constexpr uint32_t kByteOrderMark = 0x01020304;
+    static constexpr uint64_t kBlobAlignment = 64;
+    
+    enum SectionType : uint32_t { SectionMeta = 1, SectionStrings = 2, SectionClips = 3, SectionBlobs = 4 };
+    enum ClipKind : uint32_t { ClipVideo = 0, ClipAudio = 1 };
+    static constexpr uint32_t FlagEnabled = 1;
+    static constexpr uint32_t FlagMuted = 2;
+    
+    struct FileHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t byteOrderMark;
+        uint32_t sectionCount;
+        uint32_t reserved0;
+        uint64_t sectionTableOffset;
+        uint64_t fileSize;
+        uint64_t generation;        // Per full save; the journal must carry the same one
+        uint8_t reserved[16];
+    };
+    
+    struct SectionEntry {
+        uint32_t type;
+        uint32_t reserved;
+        uint64_t offset;
+        uint64_t size;
+    };
+    
+    // Blob offsets are relative to the start of the blob section
+    struct ClipRecord {
+        uint32_t kind;
+        uint32_t flags;
+        uint32_t idOffset;
+        uint32_t idLength;
+        uint32_t pathOffset;
+        uint32_t pathLength;
+        int32_t trackIndex;
+        float opacity;
+        float volume;
+        uint32_t reserved;
+        double startTime;
+        double duration;
+        double inPoint;
+        double outPoint;
+        uint64_t waveformOffset;
+        uint64_t waveformSize;
+        uint64_t effectsOffset;
+        uint64_t effectsSize;
+        uint64_t previewOffset;
+        uint64_t previewSize;
+    };
+    
+    static_assert(sizeof(FileHeader) == 64, "FileHeader layout changed");
+    static_assert(sizeof(SectionEntry) == 24, "SectionEntry layout changed");
+    static_assert(sizeof(ClipRecord) == 120, "ClipRecord layout changed");
+    
+    // Audio clips whose waveform is still deferred in an opened container;
+    // their blobs are copied from that mapping without materialising them
+    struct DeferredSource {
+        const BinaryContainer* container;
+        const std::unordered_map<std::string, DeferredBlob>* waveforms;
+    };
+    
+    static bool write(const std::string& filePath, const Timeline& timeline, uint64_t revision, uint64_t generation,
+                      const DeferredSource& deferred = DeferredSource{nullptr, nullptr}) {
+        std::string strings;
+        std::vector<ClipRecord> records;
+        std::deque<std::string> effectTexts;
+        std::deque<std::vector<float>> previews;
+        
+        struct PendingBlob {
+            const void* data;
+            uint64_t offset;
+            uint64_t size;
+        };
+        std::vector<PendingBlob> blobs;
+        uint64_t blobCursor = 0;
+        
+        auto addString = [&strings](const std::string& value, uint32_t& offset, uint32_t& length) {
+            offset = static_cast<uint32_t>(strings.size());
+            length = static_cast<uint32_t>(value.size());
+            strings.append(value);
+        };
+        auto addBlob = [&blobs, &blobCursor](const void* data, uint64_t size, uint64_t& offset, uint64_t& length) {
+            blobCursor = alignUp(blobCursor, kBlobAlignment);
+            offset = blobCursor;
+            length = size;
+            blobs.push_back({data, blobCursor, size});
+            blobCursor += size;
+        };
         
-        AVCodecContext* codecCtx = avcodec_alloc_context3(codec);
-        if (!codecCtx) {
-            LOG_ERROR("Could not allocate video codec context");
-            return nullptr;
+        Json::StreamWriterBuilder builder;
+        builder["indentation"] = "";
+        
+        for (const auto& clip : timeline.videoTracks) {
+            ClipRecord record = {};
+            record.kind = ClipVideo;
+            record.flags = clip->enabled ? FlagEnabled : 0;
+            addString(clip->id, record.idOffset, record.idLength);
+            addString(clip->filePath, record.pathOffset, record.pathLength);
+            record.trackIndex = clip->trackIndex;
+            record.opacity = clip->opacity;
+            record.volume = 1.0f;
+            record.startTime = clip->startTime;
+            record.duration = clip->duration;
+            record.inPoint = clip->inPoint;
+            record.outPoint = clip->outPoint;
+            
+            if (!clip->effects.empty() || !clip->properties.empty()) {
+                Json::Value effects;
+                for (const auto& effectName : clip->effects) {
+                    effects["effects"].append(effectName);
+                }
+                for (const auto& property : clip->properties) {
+                    effects["properties"][property.first] = property.second;
+                }
+                effectTexts.push_back(Json::writeString(builder, effects));
+                addBlob(effectTexts.back().data(), effectTexts.back().size(),
+                        record.effectsOffset, record.effectsSize);
+            }
+            records.push_back(record);
         }
         
-        codecCtx->codec_id = codec->id;
-        codecCtx->codec_type = AVMEDIA_TYPE_VIDEO;
-        codecCtx->width = settings.width;
-        codecCtx->height = settings.height;
-        codecCtx->time_base = av_d2q(1.0 / settings.frameRate, 1000000);
-        codecCtx->framerate = av_d2q(settings.frameRate, 1000000);
-        codecCtx->bit_rate = settings.videoBitrate;
-        codecCtx->gop_size = static_cast<int>(settings.frameRate); // 1 second GOP
-        codecCtx->max_b_frames = 2;
-        
-        // Set pixel format
-        if (settings.pixelFormat == "yuv420p") {
-            codecCtx->pix_fmt = AV_PIX_FMT_YUV420P;
-        } else if (settings.pixelFormat == "yuv444p") {
-            codecCtx->pix_fmt = AV_PIX_FMT_YUV444P;
-        } else {
-            codecCtx->pix_fmt = AV_PIX_FMT_YUV420P; // Default
-        }
-        
-        // Codec specific settings
-        if (settings.videoCodec == "libx264") {
-            av_opt_set(codecCtx->priv_data, "preset", settings.preset.c_str(), 0);
-            av_opt_set(codecCtx->priv_data, "crf", std::to_string(settings.crf).c_str(), 0);
-            av_opt_set(codecCtx->priv_data, "profile", "high", 0);
-        } else if (settings.videoCodec == "libx265") {
-            av_opt_set(codecCtx->priv_data, "preset", settings.preset.c_str(), 0);
-            av_opt_set(codecCtx->priv_data, "crf", std::to_string(settings.crf).c_str(), 0);
-        }
-        
-        // Hardware acceleration
-        if (settings.hardwareAcceleration && settings.videoCodec.find("nvenc") != std::string::npos) {
-            // NVIDIA NVENC settings
-            av_opt_set(codecCtx->priv_data, "preset", "slow", 0);
-            av_opt_set(codecCtx->priv_data, "rc", "vbr", 0);
-        }
-        
-        stream->time_base = codecCtx->time_base;
-        
-        int ret = avcodec_open2(codecCtx, codec, nullptr);
-        if (ret < 0) {
-            LOG_ERROR("Could not open video codec");
-            avcodec_free_context(&codecCtx);
-            return nullptr;
+        for (const auto& clip : timeline.audioTracks) {
+            ClipRecord record = {};
+            record.kind = ClipAudio;
+            record.flags = (clip->enabled ? FlagEnabled : 0) | (clip->muted ? FlagMuted : 0);
+            addString(clip->id, record.idOffset, record.idLength);
+            addString(clip->filePath, record.pathOffset, record.pathLength);
+            record.trackIndex = clip->trackIndex;
+            record.opacity = 1.0f;
+            record.volume = clip->volume;
+            record.startTime = clip->startTime;
+            record.duration = clip->duration;
+            
+            const DeferredBlob* stored = nullptr;
+            if (clip->waveform.empty() && deferred.container) {
+                auto it = deferred.waveforms->find(clip->id);
+                if (it != deferred.waveforms->end()) stored = &it->second;
+            }
+            
+            if (!clip->waveform.empty()) {
+                addBlob(clip->waveform.data(), clip->waveform.size() * sizeof(float),
+                        record.waveformOffset, record.waveformSize);
+                previews.push_back(previewWaveform(*clip));
+            } else if (stored) {
+                addBlob(deferred.container->blobData(stored->offset), stored->size,
+                        record.waveformOffset, record.waveformSize);
+                previews.push_back(deferred.container->readPreview(*stored));
+            }
+            if (record.waveformSize > 0 && !previews.back().empty()) {
+                addBlob(previews.back().data(), previews.back().size() * sizeof(float),
+                        record.previewOffset, record.previewSize);
+            }
+            records.push_back(record);
         }
         
-        // Copy parameters to stream
-        ret = avcodec_parameters_from_context(stream->codecpar, codecCtx);
-        if (ret < 0) {
-            LOG_ERROR("Could not copy video codec parameters");
-            avcodec_free_context(&codecCtx);
-            return nullptr;
+        Json::Value meta;
+        meta["name"] = timeline.name;
+        meta["duration"] = timeline.duration;
+        meta["width"] = timeline.width;
+        meta["height"] = timeline.height;
+        meta["frameRate"] = timeline.frameRate;
+        meta["revision"] = static_cast<Json::UInt64>(revision);
+        std::string metaText = Json::writeString(builder, meta);
+        
+        // Lay out the sections
+        const uint32_t sectionCount = 4;
+        SectionEntry sections[sectionCount] = {};
+        uint64_t cursor = sizeof(FileHeader) + sizeof(sections);
+        sections[0] = {SectionMeta, 0, cursor, metaText.size()};
+        cursor = alignUp(cursor + metaText.size(), 8);
+        sections[1] = {SectionStrings, 0, cursor, strings.size()};
+        cursor = alignUp(cursor + strings.size(), 8);
+        sections[2] = {SectionClips, 0, cursor, records.size() * sizeof(ClipRecord)};
+        cursor = alignUp(cursor + records.size() * sizeof(ClipRecord), kBlobAlignment);
+        sections[3] = {SectionBlobs, 0, cursor, blobCursor};
+        
+        FileHeader header = {};
+        std::memcpy(header.magic, "TVPROJ\0\0", sizeof(header.magic));
+        header.version = kVersion;
+        header.byteOrderMark = kByteOrderMark;
+        header.sectionCount = sectionCount;
+        header.sectionTableOffset = sizeof(FileHeader);
+        header.fileSize = cursor + blobCursor;
+        header.generation = generation;
+        
+        std::ofstream file(filePath, std::ios::binary | std::ios::trunc);
+        if (!file) return false;
+        
+        uint64_t written = 0;
+        auto writeBytes = [&file, &written](const void* data, uint64_t size) {
+            file.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+            written += size;
+        };
+        auto padTo = [&file, &written](uint64_t offset) {
+            static const char zeros[kBlobAlignment] = {};
+            while (written < offset) {
+                uint64_t chunk = std::min<uint64_t>(offset - written, sizeof(zeros));
+                file.write(zeros, static_cast<std::streamsize>(chunk));
+                written += chunk;
+            }
+        };
+        
+        writeBytes(&header, sizeof(header));
+        writeBytes(sections, sizeof(sections));
+        writeBytes(metaText.data(), metaText.size());
+        padTo(sections[1].offset);
+        writeBytes(strings.data(), strings.size());
+        padTo(sections[2].offset);
+        writeBytes(records.data(), records.size() * sizeof(ClipRecord));
+        for (const auto& blob : blobs) {
+            padTo(sections[3].offset + blob.offset);
+            writeBytes(blob.data, blob.size);
         }
         
-        return codecCtx;
+        file.flush();
+        return static_cast<bool>(file);
     }
     
-    AVCodecContext* setupAudioEncoder(AVStream* stream, const ExportSettings& settings) {
-        const AVCodec* codec = avcodec_find_encoder_by_name(settings.audioCodec.c_str());
-        if (!codec) {
-            LOG_ERROR("Audio codec not found: " + settings.audioCodec);
-            return nullptr;
-        }
-        
-        AVCodecContext* codecCtx = avcodec_alloc_context3(codec);
-        if (!codecCtx) {
-            LOG_ERROR("Could not allocate audio codec context");
-            return nullptr;
+    bool open(const std::string& filePath) {
+        if (!mapping.open(filePath)) {
+            LOG_ERROR("Could not map project file: " + filePath);
+            return false;
         }
         
-        codecCtx->codec_id = codec->id;
-        codecCtx->codec_type = AVMEDIA_TYPE_AUDIO;
-        codecCtx->bit_rate = settings.audioBitrate;
-        codecCtx->sample_rate = settings.audioSampleRate;
-        codecCtx->channels = 2; // Stereo
-        codecCtx->channel_layout = AV_CH_LAYOUT_STEREO;
-        codecCtx->time_base = {1, settings.audioSampleRate};
+        const uint8_t* base = mapping.getData();
+        size_t fileSize = mapping.getSize();
         
-        // Set sample format based on codec
-        if (codec->sample_fmts) {
-            codecCtx->sample_fmt = codec->sample_fmts[0]; // Use first supported format
-        } else {
-            codecCtx->sample_fmt = AV_SAMPLE_FMT_FLTP; // Default to float planar
+        if (fileSize < sizeof(FileHeader)) return fail("File too small");
+        FileHeader header;
+        std::memcpy(&header, base, sizeof(header));
+        if (std::memcmp(header.magic, "TVPROJ\0\0", sizeof(header.magic)) != 0) return fail("Bad magic");
+        if (header.byteOrderMark != kByteOrderMark) return fail("Byte order mismatch");
+        if (header.version < 1 || header.version > kVersion) {
+            return fail("Unsupported version " + std::to_string(header.version));
         }
-        
-        stream->time_base = codecCtx->time_base;
-        
-        int ret = avcodec_open2(codecCtx, codec, nullptr);
-        if (ret < 0) {
-            LOG_ERROR("Could not open audio codec");
-            avcodec_free_context(&codecCtx);
-            return nullptr;
+        recordSize = header.version == 1 ? kVersion1RecordSize : sizeof(ClipRecord);
+        if (header.fileSize != fileSize) return fail("Truncated file");
+        generation = header.generation;
+        if (header.sectionTableOffset + uint64_t(header.sectionCount) * sizeof(SectionEntry) > fileSize) {
+            return fail("Section table out of bounds");
         }
         
-        // Copy parameters to stream
-        ret = avcodec_parameters_from_context(stream->codecpar, codecCtx);
-        if (ret < 0) {
-            LOG_ERROR("Could not copy audio codec parameters");
-            avcodec_free_context(&codecCtx);
-            return nullptr;
+        for (uint32_t i = 0; i < header.sectionCount; i++) {
+            SectionEntry entry;
+            std::memcpy(&entry, base + header.sectionTableOffset + i * sizeof(SectionEntry), sizeof(entry));
+            if (entry.offset > fileSize || entry.size > fileSize - entry.offset) {
+                return fail("Section out of bounds");
+            }
+            // Unknown section types are skipped so newer writers stay readable
+            switch (entry.type) {
+                case SectionMeta: meta = entry; break;
+                case SectionStrings: strings = entry; break;
+                case SectionClips: clips = entry; break;
+                case SectionBlobs: blobs = entry; break;
+                default: break;
+            }
         }
         
-        return codecCtx;
+        if (clips.size % recordSize != 0) return fail("Malformed clip section");
+        return true;
     }
     
-    cv::Mat renderVideoFrame(const Timeline& timeline, double currentTime, int width, int height) {
-        cv::Mat compositeFrame = cv::Mat::zeros(height, width, CV_8UC3);
-        
-        // Sort clips by track index for proper layering
-        auto sortedClips = timeline.videoTracks;
-        std::sort(sortedClips.begin(), sortedClips.end(),
-            [](const std::shared_ptr<VideoClip>& a, const std::shared_ptr<VideoClip>& b) {
-                return a->trackIndex < b->trackIndex;
-            });
+    // Materialises timeline settings and clip metadata. Effect settings are
+    // small and read here; waveforms are only recorded in deferredWaveforms.
+    bool readTimeline(Timeline& timeline, std::unordered_map<std::string, DeferredBlob>& deferredWaveforms) const {
+        Json::Value metaData;
+        Json::CharReaderBuilder builder;
+        std::unique_ptr<Json::CharReader> reader(builder.newCharReader());
+        const char* metaBegin = reinterpret_cast<const char*>(mapping.getData() + meta.offset);
+        std::string errors;
+        if (!reader->parse(metaBegin, metaBegin + meta.size, &metaData, &errors)) {
+            LOG_ERROR("Invalid project metadata: " + errors);
+            return false;
+        }
         
-        // Process each video track
-        for (const auto& clip : sortedClips) {
-            if (!clip->enabled) continue;
+        timeline.name = metaData.get("name", "Untitled").asString();
+        timeline.duration = metaData.get("duration", 0.0).asDouble();
+        timeline.width = metaData.get("width", 1920).asInt();
+        timeline.height = metaData.get("height", 1080).asInt();
+        timeline.frameRate = metaData.get("frameRate", 30.0).asDouble();
+        timeline.videoTracks.clear();
+        timeline.audioTracks.clear();
+        
+        // Fields a version 1 record lacks stay zero
+        size_t clipCount = clips.size / recordSize;
+        for (size_t i = 0; i < clipCount; i++) {
+            ClipRecord record = {};
+            std::memcpy(&record, mapping.getData() + clips.offset + i * recordSize, recordSize);
             
-            if (currentTime >= clip->startTime && 
-                currentTime < clip->startTime + clip->duration) {
-                
-                double clipTime = currentTime - clip->startTime + clip->inPoint;
+            std::string id, filePath;
+            if (!readString(record.idOffset, record.idLength, id) ||
+                !readString(record.pathOffset, record.pathLength, filePath) ||
+                !blobInBounds(record.waveformOffset, record.waveformSize) ||
+                !blobInBounds(record.effectsOffset, record.effectsSize) ||
+                !blobInBounds(record.previewOffset, record.previewSize)) {
+                LOG_ERROR("Clip record " + std::to_string(i) + " out of bounds");
+                return false;
+            }
+            
+            if (record.kind == ClipVideo) {
+                auto clip = std::make_shared<VideoClip>();
+                clip->id = id;
+                clip->filePath = filePath;
+                clip->startTime = record.startTime;
+                clip->duration = record.duration;
+                clip->inPoint = record.inPoint;
+                clip->outPoint = record.outPoint;
+                clip->trackIndex = record.trackIndex;
+                clip->enabled = (record.flags & FlagEnabled) != 0;
+                clip->opacity = record.opacity;
                 
-                // Load frame from video file
-                VideoEngine engine;
-                if (engine.loadVideo(clip->filePath)) {
-                    cv::Mat frame = engine.getFrameAt(clipTime);
-                    
-                    if (!frame.empty()) {
-                        // Resize frame to timeline dimensions
-                        cv::resize(frame, frame, cv::Size(width, height));
-                        
-                        // Apply effects
-                        for (const auto& effectName : clip->effects) {
-                            frame = applyVideoEffect(frame, effectName, clip->properties);
+                if (record.effectsSize > 0) {
+                    const char* text = reinterpret_cast<const char*>(
+                        mapping.getData() + blobs.offset + record.effectsOffset);
+                    Json::Value effects;
+                    if (reader->parse(text, text + record.effectsSize, &effects, &errors)) {
+                        for (const auto& effectName : effects["effects"]) {
+                            clip->effects.push_back(effectName.asString());
                         }
-                        
-                        // Apply opacity and composite
-                        if (clip->opacity < 1.0f) {
-                            cv::Mat temp;
-                            cv::addWeighted(compositeFrame, 1.0f - clip->opacity, frame, clip->opacity, 0, temp);
-                            compositeFrame = temp;
-                        } else {
-                            frame.copyTo(compositeFrame);
+                        for (const auto& key : effects["properties"].getMemberNames()) {
+                            clip->properties[key] = effects["properties"][key].asFloat();
                         }
+                    } else {
+                        LOG_WARNING("Ignoring unreadable effect settings for clip: " + id);
                     }
                 }
+                timeline.videoTracks.push_back(clip);
+            } else if (record.kind == ClipAudio) {
+                auto clip = std::make_shared<AudioClip>();
+                clip->id = id;
+                clip->filePath = filePath;
+                clip->startTime = record.startTime;
+                clip->duration = record.duration;
+                clip->volume = record.volume;
+                clip->trackIndex = record.trackIndex;
+                clip->enabled = (record.flags & FlagEnabled) != 0;
+                clip->muted = (record.flags & FlagMuted) != 0;
+                
+                if (record.waveformSize > 0) {
+                    deferredWaveforms[id] = {record.waveformOffset, record.waveformSize,
+                                             record.previewOffset, record.previewSize};
+                }
+                timeline.audioTracks.push_back(clip);
             }
         }
         
-        return compositeFrame;
+        return true;
     }
     
-    std::vector<float> renderAudioSamples(const Timeline& timeline, double currentTime, 
-                                        double duration, int sampleRate) {
-        int sampleCount = static_cast<int>(duration * sampleRate);
-        std::vector<float> mixedAudio(sampleCount * 2, 0.0f); // Stereo
-        
-        // Process each audio track
-        for (const auto& clip : timeline.audioTracks) {
-            if (!clip->enabled || clip->muted) continue;
-            
-            if (currentTime >= clip->startTime && 
-                currentTime < clip->startTime + clip->duration) {
-                
-                double clipTime = currentTime - clip->startTime;
-                int startSample = static_cast<int>(clipTime * sampleRate);
-                
-                // Extract samples from waveform (assuming mono input)
-                for (int i = 0; i < sampleCount && startSample + i < clip->waveform.size(); i++) {
-                    float sample = clip->waveform[startSample + i] * clip->volume;
-                    
-                    // Convert mono to stereo
-                    mixedAudio[i * 2] += sample;     // Left channel
-                    mixedAudio[i * 2 + 1] += sample; // Right channel
-                }
-            }
+    // For readers that never touch waveforms, such as render workers
+    bool readTimeline(Timeline& timeline) const {
+        std::unordered_map<std::string, DeferredBlob> ignored;
+        return readTimeline(timeline, ignored);
+    }
+    
+    Json::Value readMeta() const {
+        Json::Value metaData;
+        Json::CharReaderBuilder builder;
+        std::unique_ptr<Json::CharReader> reader(builder.newCharReader());
+        const char* metaBegin = reinterpret_cast<const char*>(mapping.getData() + meta.offset);
+        reader->parse(metaBegin, metaBegin + meta.size, &metaData, nullptr);
+        return metaData;
+    }
+    
+    uint64_t getGeneration() const { return generation; }
+    
+    const uint8_t* blobData(uint64_t offset) const {
+        return mapping.getData() + blobs.offset + offset;
+    }
+    
+    std::vector<float> readWaveform(const DeferredBlob& blob) const {
+        std::vector<float> waveform(blob.size / sizeof(float));
+        std::memcpy(waveform.data(), blobData(blob.offset), waveform.size() * sizeof(float));
+        return waveform;
+    }
+    
+    // Same samples as ProjectManager::previewWaveform; version 1 files have no
+    // preview blob, so those stride through the mapped waveform instead
+    std::vector<float> readPreview(const DeferredBlob& blob) const {
+        if (blob.previewSize > 0) {
+            std::vector<float> preview(blob.previewSize / sizeof(float));
+            std::memcpy(preview.data(), blobData(blob.previewOffset), preview.size() * sizeof(float));
+            return preview;
         }
         
-        // Normalize to prevent clipping
-        float maxSample = 0.0f;
-        for (float sample : mixedAudio) {
-            maxSample = std::max(maxSample, std::abs(sample));
+        size_t count = blob.size / sizeof(float);
+        const uint8_t* samples = blobData(blob.offset);
+        std::vector<float> preview;
+        preview.reserve(count / 10 + 1);
+        for (size_t i = 0; i < count; i += 10) {
+            float sample;
+            std::memcpy(&sample, samples + i * sizeof(float), sizeof(sample));
+            preview.push_back(sample);
         }
-        
-        if (maxSample > 1.0f) {
-            for (float& sample : mixedAudio) {
-                sample /= maxSample;
+        return preview;
+    }
+    
+private:
+    MappedFile mapping;
+    uint64_t generation = 0;
+    size_t recordSize = sizeof(ClipRecord);
+    SectionEntry meta = {};
+    SectionEntry strings = {};
+    SectionEntry clips = {};
+    SectionEntry blobs = {};
+    
+    static uint64_t alignUp(uint64_t value, uint64_t alignment) {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+    
+    bool fail(const std::string& reason) {
+        LOG_ERROR("Invalid project container: " + reason);
+        mapping.close();
+        return false;
+    }
+    
+    bool readString(uint32_t offset, uint32_t length, std::string& value) const {
+        if (uint64_t(offset) + length > strings.size) return false;
+        value.assign(reinterpret_cast<const char*>(mapping.getData() + strings.offset + offset), length);
+        return true;
+    }
+    
+    bool blobInBounds(uint64_t offset, uint64_t size) const {
+        return size == 0 || (offset <= blobs.size && size <= blobs.size - offset);
+    }
+};
+
+// Journal record: [u32 payload length][u32 crc32 of payload]
+//                 [u64 revision][u32 JSON length][JSON op][float32 waveform]
+// Replay stops at the first torn or corrupt record, so a crash mid-append
+// only loses the batch that was not yet durable.
+//
+// The first record (revision 0) names the generation of the snapshot the
+// journal extends. Every full save starts a new generation, and records
+// from any other generation (an older session, another project saved to
+// the same path) are never replayed.
+class ProjectManager::EditJournal {
+public:
+    // Opening a journal of another generation empties it. A journal of this
+    // generation is cut back to its last intact record, so a tail torn by a
+    // crash never sits in front of new records.
+    EditJournal(const std::string& journalPath, uint64_t generation, std::function<void(EditJournal&)> compactor,
+                std::chrono::milliseconds flushInterval = std::chrono::milliseconds(200),
+                std::chrono::seconds compactionInterval = std::chrono::seconds(60))
+        : path(journalPath), fd(-1), generation(generation), compactor(compactor), flushInterval(flushInterval),
+          compactionInterval(compactionInterval), appendedSequence(0), durableSequence(0),
+          recordsSinceCompaction(0), flushRequested(false), running(true), intactSize(0) {
+        fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+        uint64_t existing = 0;
+        if (fd >= 0 && !(readGeneration(path, existing) && existing == generation)) {
+            std::string header;
+            encodeRecord(header, 0, generationOp(generation), nullptr);
+            if (ftruncate(fd, 0) != 0 || !writeAll(fd, header.data(), header.size()) || fdatasync(fd) != 0) {
+                ::close(fd);
+                fd = -1;
             }
+            intactSize = header.size();
+        } else if (fd >= 0) {
+            intactSize = forEachRecord(path, [](uint64_t, const char*, size_t) {});
+            struct stat st;
+            if (fstat(fd, &st) == 0 && static_cast<uint64_t>(st.st_size) > intactSize &&
+                (ftruncate(fd, static_cast<off_t>(intactSize)) != 0 || fdatasync(fd) != 0)) {
+                ::close(fd);
+                fd = -1;
+            }
+        }
+        if (fd < 0) {
+            LOG_ERROR("Could not open edit journal: " + path);
+            running = false;
+            return;
         }
         
-        return mixedAudio;
+        writerThread = std::thread([this]() { writerLoop(); });
+        compactionThread = std::thread([this]() { compactionLoop(); });
     }
     
-    cv::Mat applyVideoEffect(const cv::Mat& frame, const std::string& effectName, 
-                           const std::unordered_map<std::string, float>& params) {
-        if (effectName == "color_correction") {
-            float brightness = getParam(params, "brightness", 0.0f);
-            float contrast = getParam(params, "contrast", 1.0f);
-            float saturation = getParam(params, "saturation", 1.0f);
-            float hue = getParam(params, "hue", 0.0f);
-            return EffectProcessor::applyColorCorrection(frame, brightness, contrast, saturation, hue);
-        } else if (effectName == "blur") {
-            float strength = getParam(params, "strength", 5.0f);
-            std::string type = "gaussian"; // Could be extracted from string params
-            return EffectProcessor::applyBlur(frame, strength, type);
-        } else if (effectName == "glow") {
-            float intensity = getParam(params, "intensity", 0.5f);
-            float radius = getParam(params, "radius", 10.0f);
-            return EffectProcessor::applyGlow(frame, intensity, radius);
-        } else if (effectName == "vignette") {
-            float strength = getParam(params, "strength", 0.5f);
-            return EffectProcessor::applyVignette(frame, strength);
+    ~EditJournal() {
+        {
+            std::lock_guard<std::mutex> lock(journalMutex);
+            running = false;
         }
+        wakeCondition.notify_all();
+        if (writerThread.joinable()) writerThread.join();
+        if (compactionThread.joinable()) compactionThread.join();
         
-        return frame; // No effect applied
+        std::lock_guard<std::mutex> ioLock(ioMutex);
+        writePending();
+        if (fd >= 0) ::close(fd);
     }
     
-    bool writeVideoFrame(AVFormatContext* formatCtx, AVCodecContext* codecCtx, 
-                        AVStream* stream, const cv::Mat& frame, int frameNumber) {
-        AVFrame* avFrame = av_frame_alloc();
-        if (!avFrame) return false;
+    EditJournal(const EditJournal&) = delete;
+    EditJournal& operator=(const EditJournal&) = delete;
+    
+    bool isOpen() const { return fd >= 0; }
+    
+    uint64_t getGeneration() {
+        std::lock_guard<std::mutex> ioLock(ioMutex);
+        return generation;
+    }
+    
+    // Cheap: encodes into the pending batch; the writer thread does the IO
+    void append(uint64_t revision, const Json::Value& op, const std::vector<float>* waveform) {
+        std::string record;
+        encodeRecord(record, revision, op, waveform);
+        
+        std::lock_guard<std::mutex> lock(journalMutex);
+        pendingBytes.append(record);
+        appendedSequence++;
+        recordsSinceCompaction++;
+    }
+    
+    // Blocks until everything appended so far is on disk
+    bool flush() {
+        std::unique_lock<std::mutex> lock(journalMutex);
+        if (!isOpen()) return false;
+        
+        uint64_t target = appendedSequence;
+        flushRequested = true;
+        wakeCondition.notify_all();
+        durableCondition.wait(lock, [this, target]() { return durableSequence >= target || !running; });
+        return durableSequence >= target;
+    }
+    
+    // Drops records already contained in a snapshot taken at snapshotRevision.
+    // A non-zero newGeneration moves the journal onto the snapshot of a new
+    // full save; the records it keeps are newer than that snapshot.
+    bool compact(uint64_t snapshotRevision, uint64_t newGeneration = 0) {
+        std::lock_guard<std::mutex> ioLock(ioMutex);
+        writePending();
+        if (newGeneration != 0) {
+            generation = newGeneration;
+        }
         
-        avFrame->format = codecCtx->pix_fmt;
-        avFrame->width = codecCtx->width;
-        avFrame->height = codecCtx->height;
-        avFrame->pts = frameNumber;
+        std::string kept;
+        encodeRecord(kept, 0, generationOp(generation), nullptr);
+        size_t keptCount = 0;
+        forEachRecord(path, [&](uint64_t revision, const char* record, size_t recordSize) {
+            if (revision > snapshotRevision) {
+                kept.append(record, recordSize);
+                keptCount++;
+            }
+        });
         
-        int ret = av_frame_get_buffer(avFrame, 0);
-        if (ret < 0) {
-            av_frame_free(&avFrame);
+        std::string tempPath = path + ".tmp";
+        int tempFd = ::open(tempPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (tempFd < 0) return false;
+        bool ok = writeAll(tempFd, kept.data(), kept.size());
+        ::close(tempFd);
+        if (!ok || !replaceFileDurably(tempPath, path)) {
+            std::remove(tempPath.c_str());
             return false;
         }
         
-        // Convert OpenCV Mat to AVFrame
-        SwsContext* swsCtx = sws_getContext(
-            frame.cols, frame.rows, AV_PIX_FMT_BGR24,
-            codecCtx->width, codecCtx->height, codecCtx->pix_fmt,
-            SWS_BILINEAR, nullptr, nullptr, nullptr
-        );
+        ::close(fd);
+        fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+        intactSize = kept.size();
         
-        const uint8_t* srcData[4] = {frame.data, nullptr, nullptr, nullptr};
-        int srcLinesize[4] = {static_cast<int>(frame.step[0]), 0, 0, 0};
-        
-        sws_scale(swsCtx, srcData, srcLinesize, 0, frame.rows, avFrame->data, avFrame->linesize);
-        sws_freeContext(swsCtx);
-        
-        // Encode frame
-        ret = avcodec_send_frame(codecCtx, avFrame);
-        av_frame_free(&avFrame);
+        std::lock_guard<std::mutex> lock(journalMutex);
+        recordsSinceCompaction = keptCount;
+        return fd >= 0;
+    }
+    
+    // Calls apply for every intact record after snapshotRevision; returns
+    // the highest revision seen so numbering can continue after it. Nothing
+    // is replayed from a journal of another generation.
+    static uint64_t replay(const std::string& journalPath, uint64_t generation, uint64_t snapshotRevision,
+                           const std::function<void(const Json::Value&, std::vector<float>&)>& apply) {
+        uint64_t highestRevision = snapshotRevision;
+        uint64_t journalGeneration = 0;
+        if (!readGeneration(journalPath, journalGeneration)) return highestRevision;
+        if (journalGeneration != generation) {
+            LOG_WARNING("Ignoring edit journal from another save: " + journalPath);
+            return highestRevision;
+        }
         
-        if (ret < 0) return false;
+        Json::CharReaderBuilder builder;
+        std::unique_ptr<Json::CharReader> reader(builder.newCharReader());
         
-        AVPacket* packet = av_packet_alloc();
-        while (ret >= 0) {
-            ret = avcodec_receive_packet(codecCtx, packet);
-            if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
-                break;
-            } else if (ret < 0) {
-                av_packet_free(&packet);
-                return false;
-            }
+        forEachRecord(journalPath, [&](uint64_t revision, const char* record, size_t recordSize) {
+            if (revision <= snapshotRevision) return;
+            highestRevision = std::max(highestRevision, revision);
             
-            packet->stream_index = stream->index;
-            av_packet_rescale_ts(packet, codecCtx->time_base, stream->time_base);
+            uint32_t jsonLength = static_cast<uint32_t>(readInt(record + 16, 4));
+            const char* json = record + 20;
+            Json::Value op;
+            if (!reader->parse(json, json + jsonLength, &op, nullptr)) return;
             
-            ret = av_interleaved_write_frame(formatCtx, packet);
-            av_packet_unref(packet);
-        }
+            std::vector<float> waveform((recordSize - 20 - jsonLength) / sizeof(float));
+            if (!waveform.empty()) {
+                std::memcpy(waveform.data(), json + jsonLength, waveform.size() * sizeof(float));
+            }
+            apply(op, waveform);
+        });
         
-        av_packet_free(&packet);
-        return true;
+        return highestRevision;
     }
     
-    bool writeAudioSamples(AVFormatContext* formatCtx, AVCodecContext* codecCtx,
-                          AVStream* stream, const std::vector<float>& samples, int frameNumber) {
-        AVFrame* avFrame = av_frame_alloc();
-        if (!avFrame) return false;
-        
-        avFrame->format = codecCtx->sample_fmt;
-        avFrame->channels = codecCtx->channels;
-        avFrame->sample_rate = codecCtx->sample_rate;
-        avFrame->nb_samples = samples.size() / codecCtx->channels;
-        avFrame->pts = frameNumber * avFrame->nb_samples;
-        
-        int ret = av_frame_get_buffer(avFrame, 0);
-        if (ret < 0) {
-            av_frame_free(&avFrame);
-            return false;
+private:
+    std::string path;
+    int fd;
+    uint64_t generation;         // Guarded by ioMutex
+    std::function<void(EditJournal&)> compactor;
+    std::chrono::milliseconds flushInterval;
+    std::chrono::seconds compactionInterval;
+    
+    std::mutex journalMutex;     // pending batch and counters
+    std::mutex ioMutex;          // file descriptor and on-disk contents
+    std::condition_variable wakeCondition;
+    std::condition_variable durableCondition;
+    std::string pendingBytes;
+    uint64_t appendedSequence;
+    uint64_t durableSequence;
+    size_t recordsSinceCompaction;
+    bool flushRequested;
+    bool running;
+    std::thread writerThread;
+    std::thread compactionThread;
+    uint64_t intactSize;         // Bytes of whole records on disk; guarded by ioMutex
+    
+    // Batches whatever accumulated during flushInterval into one write + fdatasync
+    void writerLoop() {
+        std::unique_lock<std::mutex> lock(journalMutex);
+        while (running) {
+            wakeCondition.wait_for(lock, flushInterval, [this]() { return !running || flushRequested; });
+            if (pendingBytes.empty() && !flushRequested) continue;
+            
+            lock.unlock();
+            {
+                std::lock_guard<std::mutex> ioLock(ioMutex);
+                writePending();
+            }
+            lock.lock();
+        }
+    }
+    
+    // Callers hold ioMutex
+    void writePending() {
+        std::string batch;
+        uint64_t batchSequence;
+        {
+            std::lock_guard<std::mutex> lock(journalMutex);
+            batch.swap(pendingBytes);
+            batchSequence = appendedSequence;
+            flushRequested = false;
+        }
+        
+        bool ok = batch.empty() || (writeAll(fd, batch.data(), batch.size()) && fdatasync(fd) == 0);
+        if (ok) {
+            intactSize += batch.size();
+        } else {
+            // Drop the partial batch so later records still follow whole ones
+            LOG_ERROR("Edit journal write failed: " + path);
+            if (ftruncate(fd, static_cast<off_t>(intactSize)) != 0) {
+                LOG_ERROR("Could not cut back edit journal: " + path);
+            }
+        }
+        
+        {
+            std::lock_guard<std::mutex> lock(journalMutex);
+            if (ok) durableSequence = batchSequence;
+        }
+        durableCondition.notify_all();
+    }
+    
+    void compactionLoop() {
+        std::unique_lock<std::mutex> lock(journalMutex);
+        while (running) {
+            wakeCondition.wait_for(lock, compactionInterval, [this]() { return !running; });
+            if (!running || recordsSinceCompaction == 0) continue;
+            
+            lock.unlock();
+            compactor(*this);
+            lock.lock();
+        }
+    }
+    
+    static void encodeRecord(std::string& out, uint64_t revision, const Json::Value& op,
+                             const std::vector<float>* waveform) {
+        Json::StreamWriterBuilder builder;
+        builder["indentation"] = "";
+        std::string json = Json::writeString(builder, op);
+        size_t blobSize = waveform ? waveform->size() * sizeof(float) : 0;
+        
+        std::string payload;
+        payload.reserve(12 + json.size() + blobSize);
+        appendInt(payload, revision, 8);
+        appendInt(payload, json.size(), 4);
+        payload.append(json);
+        if (blobSize > 0) {
+            payload.append(reinterpret_cast<const char*>(waveform->data()), blobSize);
+        }
+        
+        appendInt(out, payload.size(), 4);
+        appendInt(out, crc32(payload.data(), payload.size()), 4);
+        out.append(payload);
+    }
+    
+    static Json::Value generationOp(uint64_t generation) {
+        Json::Value op;
+        op["op"] = "journalGeneration";
+        op["generation"] = static_cast<Json::UInt64>(generation);
+        return op;
+    }
+    
+    // False when the journal is missing, empty or predates generations
+    static bool readGeneration(const std::string& journalPath, uint64_t& generation) {
+        bool found = false;
+        bool first = true;
+        forEachRecord(journalPath, [&](uint64_t revision, const char* record, size_t recordSize) {
+            if (!first) return;
+            first = false;
+            
+            uint32_t jsonLength = static_cast<uint32_t>(readInt(record + 16, 4));
+            const char* json = record + 20;
+            Json::CharReaderBuilder builder;
+            std::unique_ptr<Json::CharReader> reader(builder.newCharReader());
+            Json::Value op;
+            if (revision == 0 && recordSize >= 20 + jsonLength &&
+                reader->parse(json, json + jsonLength, &op, nullptr) &&
+                op["op"].asString() == "journalGeneration") {
+                generation = op["generation"].asUInt64();
+                found = true;
+            }
+        });
+        return found;
+    }
+    
+    static bool writeAll(int fileDescriptor, const char* data, size_t size) {
+        while (size > 0) {
+            ssize_t written = ::write(fileDescriptor, data, size);
+            if (written < 0) {
+                if (errno == EINTR) continue;
+                return false;
+            }
+            data += written;
+            size -= static_cast<size_t>(written);
+        }
+        return true;
+    }
+    
+    // Visits each intact record; recordSize includes the 8-byte frame header.
+    // Returns where the intact records end.
+    static uint64_t forEachRecord(const std::string& journalPath,
+                                  const std::function<void(uint64_t, const char*, size_t)>& visit) {
+        MappedFile file;
+        if (!file.open(journalPath)) return 0;
+        
+        const char* data = reinterpret_cast<const char*>(file.getData());
+        size_t size = file.getSize();
+        size_t offset = 0;
+        while (size - offset >= 8) {
+            uint64_t payloadLength = readInt(data + offset, 4);
+            uint32_t checksum = static_cast<uint32_t>(readInt(data + offset + 4, 4));
+            if (payloadLength < 12 || payloadLength > size - offset - 8) break;
+            
+            const char* payload = data + offset + 8;
+            if (crc32(payload, payloadLength) != checksum) break;
+            if (readInt(payload + 8, 4) > payloadLength - 12) break;
+            
+            visit(readInt(payload, 8), data + offset, payloadLength + 8);
+            offset += payloadLength + 8;
+        }
+        
+        if (offset < size) {
+            LOG_WARNING("Edit journal has a torn tail, ignoring " + std::to_string(size - offset) + " bytes");
+        }
+        return offset;
+    }
+    
+    static void appendInt(std::string& out, uint64_t value, int bytes) {
+        for (int i = 0; i < bytes; i++) {
+            out.push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+        }
+    }
+    
+    static uint64_t readInt(const char* in, int bytes) {
+        uint64_t value = 0;
+        for (int i = 0; i < bytes; i++) {
+            value |= static_cast<uint64_t>(static_cast<uint8_t>(in[i])) << (8 * i);
+        }
+        return value;
+    }
+    
+    static uint32_t crc32(const char* data, size_t size) {
+        static const std::vector<uint32_t> table = []() {
+            std::vector<uint32_t> entries(256);
+            for (uint32_t i = 0; i < 256; i++) {
+                uint32_t c = i;
+                for (int k = 0; k < 8; k++) {
+                    c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+                }
+                entries[i] = c;
+            }
+            return entries;
+        }();
+        
+        uint32_t crc = 0xFFFFFFFFu;
+        for (size_t i = 0; i < size; i++) {
+            crc = table[(crc ^ static_cast<uint8_t>(data[i])) & 0xff] ^ (crc >> 8);
+        }
+        return crc ^ 0xFFFFFFFFu;
+    }
+};
+
+bool ProjectManager::saveProjectBinary(const std::string& filePath) {
+    std::shared_ptr<EditJournal> activeJournal;
+    {
+        std::lock_guard<std::mutex> lock(projectMutex);
+        if (journalProjectPath == filePath) {
+            activeJournal = journal;
+        }
+    }
+    
+    // The file already holds a snapshot plus the journal; only the journal
+    // tail has to reach the disk
+    if (activeJournal && activeJournal->flush()) {
+        std::lock_guard<std::mutex> lock(projectMutex);
+        isDirty = false;
+        lastSave = std::chrono::system_clock::now();
+        LOG_INFO("Project saved (journal): " + filePath);
+        return true;
+    }
+    
+    // Waveforms still deferred in the opened file are copied blob to blob
+    std::shared_ptr<BinaryContainer> source;
+    std::unordered_map<std::string, DeferredBlob> deferred;
+    auto snapshot = pinTimeline(source, deferred);
+    
+    // Write next to the target and rename, so a failed save never leaves a
+    // half-written project behind. A full save starts a new generation, which
+    // disowns whatever journal is already at this path.
+    uint64_t generation = newGeneration();
+    std::string tempPath = filePath + ".tmp";
+    if (!BinaryContainer::write(tempPath, snapshot->timeline, snapshot->revision, generation,
+                                {source.get(), &deferred})) {
+        LOG_ERROR("Failed to write project: " + filePath);
+        std::remove(tempPath.c_str());
+        return false;
+    }
+    if (!replaceFileDurably(tempPath, filePath)) {
+        LOG_ERROR("Failed to replace project file: " + filePath);
+        std::remove(tempPath.c_str());
+        return false;
+    }
+    
+    {
+        std::lock_guard<std::mutex> lock(projectMutex);
+        if (revision == snapshot->revision) {
+            isDirty = false;
+        }
+        lastSave = std::chrono::system_clock::now();
+    }
+    
+    attachJournal(filePath, generation, snapshot->revision);
+    LOG_INFO("Project saved: " + filePath);
+    return true;
+}
+
+bool ProjectManager::loadProjectBinary(const std::string& filePath) {
+    auto loaded = std::make_shared<BinaryContainer>();
+    if (!loaded->open(filePath)) {
+        return false;
+    }
+    
+    Timeline loadedTimeline;
+    std::unordered_map<std::string, DeferredBlob> deferred;
+    if (!loaded->readTimeline(loadedTimeline, deferred)) {
+        LOG_ERROR("Failed to read project: " + filePath);
+        return false;
+    }
+    
+    uint64_t snapshotRevision;
+    size_t deferredCount;
+    std::shared_ptr<EditJournal> previousJournal;
+    {
+        std::lock_guard<std::mutex> lock(projectMutex);
+        // Replayed edits must not be appended to the journal they come from
+        previousJournal = std::move(journal);
+        journalProjectPath.clear();
+        timeline = loadedTimeline;
+        projectData = loaded->readMeta();
+        snapshotRevision = projectData.get("revision", 0).asUInt64();
+        revision = std::max(revision, snapshotRevision);
+        deferredWaveforms = std::move(deferred);
+        deferredCount = deferredWaveforms.size();
+        container = deferredWaveforms.empty() ? nullptr : loaded;
+        isDirty = false;
+        lastSave = std::chrono::system_clock::now();
+    }
+    
+    previousJournal.reset();
+    
+    // Edits made after the snapshot was written survive in the journal
+    uint64_t replayed = replayJournal(filePath, loaded->getGeneration(), snapshotRevision);
+    attachJournal(filePath, loaded->getGeneration(), snapshotRevision);
+    
+    LOG_INFO("Project loaded: " + filePath + " (" + std::to_string(deferredCount) +
+             " waveforms deferred, " + std::to_string(replayed) + " journal records replayed)");
+    return true;
+}
+
+void ProjectManager::loadDeferredBlobs() {
+    std::lock_guard<std::mutex> lock(projectMutex);
+    if (deferredWaveforms.empty()) return;
+    
+    // Copy-on-write like any other edit; the content revision is unchanged
+    for (auto& clip : timeline.audioTracks) {
+        auto it = deferredWaveforms.find(clip->id);
+        if (it == deferredWaveforms.end()) continue;
+        
+        auto loaded = std::make_shared<AudioClip>(*clip);
+        loaded->waveform = container->readWaveform(it->second);
+        clip = loaded;
+    }
+    
+    deferredWaveforms.clear();
+    container.reset();
+    publishSnapshot();
+}
+
+std::vector<float> ProjectManager::waveformPreview(const AudioClip& clip) const {
+    if (!clip.waveform.empty()) return previewWaveform(clip);
+    
+    std::lock_guard<std::mutex> lock(projectMutex);
+    auto it = deferredWaveforms.find(clip.id);
+    if (it == deferredWaveforms.end()) return {};
+    return container->readPreview(it->second);
+}
+
+// Callers hold projectMutex
+std::vector<float> ProjectManager::readDeferredWaveform(const std::string& clipId) const {
+    auto it = deferredWaveforms.find(clipId);
+    if (it == deferredWaveforms.end()) return {};
+    return container->readWaveform(it->second);
+}
+
+// The published version with its deferred waveforms read into a private copy,
+// for consumers such as export that mix every sample. The live timeline and
+// the mapping stay as they are.
+std::shared_ptr<const TimelineSnapshot> ProjectManager::getCompleteSnapshot() {
+    std::shared_ptr<BinaryContainer> source;
+    std::unordered_map<std::string, DeferredBlob> deferred;
+    auto snapshot = pinTimeline(source, deferred);
+    if (deferred.empty()) return snapshot;
+    
+    auto complete = std::make_shared<TimelineSnapshot>(*snapshot);
+    for (auto& clip : complete->timeline.audioTracks) {
+        auto it = deferred.find(clip->id);
+        if (it == deferred.end() || !clip->waveform.empty()) continue;
+        
+        auto loaded = std::make_shared<AudioClip>(*clip);
+        loaded->waveform = source->readWaveform(it->second);
+        clip = loaded;
+    }
+    return complete;
+}
+
+// The published timeline together with what of it is still deferred, taken
+// under one lock so loadDeferredBlobs() cannot run in between
+std::shared_ptr<const TimelineSnapshot> ProjectManager::pinTimeline(
+    std::shared_ptr<BinaryContainer>& source, std::unordered_map<std::string, DeferredBlob>& deferred) {
+    std::lock_guard<std::mutex> lock(projectMutex);
+    source = container;
+    deferred = deferredWaveforms;
+    if (!std::atomic_load(&publishedTimeline)) {
+        publishSnapshot();
+    }
+    return std::atomic_load(&publishedTimeline);
+}
+
+void ProjectManager::journalChange(const TimelineChange& change, const std::vector<float>* waveform) {
+    // Replacing the timeline is a load/new, not an edit to replay
+    if (change.op["op"].asString() == "timelineReplaced") return;
+    
+    if (change.op["op"].asString() == "batch") {
+        // Full waveforms of the batch's audio adds are concatenated into the
+        // blob; each add records its slice
+        Json::Value op = change.op;
+        std::vector<float> blob;
+        for (auto& subOp : op["ops"]) {
+            if (subOp["op"].asString() != "clipAdded" || subOp["kind"].asString() != "audio") continue;
+            subOp["clip"].removeMember("waveform");
+            
+            ClipLocation location;
+            if (!locateClip(subOp["clip"]["id"].asString(), location) || !location.audio) continue;
+            const auto& samples = timeline.audioTracks[location.index]->waveform;
+            subOp["waveformOffset"] = static_cast<Json::UInt64>(blob.size());
+            subOp["waveformSamples"] = static_cast<Json::UInt64>(samples.size());
+            blob.insert(blob.end(), samples.begin(), samples.end());
+        }
+        journal->append(change.revision, op, blob.empty() ? nullptr : &blob);
+        return;
+    }
+    
+    if (waveform && change.op.isMember("clip")) {
+        // The full waveform travels as raw floats instead of the JSON preview
+        Json::Value op = change.op;
+        op["clip"].removeMember("waveform");
+        journal->append(change.revision, op, waveform);
+    } else {
+        journal->append(change.revision, change.op, nullptr);
+    }
+}
+
+uint64_t ProjectManager::newGeneration() {
+    static std::mt19937_64 random(std::random_device{}() ^
+                                  static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count()));
+    static std::mutex randomMutex;
+    std::lock_guard<std::mutex> lock(randomMutex);
+    uint64_t generation = 0;
+    while (generation == 0) {
+        generation = random();
+    }
+    return generation;
+}
+
+// fsyncs tempPath, renames it over filePath and fsyncs the directory, so
+// after a crash filePath is either the old file or the complete new one
+bool ProjectManager::replaceFileDurably(const std::string& tempPath, const std::string& filePath) {
+    int fd = ::open(tempPath.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    bool synced = fsync(fd) == 0;
+    ::close(fd);
+    if (!synced || std::rename(tempPath.c_str(), filePath.c_str()) != 0) return false;
+    
+    size_t slash = filePath.find_last_of('/');
+    std::string directory = slash == std::string::npos ? "." : (slash == 0 ? "/" : filePath.substr(0, slash));
+    int directoryFd = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY);
+    if (directoryFd < 0) return false;
+    synced = fsync(directoryFd) == 0;
+    ::close(directoryFd);
+    return synced;
+}
+
+// The snapshot at projectPath is of the given generation and revision
+void ProjectManager::attachJournal(const std::string& projectPath, uint64_t generation, uint64_t snapshotRevision) {
+    std::shared_ptr<EditJournal> previous;
+    std::shared_ptr<EditJournal> current;
+    {
+        std::lock_guard<std::mutex> lock(projectMutex);
+        if (journal && journalProjectPath == projectPath) {
+            current = journal;
+        }
+    }
+    if (current) {
+        // Keeps the edits made since the snapshot was taken
+        if (!current->compact(snapshotRevision, generation)) {
+            LOG_WARNING("Could not move edit journal to the new save: " + projectPath);
+        }
+        return;
+    }
+    
+    {
+        std::lock_guard<std::mutex> lock(projectMutex);
+        if (journal && journalProjectPath == projectPath) return;
+        
+        auto attached = std::make_shared<EditJournal>(projectPath + ".journal", generation,
+            [this](EditJournal& source) { compactJournal(source); });
+        if (!attached->isOpen()) return;
+        
+        previous = std::move(journal);
+        journal = attached;
+        journalProjectPath = projectPath;
+    }
+    previous.reset();
+}
+
+// Runs on the journal's compaction thread, off the request path
+void ProjectManager::compactJournal(EditJournal& source) {
+    std::string projectPath;
+    {
+        std::lock_guard<std::mutex> lock(projectMutex);
+        if (journal.get() != &source) return;
+        projectPath = journalProjectPath;
+    }
+    
+    // The file being replaced may still back deferred waveforms; write()
+    // copies them out of the mapping, which stays valid after the rename
+    std::shared_ptr<BinaryContainer> mapped;
+    std::unordered_map<std::string, DeferredBlob> deferred;
+    auto snapshot = pinTimeline(mapped, deferred);
+    
+    // Same generation: the journal keeps extending this snapshot
+    std::string tempPath = projectPath + ".tmp";
+    if (!BinaryContainer::write(tempPath, snapshot->timeline, snapshot->revision, source.getGeneration(),
+                                {mapped.get(), &deferred}) ||
+        !replaceFileDurably(tempPath, projectPath)) {
+        LOG_WARNING("Journal compaction failed for: " + projectPath);
+        std::remove(tempPath.c_str());
+        return;
+    }
+    
+    // Only now that the snapshot is on disk may the records it holds go
+    source.compact(snapshot->revision);
+    LOG_DEBUG("Journal compacted at revision " + std::to_string(snapshot->revision));
+}
+
+uint64_t ProjectManager::replayJournal(const std::string& projectPath, uint64_t generation, uint64_t snapshotRevision) {
+    {
+        std::lock_guard<std::mutex> lock(projectMutex);
+        replayingJournal = true;
+    }
+    
+    uint64_t replayed = 0;
+    uint64_t highestRevision = EditJournal::replay(projectPath + ".journal", generation, snapshotRevision,
+        [this, &replayed](const Json::Value& op, std::vector<float>& waveform) {
+            replayChange(op, waveform);
+            replayed++;
+        });
+    
+    // Continue numbering after the journal so compaction never drops newer records
+    std::lock_guard<std::mutex> lock(projectMutex);
+    replayingJournal = false;
+    revision = std::max(revision, highestRevision);
+    return replayed;
+}
+
+void ProjectManager::replayChange(const Json::Value& op, std::vector<float>& waveform) {
+    std::string kind = op["op"].asString();
+    if (kind == "clipAdded") {
+        restoreClip(op, waveform);
+    } else if (kind == "clipRemoved") {
+        removeClip(op["clipId"].asString());
+    } else if (kind == "clipUpdated") {
+        updateClip(op["clipId"].asString(), op["fields"]);
+    } else if (kind == "batch") {
+        for (const auto& subOp : op["ops"]) {
+            size_t offset = subOp.get("waveformOffset", 0).asUInt64();
+            size_t samples = subOp.get("waveformSamples", 0).asUInt64();
+            std::vector<float> slice;
+            if (offset + samples <= waveform.size()) {
+                slice.assign(waveform.begin() + offset, waveform.begin() + offset + samples);
+            }
+            replayChange(subOp, slice);
+        }
+    }
+}
+
+void ProjectManager::restoreClip(const Json::Value& op, std::vector<float>& waveform) {
+    const Json::Value& clipData = op["clip"];
+    std::lock_guard<std::mutex> lock(projectMutex);
+    
+    if (op["kind"].asString() == "audio") {
+        auto clip = std::make_shared<AudioClip>();
+        clip->id = clipData["id"].asString();
+        clip->filePath = clipData["filePath"].asString();
+        clip->startTime = clipData["startTime"].asDouble();
+        clip->duration = clipData["duration"].asDouble();
+        clip->volume = clipData["volume"].asFloat();
+        clip->trackIndex = clipData["trackIndex"].asInt();
+        clip->enabled = clipData["enabled"].asBool();
+        clip->muted = clipData["muted"].asBool();
+        clip->waveform = std::move(waveform);
+        
+        timeline.audioTracks.push_back(clip);
+        timeline.duration = std::max(timeline.duration, clip->startTime + clip->duration);
+    } else {
+        auto clip = std::make_shared<VideoClip>();
+        clip->id = clipData["id"].asString();
+        clip->filePath = clipData["filePath"].asString();
+        clip->startTime = clipData["startTime"].asDouble();
+        clip->duration = clipData["duration"].asDouble();
+        clip->inPoint = clipData["inPoint"].asDouble();
+        clip->outPoint = clipData["outPoint"].asDouble();
+        clip->trackIndex = clipData["trackIndex"].asInt();
+        clip->enabled = clipData["enabled"].asBool();
+        clip->opacity = clipData["opacity"].asFloat();
+        
+        timeline.videoTracks.push_back(clip);
+        timeline.duration = std::max(timeline.duration, clip->startTime + clip->duration);
+    }
+    
+    isDirty = true;
+    recordChange(op);
+}
+
+// Lock-free export progress snapshot (single writer, any number of readers;
+// RenderEngine runs one export at a time to keep it that way).
+// The render loop publishes plain numbers through a sequence counter, so it
+// never locks or allocates; readers retry if they raced with a write.
+class ProgressSeqlock {
+public:
+    enum class Phase { Idle, Initializing, Rendering, Finalizing, Complete, Cancelled, Failed };
+
+    struct Snapshot {
+        Phase phase;
+        int currentFrame;
+        int totalFrames;
+        double estimatedTimeRemaining;
+        uint32_t sequence;
+    };
+
+    ProgressSeqlock() : sequence(0), phase(static_cast<int>(Phase::Idle)), currentFrame(0),
+                        totalFrames(0), estimatedTimeRemaining(0.0) {}
+
+    void publish(Phase newPhase, int frame, int total, double remaining) {
+        uint32_t seq = sequence.load(std::memory_order_relaxed);
+        sequence.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        phase.store(static_cast<int>(newPhase), std::memory_order_relaxed);
+        currentFrame.store(frame, std::memory_order_relaxed);
+        totalFrames.store(total, std::memory_order_relaxed);
+        estimatedTimeRemaining.store(remaining, std::memory_order_relaxed);
+
+        sequence.store(seq + 2, std::memory_order_release);
+    }
+
+    Snapshot read() const {
+        Snapshot snapshot;
+        uint32_t before, after;
+        do {
+            before = sequence.load(std::memory_order_acquire);
+            snapshot.phase = static_cast<Phase>(phase.load(std::memory_order_relaxed));
+            snapshot.currentFrame = currentFrame.load(std::memory_order_relaxed);
+            snapshot.totalFrames = totalFrames.load(std::memory_order_relaxed);
+            snapshot.estimatedTimeRemaining = estimatedTimeRemaining.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            after = sequence.load(std::memory_order_relaxed);
+        } while ((before & 1) || before != after);
+
+        snapshot.sequence = after;
+        return snapshot;
+    }
+
+    // Cheap change detection for pollers; even values are stable snapshots
+    uint32_t getSequence() const {
+        return sequence.load(std::memory_order_acquire);
+    }
+
+private:
+    std::atomic<uint32_t> sequence;
+    std::atomic<int> phase;
+    std::atomic<int> currentFrame;
+    std::atomic<int> totalFrames;
+    std::atomic<double> estimatedTimeRemaining;
+};
+
+// Container metadata read in process through libavformat: duration,
+// streams, codec parameters and the video keyframe count. Results are kept
+// in memory and in a JSON cache file keyed by path, and an entry only counts
+// while the file's size and modification time still match, so every file is
+// opened once however often its duration is asked for, across restarts too.
+class MediaProbe {
+public:
+    struct StreamInfo {
+        int index;
+        std::string type;           // "video", "audio", "subtitle", ...
+        std::string codec;
+        double duration;            // Seconds, 0 when the container does not say
+        int64_t bitRate;
+        int width;
+        int height;
+        double frameRate;
+        std::string pixelFormat;
+        int sampleRate;
+        int channels;
+        
+        StreamInfo() : index(0), duration(0.0), bitRate(0), width(0), height(0), frameRate(0.0),
+                       sampleRate(0), channels(0) {}
+    };
+    
+    struct MediaInfo {
+        bool valid;
+        std::string error;
+        std::string format;
+        double duration;
+        int64_t bitRate;
+        int64_t keyframeCount;      // Of the first video stream; -1 without one or until keyframeCount() counts it
+        std::vector<StreamInfo> streams;
+        
+        MediaInfo() : valid(false), duration(0.0), bitRate(0), keyframeCount(-1) {}
+        
+        Json::Value toJson() const {
+            Json::Value json;
+            json["format"] = format;
+            json["duration"] = duration;
+            json["bitRate"] = static_cast<Json::Int64>(bitRate);
+            json["keyframeCount"] = static_cast<Json::Int64>(keyframeCount);
+            json["streams"] = Json::Value(Json::arrayValue);
+            for (const auto& stream : streams) {
+                Json::Value entry;
+                entry["index"] = stream.index;
+                entry["type"] = stream.type;
+                entry["codec"] = stream.codec;
+                entry["duration"] = stream.duration;
+                entry["bitRate"] = static_cast<Json::Int64>(stream.bitRate);
+                if (stream.type == "video") {
+                    entry["width"] = stream.width;
+                    entry["height"] = stream.height;
+                    entry["frameRate"] = stream.frameRate;
+                    entry["pixelFormat"] = stream.pixelFormat;
+                } else if (stream.type == "audio") {
+                    entry["sampleRate"] = stream.sampleRate;
+                    entry["channels"] = stream.channels;
+                }
+                json["streams"].append(entry);
+            }
+            return json;
+        }
+        
+        static MediaInfo fromJson(const Json::Value& json) {
+            MediaInfo info;
+            info.valid = true;
+            info.format = json.get("format", "").asString();
+            info.duration = json.get("duration", 0.0).asDouble();
+            info.bitRate = json.get("bitRate", 0).asInt64();
+            info.keyframeCount = json.get("keyframeCount", -1).asInt64();
+            for (const auto& entry : json["streams"]) {
+                StreamInfo stream;
+                stream.index = entry.get("index", 0).asInt();
+                stream.type = entry.get("type", "").asString();
+                stream.codec = entry.get("codec", "").asString();
+                stream.duration = entry.get("duration", 0.0).asDouble();
+                stream.bitRate = entry.get("bitRate", 0).asInt64();
+                stream.width = entry.get("width", 0).asInt();
+                stream.height = entry.get("height", 0).asInt();
+                stream.frameRate = entry.get("frameRate", 0.0).asDouble();
+                stream.pixelFormat = entry.get("pixelFormat", "").asString();
+                stream.sampleRate = entry.get("sampleRate", 0).asInt();
+                stream.channels = entry.get("channels", 0).asInt();
+                info.streams.push_back(stream);
+            }
+            return info;
+        }
+    };
+    
+    static constexpr size_t maxCacheEntries = 4096;
+    static constexpr int64_t saveIntervalMs = 5000;   // At most one cache rewrite per interval; the rest waits for flush()
+    
+    // Caches under $XDG_CACHE_HOME/tvid (or ~/.cache/tvid); memory only when
+    // neither is set
+    MediaProbe() : cacheLoaded(false), dirty(false), probes(0), hits(0) {
+        const char* cacheHome = std::getenv("XDG_CACHE_HOME");
+        const char* home = std::getenv("HOME");
+        std::string directory;
+        if (cacheHome && *cacheHome) {
+            directory = cacheHome;
+        } else if (home && *home) {
+            directory = std::string(home) + "/.cache";
+        }
+        if (!directory.empty()) {
+            ::mkdir(directory.c_str(), 0755);
+            directory += "/tvid";
+            ::mkdir(directory.c_str(), 0755);
+            cachePath = directory + "/media-probe.json";
+        }
+    }
+    
+    explicit MediaProbe(const std::string& cachePath)
+        : cachePath(cachePath), cacheLoaded(false), dirty(false), probes(0), hits(0) {}
+    
+    ~MediaProbe() {
+        flush();
+    }
+    
+    MediaProbe(const MediaProbe&) = delete;
+    MediaProbe& operator=(const MediaProbe&) = delete;
+    
+    static MediaProbe& shared() {
+        static MediaProbe probe;
+        return probe;
+    }
+    
+    // Metadata for path, from the cache while the file is unchanged. Only
+    // reads the container header; keyframeCount stays -1 until
+    // keyframeCount() has counted it. Failures are not cached; check valid
+    // and error.
+    MediaInfo probe(const std::string& path) {
+        struct stat st;
+        if (::stat(path.c_str(), &st) < 0) {
+            MediaInfo info;
+            info.error = "Cannot access " + path + ": " + std::string(strerror(errno));
+            return info;
+        }
+        int64_t size = static_cast<int64_t>(st.st_size);
+        int64_t modified = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000LL + st.st_mtim.tv_nsec;
+        
+        {
+            std::lock_guard<std::mutex> lock(cacheMutex);
+            loadCache();
+            auto it = entries.find(path);
+            if (it != entries.end() && it->second.size == size && it->second.modified == modified) {
+                hits++;
+                return it->second.info;
+            }
+        }
+        
+        MediaInfo info = read(path);
+        if (!info.valid) {
+            LOG_WARNING("Media probe failed: " + info.error);
+            return info;
+        }
+        
+        {
+            std::lock_guard<std::mutex> lock(cacheMutex);
+            probes++;
+            if (entries.find(path) == entries.end()) {
+                order.push_back(path);
+            }
+            entries[path] = Entry{size, modified, info};
+            while (entries.size() > maxCacheEntries && !order.empty()) {
+                entries.erase(order.front());
+                order.pop_front();
+            }
+            dirty = true;
+        }
+        saveCache(false);
+        return info;
+    }
+    
+    // Keyframes in the first video stream, or -1 without one. Demuxes the
+    // whole file the first time, so only callers that need the count pay
+    // for it; the result is kept in the cache entry.
+    int64_t keyframeCount(const std::string& path) {
+        MediaInfo info = probe(path);
+        if (!info.valid) return -1;
+        if (info.keyframeCount >= 0) return info.keyframeCount;
+        bool hasVideo = false;
+        for (const auto& stream : info.streams) {
+            hasVideo = hasVideo || stream.type == "video";
+        }
+        if (!hasVideo) return -1;
+        
+        struct stat st;
+        if (::stat(path.c_str(), &st) < 0) return -1;
+        int64_t keyframes = countKeyframes(path);
+        if (keyframes < 0) return -1;
+        
+        {
+            std::lock_guard<std::mutex> lock(cacheMutex);
+            auto it = entries.find(path);
+            int64_t modified = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000LL + st.st_mtim.tv_nsec;
+            // Only when the entry still describes the file that was counted
+            if (it != entries.end() && it->second.size == static_cast<int64_t>(st.st_size) &&
+                it->second.modified == modified) {
+                it->second.info.keyframeCount = keyframes;
+                dirty = true;
+            }
+        }
+        saveCache(false);
+        return keyframes;
+    }
+    
+    // Writes pending cache changes now instead of waiting for the interval
+    void flush() {
+        saveCache(true);
+    }
+    
+    // Duration in seconds, or fallback when the file cannot be probed
+    double duration(const std::string& path, double fallback = 0.0) {
+        MediaInfo info = probe(path);
+        return info.valid ? info.duration : fallback;
+    }
+    
+    Json::Value getStats() {
+        std::lock_guard<std::mutex> lock(cacheMutex);
+        Json::Value stats;
+        stats["entries"] = static_cast<Json::UInt64>(entries.size());
+        stats["probes"] = static_cast<Json::UInt64>(probes);
+        stats["hits"] = static_cast<Json::UInt64>(hits);
+        return stats;
+    }
+    
+private:
+    struct Entry {
+        int64_t size;
+        int64_t modified;           // st_mtim in nanoseconds
+        MediaInfo info;
+    };
+    
+    std::string cachePath;
+    std::mutex cacheMutex;
+    std::unordered_map<std::string, Entry> entries;
+    std::deque<std::string> order;  // Insertion order, for eviction
+    bool cacheLoaded;
+    bool dirty;                     // Entries changed since the last save
+    std::chrono::steady_clock::time_point lastSave;
+    std::mutex saveMutex;           // One writer of the cache file at a time
+    uint64_t probes;
+    uint64_t hits;
+    
+    static std::string errorString(int error) {
+        char buffer[AV_ERROR_MAX_STRING_SIZE] = {0};
+        av_strerror(error, buffer, sizeof(buffer));
+        return buffer;
+    }
+    
+    static MediaInfo read(const std::string& path) {
+        MediaInfo info;
+        AVFormatContext* format = nullptr;
+        int ret = avformat_open_input(&format, path.c_str(), nullptr, nullptr);
+        if (ret < 0) {
+            info.error = "Could not open " + path + ": " + errorString(ret);
+            return info;
+        }
+        ret = avformat_find_stream_info(format, nullptr);
+        if (ret < 0) {
+            info.error = "Could not read stream info of " + path + ": " + errorString(ret);
+            avformat_close_input(&format);
+            return info;
+        }
+        
+        info.format = format->iformat->name;
+        info.bitRate = format->bit_rate;
+        if (format->duration != AV_NOPTS_VALUE) {
+            info.duration = format->duration / static_cast<double>(AV_TIME_BASE);
+        }
+        
+        for (unsigned int i = 0; i < format->nb_streams; i++) {
+            const AVStream* stream = format->streams[i];
+            const AVCodecParameters* codecpar = stream->codecpar;
+            
+            StreamInfo entry;
+            entry.index = static_cast<int>(i);
+            const char* type = av_get_media_type_string(codecpar->codec_type);
+            entry.type = type ? type : "unknown";
+            entry.codec = avcodec_get_name(codecpar->codec_id);
+            entry.bitRate = codecpar->bit_rate;
+            if (stream->duration != AV_NOPTS_VALUE) {
+                entry.duration = stream->duration * av_q2d(stream->time_base);
+            }
+            
+            if (codecpar->codec_type == AVMEDIA_TYPE_VIDEO) {
+                entry.width = codecpar->width;
+                entry.height = codecpar->height;
+                entry.frameRate = av_q2d(stream->avg_frame_rate);
+                const char* pixelFormat = av_get_pix_fmt_name(static_cast<AVPixelFormat>(codecpar->format));
+                entry.pixelFormat = pixelFormat ? pixelFormat : "";
+            } else if (codecpar->codec_type == AVMEDIA_TYPE_AUDIO) {
+                entry.sampleRate = codecpar->sample_rate;
+                entry.channels = codecpar->channels;
+            }
+            
+            info.duration = std::max(info.duration, entry.duration);
+            info.streams.push_back(entry);
+        }
+        
+        avformat_close_input(&format);
+        info.valid = true;
+        return info;
+    }
+    
+    // Demuxes the video stream's packets without decoding them
+    static int64_t countKeyframes(const std::string& path) {
+        AVFormatContext* format = nullptr;
+        int ret = avformat_open_input(&format, path.c_str(), nullptr, nullptr);
+        if (ret < 0) {
+            LOG_WARNING("Could not open " + path + " to count keyframes: " + errorString(ret));
+            return -1;
+        }
+        
+        // Cover art is a video stream too, but has no keyframes worth counting
+        int videoIndex = -1;
+        for (unsigned int i = 0; i < format->nb_streams; i++) {
+            const AVStream* stream = format->streams[i];
+            if (videoIndex < 0 && stream->codecpar->codec_type == AVMEDIA_TYPE_VIDEO &&
+                !(stream->disposition & AV_DISPOSITION_ATTACHED_PIC)) {
+                videoIndex = static_cast<int>(i);
+            }
+        }
+        for (unsigned int i = 0; i < format->nb_streams; i++) {
+            format->streams[i]->discard = static_cast<int>(i) == videoIndex ? AVDISCARD_DEFAULT : AVDISCARD_ALL;
+        }
+        
+        AVPacket* packet = videoIndex >= 0 ? av_packet_alloc() : nullptr;
+        if (!packet) {
+            avformat_close_input(&format);
+            return -1;
+        }
+        int64_t keyframes = 0;
+        while (av_read_frame(format, packet) >= 0) {
+            if (packet->stream_index == videoIndex && (packet->flags & AV_PKT_FLAG_KEY)) {
+                keyframes++;
+            }
+            av_packet_unref(packet);
+        }
+        av_packet_free(&packet);
+        avformat_close_input(&format);
+        return keyframes;
+    }
+    
+    // Callers hold cacheMutex
+    void loadCache() {
+        if (cacheLoaded) return;
+        cacheLoaded = true;
+        if (cachePath.empty()) return;
+        
+        std::ifstream file(cachePath);
+        if (!file) return;
+        Json::CharReaderBuilder builder;
+        Json::Value root;
+        std::string errors;
+        if (!Json::parseFromStream(builder, file, &root, &errors)) {
+            LOG_WARNING("Ignoring unreadable media probe cache: " + errors);
+            return;
+        }
+        
+        for (const auto& entry : root["entries"]) {
+            std::string path = entry.get("path", "").asString();
+            if (path.empty() || entries.count(path)) continue;
+            entries[path] = Entry{entry.get("size", -1).asInt64(), entry.get("modified", -1).asInt64(),
+                                  MediaInfo::fromJson(entry["info"])};
+            order.push_back(path);
+        }
+    }
+    
+    // Rewrites the cache when it changed and, unless forced, saveIntervalMs
+    // has passed since the last rewrite. Only the copy of the entries is
+    // taken under cacheMutex. Written next to the cache and renamed, so a
+    // crash never leaves a truncated cache behind.
+    void saveCache(bool force) {
+        if (cachePath.empty()) return;
+        
+        std::vector<std::pair<std::string, Entry>> snapshot;
+        {
+            std::lock_guard<std::mutex> lock(cacheMutex);
+            auto now = std::chrono::steady_clock::now();
+            if (!dirty) return;
+            if (!force && lastSave.time_since_epoch().count() != 0 &&
+                now - lastSave < std::chrono::milliseconds(saveIntervalMs)) {
+                return;
+            }
+            dirty = false;
+            lastSave = now;
+            snapshot.reserve(order.size());
+            for (const auto& path : order) {
+                snapshot.emplace_back(path, entries[path]);
+            }
+        }
+        
+        std::lock_guard<std::mutex> saveLock(saveMutex);
+        Json::Value root;
+        root["version"] = 1;
+        root["entries"] = Json::Value(Json::arrayValue);
+        for (const auto& item : snapshot) {
+            const Entry& cached = item.second;
+            Json::Value entry;
+            entry["path"] = item.first;
+            entry["size"] = static_cast<Json::Int64>(cached.size);
+            entry["modified"] = static_cast<Json::Int64>(cached.modified);
+            entry["info"] = cached.info.toJson();
+            root["entries"].append(entry);
+        }
+        
+        Json::StreamWriterBuilder builder;
+        builder["indentation"] = "";
+        std::string tempPath = cachePath + ".tmp";
+        {
+            std::ofstream file(tempPath, std::ios::trunc);
+            file << Json::writeString(builder, root);
+            if (!file) {
+                LOG_WARNING("Failed to write media probe cache: " + tempPath);
+                std::remove(tempPath.c_str());
+                markDirty();
+                return;
+            }
+        }
+        if (std::rename(tempPath.c_str(), cachePath.c_str()) != 0) {
+            LOG_WARNING("Failed to replace media probe cache: " + cachePath);
+            std::remove(tempPath.c_str());
+            markDirty();
+        }
+    }
+    
+    // A failed save leaves the changes pending for the next one
+    void markDirty() {
+        std::lock_guard<std::mutex> lock(cacheMutex);
+        dirty = true;
+    }
+};
+
+// Encodes BGR frames, plus an optional stereo float audio track, to a file
+// through libavcodec/libavformat. writeFrame() converts straight from the
+// caller's Mat into the encoder's pixel format and queues the result for a
+// dedicated encode/mux thread, so the caller can reuse its buffer as soon as
+// the call returns. Meant for one producer thread. Errors are sticky: later
+// writes are ignored and close() reports the failure.
+//
+// Instead of written samples, the audio track can come from an existing
+// file (Settings::audioSourcePath), muxed in the same pass by a side thread:
+// its packets are copied as they are when the container accepts the codec,
+// and decoded and re-encoded otherwise.
+class FrameSink {
+public:
+    struct Settings {
+        std::string outputPath;
+        std::string videoCodec;
+        std::string audioCodec;
+        int width;
+        int height;
+        double frameRate;
+        int videoBitrate;
+        int audioBitrate;
+        int audioSampleRate;
+        std::string preset;
+        int crf;
+        std::string pixelFormat;
+        bool hardwareAcceleration;
+        bool enableAudio;
+        int encoderThreads;     // 0 = let the codec use every core
+        int maxQueuedFrames;    // converted frames waiting for the encode thread
+        bool deduplicateFrames; // hash frames and hold repeats instead of encoding them
+        std::string audioSourcePath; // file whose audio track is muxed in; replaces writeAudio()
+        
+        Settings() : videoCodec("libx264"), audioCodec("aac"), width(1920), height(1080),
+                     frameRate(30.0), videoBitrate(10000000), audioBitrate(192000),
+                     audioSampleRate(44100), preset("medium"), crf(23), pixelFormat("yuv420p"),
+                     hardwareAcceleration(false), enableAudio(false), encoderThreads(0),
+                     maxQueuedFrames(8), deduplicateFrames(true) {}
+        
+        Settings(const std::string& path, cv::Size size, double rate) : Settings() {
+            outputPath = path;
+            width = size.width;
+            height = size.height;
+            frameRate = rate;
+        }
+        
+        // Encoder choices a request may override
+        void applyParams(const Json::Value& params) {
+            videoCodec = params.get("videoCodec", videoCodec).asString();
+            preset = params.get("preset", preset).asString();
+            crf = params.get("crf", crf).asInt();
+            videoBitrate = params.get("videoBitrate", videoBitrate).asInt();
+            encoderThreads = params.get("encoderThreads", encoderThreads).asInt();
+        }
+    };
+    
+    explicit FrameSink(const Settings& settings)
+        : settings(settings), formatCtx(nullptr), videoCtx(nullptr), audioCtx(nullptr),
+          videoStream(nullptr), audioStream(nullptr), swsCtx(nullptr), opened(false),
+          finishing(false), failed(false), framesWritten(0), audioSamplesWritten(0),
+          lastFrame(nullptr), lastFrameHash(0), holdingRepeats(false), audioSourceCtx(nullptr),
+          audioDecoderCtx(nullptr), resampleCtx(nullptr), audioFifo(nullptr), audioSourceIndex(-1),
+          audioSourceStart(0), videoMuxedTime(0.0), videoEnded(false), videoEndTime(0.0) {}
+    
+    ~FrameSink() {
+        if (opened) close();
+        cleanup();
+    }
+    
+    FrameSink(const FrameSink&) = delete;
+    FrameSink& operator=(const FrameSink&) = delete;
+    
+    bool open() {
+        int ret = avformat_alloc_output_context2(&formatCtx, nullptr, nullptr, settings.outputPath.c_str());
+        if (ret < 0 || !formatCtx) {
+            return fail("Could not create output context for: " + settings.outputPath);
+        }
+        
+        videoStream = avformat_new_stream(formatCtx, nullptr);
+        if (!videoStream) return fail("Could not create video stream");
+        videoCtx = setupVideoEncoder(videoStream);
+        if (!videoCtx) return fail("Could not setup video encoder");
+        
+        if (!settings.audioSourcePath.empty()) {
+            if (!openAudioSource()) return false;
+        } else if (settings.enableAudio) {
+            audioStream = avformat_new_stream(formatCtx, nullptr);
+            if (!audioStream) return fail("Could not create audio stream");
+            audioCtx = setupAudioEncoder(audioStream);
+            if (!audioCtx) return fail("Could not setup audio encoder");
+        }
+        
+        if (!(formatCtx->oformat->flags & AVFMT_NOFILE)) {
+            ret = avio_open(&formatCtx->pb, settings.outputPath.c_str(), AVIO_FLAG_WRITE);
+            if (ret < 0) return fail("Could not open output file: " + settings.outputPath);
+        }
+        
+        ret = avformat_write_header(formatCtx, nullptr);
+        if (ret < 0) return fail("Error writing header");
+        
+        opened = true;
+        encodeThread = std::thread([this]() { encodeLoop(); });
+        if (audioSourceCtx) {
+            audioThread = std::thread([this]() { muxAudioSource(); });
+        }
+        return true;
+    }
+    
+    bool writeFrame(const cv::Mat& frame) {
+        if (!opened || failed) return false;
+        
+        uint64_t hash = 0;
+        if (settings.deduplicateFrames && !frame.empty()) {
+            hash = hashFrame(frame);
+            if (lastFrame && hash == lastFrameHash) {
+                return repeatFrame(1);
+            }
+        }
+        if (!finishRepeats()) return false;
+        
+        AVPixelFormat sourceFormat;
+        switch (frame.type()) {
+            case CV_8UC1: sourceFormat = AV_PIX_FMT_GRAY8; break;
+            case CV_8UC3: sourceFormat = AV_PIX_FMT_BGR24; break;
+            case CV_8UC4: sourceFormat = AV_PIX_FMT_BGRA; break;
+            default:
+                return setFailure("Unsupported frame type for encoding: " + std::to_string(frame.type()));
+        }
+        
+        AVFrame* avFrame = av_frame_alloc();
+        if (!avFrame) return setFailure("Could not allocate video frame");
+        avFrame->format = videoCtx->pix_fmt;
+        avFrame->width = videoCtx->width;
+        avFrame->height = videoCtx->height;
+        avFrame->pts = framesWritten++;
+        if (av_frame_get_buffer(avFrame, 0) < 0) {
+            av_frame_free(&avFrame);
+            return setFailure("Could not allocate video frame buffer");
+        }
+        
+        // Scales too if the generator's frame size differs from the stream
+        swsCtx = sws_getCachedContext(swsCtx, frame.cols, frame.rows, sourceFormat,
+                                      videoCtx->width, videoCtx->height, videoCtx->pix_fmt,
+                                      SWS_BILINEAR, nullptr, nullptr, nullptr);
+        if (!swsCtx) {
+            av_frame_free(&avFrame);
+            return setFailure("Could not create pixel format converter");
+        }
+        
+        const uint8_t* srcData[4] = {frame.data, nullptr, nullptr, nullptr};
+        int srcLinesize[4] = {static_cast<int>(frame.step[0]), 0, 0, 0};
+        sws_scale(swsCtx, srcData, srcLinesize, 0, frame.rows, avFrame->data, avFrame->linesize);
+        
+        // Kept (by reference) in case the next frames repeat it
+        av_frame_free(&lastFrame);
+        lastFrame = av_frame_clone(avFrame);
+        lastFrameHash = hash;
+        
+        return enqueue(avFrame, false);
+    }
+    
+    // Keeps the last written frame on screen for count more frame periods
+    // without converting or encoding it again. Generators that know a frame
+    // is static (title cards, still scenes) call this directly; with
+    // deduplicateFrames, writeFrame() does it when a frame hashes the same as
+    // the one before. The run is closed by one re-encode of the held frame
+    // at its last timestamp, so every container gets the right duration:
+    // timestamp-based ones (MP4, MKV) store the gap as one long frame, AVI
+    // fills it with empty repeat chunks.
+    bool repeatFrame(int count) {
+        if (!opened || failed) return false;
+        if (count <= 0) return true;
+        if (!lastFrame) return setFailure("No frame to repeat");
+        
+        framesWritten += count;
+        holdingRepeats = true;
+        return true;
+    }
+    
+    // Interleaved stereo samples; re-chunked to the audio encoder's frame size
+    bool writeAudio(const std::vector<float>& samples) {
+        if (!opened || failed) return false;
+        if (audioSourceCtx) return setFailure("Audio track is muxed from " + settings.audioSourcePath);
+        if (!audioCtx) return setFailure("Audio track not enabled");
+        
+        pendingAudio.insert(pendingAudio.end(), samples.begin(), samples.end());
+        
+        size_t frameSamples = audioFrameSamples();
+        while (pendingAudio.size() >= frameSamples * 2) {
+            if (!queueAudioFrame(frameSamples)) return false;
+        }
+        return true;
+    }
+    
+    // Drains the queue, flushes the encoders and writes the trailer
+    bool close() {
+        if (!opened) return !failed;
+        
+        finishRepeats();
+        
+        if (audioCtx && !audioSourceCtx && !failed && !pendingAudio.empty()) {
+            bool smallLastFrame = audioCtx->codec->capabilities & AV_CODEC_CAP_SMALL_LAST_FRAME;
+            size_t remaining = pendingAudio.size() / 2;
+            if (!smallLastFrame) {
+                pendingAudio.resize(audioFrameSamples() * 2, 0.0f);
+                remaining = audioFrameSamples();
+            }
+            queueAudioFrame(remaining);
+        }
+        
+        stopEncodeThread(false);
+        
+        if (!failed) {
+            flushEncoder(videoCtx, videoStream);
+        }
+        // Source audio runs on to the end of the video, then drains
+        finishAudioSource(framesWritten / settings.frameRate);
+        
+        if (!failed) {
+            if (audioCtx && !audioSourceCtx) flushEncoder(audioCtx, audioStream);
+            if (av_write_trailer(formatCtx) < 0) {
+                setFailure("Error writing trailer");
+            }
+        }
+        
+        cleanup();
+        return !failed;
+    }
+    
+    // Stops without flushing or finalising the file (e.g. cancelled export)
+    void abort() {
+        if (opened) {
+            stopEncodeThread(true);
+        }
+        cleanup();
+    }
+    
+    std::string getError() const {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        return errorMessage;
+    }
+    
+    const Settings& getSettings() const { return settings; }
+    
+private:
+    struct QueuedFrame {
+        AVFrame* frame;
+        bool audio;
+    };
+    
+    Settings settings;
+    AVFormatContext* formatCtx;
+    AVCodecContext* videoCtx;
+    AVCodecContext* audioCtx;
+    AVStream* videoStream;
+    AVStream* audioStream;
+    SwsContext* swsCtx;
+    bool opened;
+    
+    mutable std::mutex queueMutex;
+    std::condition_variable queueNotEmpty;
+    std::condition_variable queueNotFull;
+    std::deque<QueuedFrame> queue;
+    bool finishing;
+    std::atomic<bool> failed;
+    std::string errorMessage;
+    std::thread encodeThread;
+    
+    int64_t framesWritten;
+    int64_t audioSamplesWritten;
+    std::vector<float> pendingAudio;
+    
+    AVFrame* lastFrame;         // Converted copy of the last distinct frame
+    uint64_t lastFrameHash;
+    bool holdingRepeats;        // Repeats of lastFrame not yet closed off
+    
+    // Settings::audioSourcePath. The audio thread owns these (and audioCtx,
+    // when re-encoding) until finishAudioSource() joins it.
+    static constexpr double audioLeadSeconds = 1.0; // How far source audio may run ahead of the video
+    AVFormatContext* audioSourceCtx;
+    AVCodecContext* audioDecoderCtx;    // Only when the source codec is re-encoded
+    SwrContext* resampleCtx;
+    AVAudioFifo* audioFifo;
+    int audioSourceIndex;
+    int64_t audioSourceStart;
+    std::thread audioThread;
+    std::mutex muxMutex;                // The muxer is shared by the encode and audio threads
+    std::condition_variable muxProgress;
+    double videoMuxedTime;              // Latest video timestamp handed to the muxer
+    bool videoEnded;
+    double videoEndTime;
+    
+    bool fail(const std::string& error) {
+        setFailure(error);
+        cleanup();
+        return false;
+    }
+    
+    bool setFailure(const std::string& error) {
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            if (!failed) {
+                errorMessage = error;
+                LOG_ERROR("FrameSink: " + error);
+            }
+            failed = true;
+        }
+        queueNotFull.notify_all();
+        {
+            // Taken so an audio thread checking its wait condition cannot miss it
+            std::lock_guard<std::mutex> lock(muxMutex);
+        }
+        muxProgress.notify_all();
+        return false;
+    }
+    
+    bool enqueue(AVFrame* frame, bool audio) {
+        std::unique_lock<std::mutex> lock(queueMutex);
+        queueNotFull.wait(lock, [this]() {
+            return queue.size() < static_cast<size_t>(std::max(1, settings.maxQueuedFrames)) || failed;
+        });
+        if (failed) {
+            av_frame_free(&frame);
+            return false;
+        }
+        queue.push_back({frame, audio});
+        lock.unlock();
+        queueNotEmpty.notify_one();
+        return true;
+    }
+    
+    // The only thread that touches the encoders and the muxer while open
+    void encodeLoop() {
+        std::unique_lock<std::mutex> lock(queueMutex);
+        while (true) {
+            queueNotEmpty.wait(lock, [this]() { return !queue.empty() || finishing; });
+            if (queue.empty()) break;
+            
+            QueuedFrame item = queue.front();
+            queue.pop_front();
+            lock.unlock();
+            queueNotFull.notify_one();
+            
+            if (!failed) {
+                AVCodecContext* codecCtx = item.audio ? audioCtx : videoCtx;
+                AVStream* stream = item.audio ? audioStream : videoStream;
+                if (!encode(codecCtx, stream, item.frame)) {
+                    setFailure(std::string("Error encoding ") + (item.audio ? "audio" : "video") + " frame");
+                }
+            }
+            av_frame_free(&item.frame);
+            lock.lock();
+        }
+    }
+    
+    void stopEncodeThread(bool discardQueued) {
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            finishing = true;
+            if (discardQueued) {
+                for (auto& item : queue) av_frame_free(&item.frame);
+                queue.clear();
+            }
+        }
+        queueNotEmpty.notify_all();
+        if (encodeThread.joinable()) encodeThread.join();
+        opened = false;
+    }
+    
+    // Re-encodes the held frame at the last repeated timestamp
+    bool finishRepeats() {
+        if (!holdingRepeats) return true;
+        holdingRepeats = false;
+        
+        AVFrame* closing = av_frame_clone(lastFrame);
+        if (!closing) return setFailure("Could not allocate video frame");
+        closing->pts = framesWritten - 1;
+        return enqueue(closing, false);
+    }
+    
+    // 64-bit content hash over the pixel rows, four independent lanes so it
+    // runs close to memory speed. Only compared against the previous frame.
+    static uint64_t hashFrame(const cv::Mat& frame) {
+        const uint64_t prime = 0x9E3779B97F4A7C15ULL;
+        uint64_t lanes[4] = {prime, prime * 3, prime * 5, prime * 7};
+        const size_t rowBytes = frame.cols * frame.elemSize();
+        
+        for (int y = 0; y < frame.rows; y++) {
+            const uint8_t* row = frame.ptr<uint8_t>(y);
+            size_t i = 0;
+            for (; i + 32 <= rowBytes; i += 32) {
+                for (int lane = 0; lane < 4; lane++) {
+                    uint64_t word;
+                    memcpy(&word, row + i + lane * 8, sizeof(word));
+                    lanes[lane] = (lanes[lane] ^ word) * prime;
+                    lanes[lane] ^= lanes[lane] >> 29;
+                }
+            }
+            for (; i < rowBytes; i++) {
+                lanes[0] = (lanes[0] ^ row[i]) * prime;
+            }
+        }
+        
+        uint64_t hash = (static_cast<uint64_t>(frame.rows) << 32) ^ static_cast<uint64_t>(frame.cols) ^
+                        (static_cast<uint64_t>(frame.type()) << 48);
+        for (uint64_t lane : lanes) {
+            hash = (hash ^ lane) * prime;
+            hash ^= hash >> 32;
+        }
+        return hash;
+    }
+    
+    size_t audioFrameSamples() const {
+        // Codecs without a fixed frame size take any chunk; use 1024 then
+        return audioCtx->frame_size > 0 ? static_cast<size_t>(audioCtx->frame_size) : 1024;
+    }
+    
+    bool queueAudioFrame(size_t sampleCount) {
+        AVFrame* avFrame = av_frame_alloc();
+        if (!avFrame) return setFailure("Could not allocate audio frame");
+        avFrame->format = audioCtx->sample_fmt;
+        avFrame->channels = audioCtx->channels;
+        avFrame->channel_layout = audioCtx->channel_layout;
+        avFrame->sample_rate = audioCtx->sample_rate;
+        avFrame->nb_samples = static_cast<int>(sampleCount);
+        avFrame->pts = audioSamplesWritten;
+        audioSamplesWritten += sampleCount;
+        
+        if (av_frame_get_buffer(avFrame, 0) < 0) {
+            av_frame_free(&avFrame);
+            return setFailure("Could not allocate audio frame buffer");
+        }
+        
+        if (audioCtx->sample_fmt == AV_SAMPLE_FMT_FLTP) {
+            float* left = reinterpret_cast<float*>(avFrame->data[0]);
+            float* right = reinterpret_cast<float*>(avFrame->data[1]);
+            for (size_t i = 0; i < sampleCount; i++) {
+                left[i] = pendingAudio[i * 2];
+                right[i] = pendingAudio[i * 2 + 1];
+            }
+        } else {
+            memcpy(avFrame->data[0], pendingAudio.data(), sampleCount * 2 * sizeof(float));
+        }
+        pendingAudio.erase(pendingAudio.begin(), pendingAudio.begin() + sampleCount * 2);
+        
+        return enqueue(avFrame, true);
+    }
+    
+    AVCodecContext* setupVideoEncoder(AVStream* stream) {
+        const AVCodec* codec = avcodec_find_encoder_by_name(settings.videoCodec.c_str());
+        if (!codec) {
+            // Always built into libavcodec, so generation never fails for lack of x264
+            LOG_WARNING("Video codec not found: " + settings.videoCodec + ", using mpeg4");
+            codec = avcodec_find_encoder(AV_CODEC_ID_MPEG4);
+            if (!codec) return nullptr;
+        }
+        if (avformat_query_codec(formatCtx->oformat, codec->id, FF_COMPLIANCE_NORMAL) == 0) {
+            // e.g. H.264 into .avi: use what the container was made for instead
+            const AVCodec* native = avcodec_find_encoder(formatCtx->oformat->video_codec);
+            if (native) {
+                LOG_WARNING("Video codec " + std::string(codec->name) + " does not fit " +
+                            settings.outputPath + ", using " + native->name);
+                codec = native;
+            }
+        }
+        std::string codecName = codec->name;
+        
+        AVCodecContext* codecCtx = avcodec_alloc_context3(codec);
+        if (!codecCtx) {
+            LOG_ERROR("Could not allocate video codec context");
+            return nullptr;
+        }
+        
+        codecCtx->codec_id = codec->id;
+        codecCtx->codec_type = AVMEDIA_TYPE_VIDEO;
+        codecCtx->width = settings.width;
+        codecCtx->height = settings.height;
+        codecCtx->time_base = av_d2q(1.0 / settings.frameRate, 1000000);
+        codecCtx->framerate = av_d2q(settings.frameRate, 1000000);
+        codecCtx->bit_rate = settings.videoBitrate;
+        codecCtx->gop_size = static_cast<int>(settings.frameRate); // 1 second GOP
+        codecCtx->max_b_frames = 2;
+        codecCtx->thread_count = settings.encoderThreads;
+        codecCtx->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+        
+        if (formatCtx->oformat->flags & AVFMT_GLOBALHEADER) {
+            codecCtx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+        }
+        
+        // Set pixel format
+        if (settings.pixelFormat == "yuv444p") {
+            codecCtx->pix_fmt = AV_PIX_FMT_YUV444P;
+        } else {
+            codecCtx->pix_fmt = AV_PIX_FMT_YUV420P; // Default
+        }
+        
+        // Codec specific settings
+        if (codecName == "libx264") {
+            av_opt_set(codecCtx->priv_data, "preset", settings.preset.c_str(), 0);
+            av_opt_set(codecCtx->priv_data, "crf", std::to_string(settings.crf).c_str(), 0);
+            av_opt_set(codecCtx->priv_data, "profile", "high", 0);
+        } else if (codecName == "libx265") {
+            av_opt_set(codecCtx->priv_data, "preset", settings.preset.c_str(), 0);
+            av_opt_set(codecCtx->priv_data, "crf", std::to_string(settings.crf).c_str(), 0);
+        }
+        
+        // Hardware acceleration
+        if (settings.hardwareAcceleration && codecName.find("nvenc") != std::string::npos) {
+            // NVIDIA NVENC settings
+            av_opt_set(codecCtx->priv_data, "preset", "slow", 0);
+            av_opt_set(codecCtx->priv_data, "rc", "vbr", 0);
+        }
+        
+        stream->time_base = codecCtx->time_base;
+        
+        int ret = avcodec_open2(codecCtx, codec, nullptr);
+        if (ret < 0) {
+            LOG_ERROR("Could not open video codec");
+            avcodec_free_context(&codecCtx);
+            return nullptr;
+        }
+        
+        // Copy parameters to stream
+        ret = avcodec_parameters_from_context(stream->codecpar, codecCtx);
+        if (ret < 0) {
+            LOG_ERROR("Could not copy video codec parameters");
+            avcodec_free_context(&codecCtx);
+            return nullptr;
+        }
+        
+        return codecCtx;
+    }
+    
+    AVCodecContext* setupAudioEncoder(AVStream* stream) {
+        const AVCodec* codec = avcodec_find_encoder_by_name(settings.audioCodec.c_str());
+        if (!codec) {
+            LOG_ERROR("Audio codec not found: " + settings.audioCodec);
+            return nullptr;
+        }
+        
+        AVCodecContext* codecCtx = avcodec_alloc_context3(codec);
+        if (!codecCtx) {
+            LOG_ERROR("Could not allocate audio codec context");
+            return nullptr;
+        }
+        
+        codecCtx->codec_id = codec->id;
+        codecCtx->codec_type = AVMEDIA_TYPE_AUDIO;
+        codecCtx->bit_rate = settings.audioBitrate;
+        codecCtx->sample_rate = settings.audioSampleRate;
+        codecCtx->channels = 2; // Stereo
+        codecCtx->channel_layout = AV_CH_LAYOUT_STEREO;
+        codecCtx->time_base = {1, settings.audioSampleRate};
+        
+        if (formatCtx->oformat->flags & AVFMT_GLOBALHEADER) {
+            codecCtx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+        }
+        
+        // Samples arrive as float; take the planar or packed float layout
+        codecCtx->sample_fmt = AV_SAMPLE_FMT_NONE;
+        for (const AVSampleFormat* format = codec->sample_fmts; format && *format != AV_SAMPLE_FMT_NONE; ++format) {
+            if (*format == AV_SAMPLE_FMT_FLTP || *format == AV_SAMPLE_FMT_FLT) {
+                codecCtx->sample_fmt = *format;
+                break;
+            }
+        }
+        if (codecCtx->sample_fmt == AV_SAMPLE_FMT_NONE) {
+            if (codec->sample_fmts) {
+                LOG_ERROR("Audio codec has no float sample format: " + settings.audioCodec);
+                avcodec_free_context(&codecCtx);
+                return nullptr;
+            }
+            codecCtx->sample_fmt = AV_SAMPLE_FMT_FLTP; // Default to float planar
+        }
+        
+        stream->time_base = codecCtx->time_base;
+        
+        int ret = avcodec_open2(codecCtx, codec, nullptr);
+        if (ret < 0) {
+            LOG_ERROR("Could not open audio codec");
+            avcodec_free_context(&codecCtx);
+            return nullptr;
+        }
+        
+        // Copy parameters to stream
+        ret = avcodec_parameters_from_context(stream->codecpar, codecCtx);
+        if (ret < 0) {
+            LOG_ERROR("Could not copy audio codec parameters");
+            avcodec_free_context(&codecCtx);
+            return nullptr;
+        }
+        
+        return codecCtx;
+    }
+    
+    bool encode(AVCodecContext* codecCtx, AVStream* stream, AVFrame* frame) {
+        int ret = avcodec_send_frame(codecCtx, frame);
+        if (ret < 0) return false;
+        
+        AVPacket* packet = av_packet_alloc();
+        while (ret >= 0) {
+            ret = avcodec_receive_packet(codecCtx, packet);
+            if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
+                break;
+            } else if (ret < 0) {
+                av_packet_free(&packet);
+                return false;
+            }
+            
+            packet->stream_index = stream->index;
+            double packetTime = packet->pts != AV_NOPTS_VALUE ? packet->pts * av_q2d(codecCtx->time_base) : 0.0;
+            av_packet_rescale_ts(packet, codecCtx->time_base, stream->time_base);
+            
+            {
+                std::lock_guard<std::mutex> lock(muxMutex);
+                ret = av_interleaved_write_frame(formatCtx, packet);
+                if (stream == videoStream) {
+                    videoMuxedTime = std::max(videoMuxedTime, packetTime);
+                }
+            }
+            if (stream == videoStream) {
+                muxProgress.notify_all();
+            }
+            av_packet_unref(packet);
+            if (ret < 0) {
+                av_packet_free(&packet);
+                return false;
+            }
+        }
+        
+        av_packet_free(&packet);
+        return true;
+    }
+    
+    void flushEncoder(AVCodecContext* codecCtx, AVStream* stream) {
+        if (!encode(codecCtx, stream, nullptr)) {
+            setFailure("Error flushing encoder");
+        }
+    }
+    
+    // Opens the audio track of settings.audioSourcePath and adds its output
+    // stream: a copy of the source parameters when the container accepts
+    // the codec, otherwise the audio encoder fed through a resampler
+    bool openAudioSource() {
+        const std::string& path = settings.audioSourcePath;
+        int ret = avformat_open_input(&audioSourceCtx, path.c_str(), nullptr, nullptr);
+        if (ret < 0) return fail("Could not open audio source: " + path);
+        ret = avformat_find_stream_info(audioSourceCtx, nullptr);
+        if (ret < 0) return fail("Could not read audio source: " + path);
+        
+        audioSourceIndex = av_find_best_stream(audioSourceCtx, AVMEDIA_TYPE_AUDIO, -1, -1, nullptr, 0);
+        if (audioSourceIndex < 0) return fail("No audio stream in: " + path);
+        const AVStream* source = audioSourceCtx->streams[audioSourceIndex];
+        audioSourceStart = source->start_time != AV_NOPTS_VALUE ? source->start_time : 0;
+        
+        audioStream = avformat_new_stream(formatCtx, nullptr);
+        if (!audioStream) return fail("Could not create audio stream");
+        
+        if (avformat_query_codec(formatCtx->oformat, source->codecpar->codec_id, FF_COMPLIANCE_NORMAL) == 1) {
+            ret = avcodec_parameters_copy(audioStream->codecpar, source->codecpar);
+            if (ret < 0) return fail("Could not copy audio source parameters");
+            audioStream->codecpar->codec_tag = 0;
+            audioStream->time_base = source->time_base;
+            return true;
+        }
+        
+        const AVCodec* decoder = avcodec_find_decoder(source->codecpar->codec_id);
+        if (!decoder) {
+            return fail(std::string("No decoder for audio source codec: ") + avcodec_get_name(source->codecpar->codec_id));
+        }
+        audioDecoderCtx = avcodec_alloc_context3(decoder);
+        if (!audioDecoderCtx ||
+            avcodec_parameters_to_context(audioDecoderCtx, source->codecpar) < 0 ||
+            avcodec_open2(audioDecoderCtx, decoder, nullptr) < 0) {
+            return fail("Could not open audio source decoder");
+        }
+        if (!audioDecoderCtx->channel_layout) {
+            audioDecoderCtx->channel_layout = av_get_default_channel_layout(audioDecoderCtx->channels);
+        }
+        
+        audioCtx = setupAudioEncoder(audioStream);
+        if (!audioCtx) return fail("Could not setup audio encoder");
+        
+        resampleCtx = swr_alloc_set_opts(nullptr,
+                                         audioCtx->channel_layout, audioCtx->sample_fmt, audioCtx->sample_rate,
+                                         audioDecoderCtx->channel_layout, audioDecoderCtx->sample_fmt,
+                                         audioDecoderCtx->sample_rate, 0, nullptr);
+        if (!resampleCtx || swr_init(resampleCtx) < 0) return fail("Could not setup audio resampler");
+        
+        audioFifo = av_audio_fifo_alloc(audioCtx->sample_fmt, audioCtx->channels,
+                                        static_cast<int>(audioFrameSamples()));
+        if (!audioFifo) return fail("Could not allocate audio buffer");
+        return true;
+    }
+    
+    // Audio thread. Feeds the source track into the muxer at most
+    // audioLeadSeconds ahead of the video muxed so far, which keeps the
+    // muxer's interleaving queue short, and stops at the end of the video.
+    void muxAudioSource() {
+        const AVStream* source = audioSourceCtx->streams[audioSourceIndex];
+        AVPacket* packet = av_packet_alloc();
+        AVFrame* decoded = av_frame_alloc();
+        if (!packet || !decoded) {
+            setFailure("Could not allocate audio source buffers");
+        }
+        
+        while (!failed && av_read_frame(audioSourceCtx, packet) >= 0) {
+            if (packet->stream_index != audioSourceIndex) {
+                av_packet_unref(packet);
+                continue;
+            }
+            
+            int64_t timestamp = packet->pts != AV_NOPTS_VALUE ? packet->pts : packet->dts;
+            double packetTime = timestamp != AV_NOPTS_VALUE ? (timestamp - audioSourceStart) * av_q2d(source->time_base) : 0.0;
+            if (!waitForVideo(packetTime)) {
+                av_packet_unref(packet);
+                break;
+            }
+            
+            bool ok = audioDecoderCtx ? transcodeAudio(packet, decoded) : copyAudio(packet, source);
+            av_packet_unref(packet);
+            if (!ok) setFailure("Error muxing source audio");
+        }
+        
+        if (audioDecoderCtx && !failed) {
+            // Drain the decoder and resampler, then the encoder
+            if (!transcodeAudio(nullptr, decoded) || !resampleAudio(nullptr) || !encodeAudioFifo(true)) {
+                setFailure("Error muxing source audio");
+            } else {
+                flushEncoder(audioCtx, audioStream);
+            }
+        }
+        
+        av_frame_free(&decoded);
+        av_packet_free(&packet);
+    }
+    
+    // False once the video has ended before time or the sink failed
+    bool waitForVideo(double time) {
+        std::unique_lock<std::mutex> lock(muxMutex);
+        muxProgress.wait(lock, [this, time]() {
+            return failed || videoEnded || time <= videoMuxedTime + audioLeadSeconds;
+        });
+        return !failed && !(videoEnded && time >= videoEndTime);
+    }
+    
+    // Lets the audio thread run up to endTime and waits for it
+    void finishAudioSource(double endTime) {
+        if (!audioThread.joinable()) return;
+        {
+            std::lock_guard<std::mutex> lock(muxMutex);
+            videoEnded = true;
+            videoEndTime = endTime;
+        }
+        muxProgress.notify_all();
+        audioThread.join();
+    }
+    
+    bool copyAudio(AVPacket* packet, const AVStream* source) {
+        if (packet->pts != AV_NOPTS_VALUE) packet->pts -= audioSourceStart;
+        if (packet->dts != AV_NOPTS_VALUE) packet->dts -= audioSourceStart;
+        av_packet_rescale_ts(packet, source->time_base, audioStream->time_base);
+        packet->stream_index = audioStream->index;
+        packet->pos = -1;
+        
+        std::lock_guard<std::mutex> lock(muxMutex);
+        return av_interleaved_write_frame(formatCtx, packet) >= 0;
+    }
+    
+    // Decodes a source packet (nullptr drains the decoder) and encodes every
+    // whole encoder frame it completes
+    bool transcodeAudio(const AVPacket* packet, AVFrame* decoded) {
+        int ret = avcodec_send_packet(audioDecoderCtx, packet);
+        if (ret == AVERROR_INVALIDDATA) return true; // Skip a damaged packet
+        if (ret < 0 && ret != AVERROR_EOF) return false;
+        
+        while ((ret = avcodec_receive_frame(audioDecoderCtx, decoded)) >= 0) {
+            bool ok = resampleAudio(decoded) && encodeAudioFifo(false);
+            av_frame_unref(decoded);
+            if (!ok) return false;
+        }
+        return ret == AVERROR(EAGAIN) || ret == AVERROR_EOF;
+    }
+    
+    // Converts to the encoder's layout, format and rate into audioFifo;
+    // nullptr flushes the samples the resampler still holds
+    bool resampleAudio(const AVFrame* frame) {
+        int inputSamples = frame ? frame->nb_samples : 0;
+        int outputSamples = swr_get_out_samples(resampleCtx, inputSamples);
+        if (outputSamples <= 0) return outputSamples == 0;
+        
+        uint8_t** converted = nullptr;
+        if (av_samples_alloc_array_and_samples(&converted, nullptr, audioCtx->channels, outputSamples,
+                                               audioCtx->sample_fmt, 0) < 0) {
+            return false;
+        }
+        int samples = swr_convert(resampleCtx, converted, outputSamples,
+                                  frame ? const_cast<const uint8_t**>(frame->extended_data) : nullptr, inputSamples);
+        bool ok = samples >= 0 &&
+                  av_audio_fifo_write(audioFifo, reinterpret_cast<void**>(converted), samples) == samples;
+        av_freep(&converted[0]);
+        av_freep(&converted);
+        return ok;
+    }
+    
+    // Encodes whole encoder frames from audioFifo; at the end also the rest,
+    // padded with silence unless the codec takes a short last frame
+    bool encodeAudioFifo(bool final) {
+        const int frameSamples = static_cast<int>(audioFrameSamples());
+        const bool smallLastFrame = audioCtx->codec->capabilities & AV_CODEC_CAP_SMALL_LAST_FRAME;
+        
+        while (av_audio_fifo_size(audioFifo) >= frameSamples || (final && av_audio_fifo_size(audioFifo) > 0)) {
+            int available = std::min(frameSamples, av_audio_fifo_size(audioFifo));
+            
+            AVFrame* avFrame = av_frame_alloc();
+            if (!avFrame) return false;
+            avFrame->format = audioCtx->sample_fmt;
+            avFrame->channels = audioCtx->channels;
+            avFrame->channel_layout = audioCtx->channel_layout;
+            avFrame->sample_rate = audioCtx->sample_rate;
+            avFrame->nb_samples = (available < frameSamples && smallLastFrame) ? available : frameSamples;
+            avFrame->pts = audioSamplesWritten;
+            audioSamplesWritten += avFrame->nb_samples;
+            
+            if (av_frame_get_buffer(avFrame, 0) < 0 ||
+                av_audio_fifo_read(audioFifo, reinterpret_cast<void**>(avFrame->data), available) != available) {
+                av_frame_free(&avFrame);
+                return false;
+            }
+            if (available < avFrame->nb_samples) {
+                av_samples_set_silence(avFrame->data, available, avFrame->nb_samples - available,
+                                       audioCtx->channels, audioCtx->sample_fmt);
+            }
+            
+            bool ok = encode(audioCtx, audioStream, avFrame);
+            av_frame_free(&avFrame);
+            if (!ok) return false;
+        }
+        return true;
+    }
+    
+    void cleanup() {
+        finishAudioSource(0.0);
+        if (audioSourceCtx) avformat_close_input(&audioSourceCtx);
+        if (audioDecoderCtx) avcodec_free_context(&audioDecoderCtx);
+        if (resampleCtx) swr_free(&resampleCtx);
+        if (audioFifo) {
+            av_audio_fifo_free(audioFifo);
+            audioFifo = nullptr;
+        }
+        av_frame_free(&lastFrame);
+        holdingRepeats = false;
+        if (videoCtx) avcodec_free_context(&videoCtx);
+        if (audioCtx) avcodec_free_context(&audioCtx);
+        if (swsCtx) {
+            sws_freeContext(swsCtx);
+            swsCtx = nullptr;
+        }
+        if (formatCtx) {
+            if (!(formatCtx->oformat->flags & AVFMT_NOFILE))
+                avio_closep(&formatCtx->pb);
+            avformat_free_context(formatCtx);
+            formatCtx = nullptr;
+        }
+        videoStream = nullptr;
+        audioStream = nullptr;
+    }
+};
+
+// Work-stealing task scheduler shared by export and the SI generators. Each
+// worker owns one deque per priority class: it pushes and pops its own tasks
+// at the back, where they are still warm in cache, and an idle worker steals
+// the oldest task from the front of another worker's deque. Tasks submitted
+// from outside the pool are spread round-robin. Threads waiting on pool work
+// run queued tasks instead of blocking, so frame tasks can split themselves
+// into sub-frame tasks (row bands, tiles) without starving the pool.
+//
+// Workers always take the most urgent class first, and every class has a
+// concurrency cap. Export is capped one below the worker count, so a worker
+// is always free for interactive work even when every other core is
+// rendering. Batch work is split into per-frame tasks, which makes each
+// frame boundary a point where an interactive request can get in. Caps
+// shrink under the CPU and memory readings PerformanceMonitor feeds in.
+class FiberOpticThreading {
+public:
+    enum class Priority {
+        Interactive,    // UI requests waiting on an answer (thumbnails, scrubbing)
+        Preview,        // Playback and preview frames
+        Export,         // Final renders and batch video generation
+        Background      // Analysis and proxy generation
+    };
+    
+    static constexpr int priorityCount = 4;
+    
+    // Sets the class of pool work started from this thread while in scope
+    class PriorityScope {
+    public:
+        explicit PriorityScope(Priority priority) : previous(currentPriority()) {
+            currentPriority() = priority;
+        }
+        ~PriorityScope() { currentPriority() = previous; }
+        
+        PriorityScope(const PriorityScope&) = delete;
+        PriorityScope& operator=(const PriorityScope&) = delete;
+    
+    private:
+        Priority previous;
+    };
+    
+    explicit FiberOpticThreading(size_t workerCount = 0)
+        : pending(0), signals(0), stopping(false), nextQueue(0), cpuLoad(0.0), memoryLoad(0.0) {
+        if (inlineOnly()) {
+            workerCount = 1;
+        } else if (workerCount == 0) {
+            workerCount = std::max(1u, std::thread::hardware_concurrency());
+        }
+        int threads = static_cast<int>(workerCount);
+        configuredCaps[index(Priority::Interactive)] = threads;
+        configuredCaps[index(Priority::Preview)] = threads;
+        configuredCaps[index(Priority::Export)] = std::max(1, threads - 1);
+        configuredCaps[index(Priority::Background)] = std::max(1, threads / 4);
+        for (int c = 0; c < priorityCount; c++) {
+            running[c] = 0;
+        }
+        updateAdmission();
+        
+        for (size_t i = 0; i < workerCount; i++) {
+            queues.emplace_back(new WorkQueue());
+        }
+        for (size_t i = 0; i < workerCount && !inlineOnly(); i++) {
+            workers.emplace_back([this, i]() { workerLoop(i); });
+        }
+    }
+    
+    // Runs whatever is still queued, then joins the workers
+    ~FiberOpticThreading() {
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            stopping = true;
+        }
+        wakeWorkers.notify_all();
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+    
+    FiberOpticThreading(const FiberOpticThreading&) = delete;
+    FiberOpticThreading& operator=(const FiberOpticThreading&) = delete;
+    
+    // Process-wide pool with one worker per core
+    static FiberOpticThreading& shared() {
+        static FiberOpticThreading pool;
+        return pool;
+    }
+    
+    // Render worker processes run all pool work on the calling thread: pools
+    // built afterwards start no threads, and enqueue() and parallelFor() run
+    // their tasks in place. Call before the first pool is built.
+    static void runInline() { inlineOnly() = true; }
+    
+    size_t workerCount() const { return queues.size(); }
+    
+    // Class of work started from the calling thread: the class of the task it
+    // is running, else its PriorityScope, else Preview
+    static Priority callerPriority() { return currentPriority(); }
+    
+    // Most tasks of this class that may run at once before load adjustments
+    void setConcurrencyCap(Priority priority, int cap) {
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            configuredCaps[index(priority)] = std::max(1, cap);
+            updateAdmission();
+            signals++;
+        }
+        wakeWorkers.notify_all();
+    }
+    
+    // Called by PerformanceMonitor with whole-machine percentages (0-100)
+    void updateSystemLoad(double cpuPercentage, double memoryPercentage) {
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            cpuLoad = cpuPercentage;
+            memoryLoad = memoryPercentage;
+            updateAdmission();
+            signals++;
+        }
+        wakeWorkers.notify_all();
+    }
+    
+    int runningTasks(Priority priority) const { return running[index(priority)]; }
+    
+    template <typename Function>
+    auto enqueue(Function&& function) -> std::future<decltype(function())> {
+        return enqueue(callerPriority(), std::forward<Function>(function));
+    }
+    
+    template <typename Function>
+    auto enqueue(Priority priority, Function&& function) -> std::future<decltype(function())> {
+        using Result = decltype(function());
+        auto task = std::make_shared<std::packaged_task<Result()>>(std::forward<Function>(function));
+        std::future<Result> future = task->get_future();
+        if (workers.empty()) {
+            // Inline pool; exceptions still travel through the future
+            (*task)();
+            return future;
+        }
+        push(priority, [task]() { (*task)(); });
+        return future;
+    }
+    
+    // Runs queued tasks of the caller's class or more urgent ones on the
+    // calling thread until the future is ready
+    template <typename Result>
+    Result wait(std::future<Result>& future) {
+        helpUntilReady(future);
+        return future.get();
+    }
+    
+    // Runs body(chunkBegin, chunkEnd) over [begin, end) in chunks of at most
+    // grain items, in the caller's priority class. The caller works through
+    // chunks too. The first exception a chunk throws is rethrown once every
+    // chunk has finished.
+    template <typename Body>
+    void parallelFor(int begin, int end, int grain, const Body& body) {
+        if (end <= begin) return;
+        grain = std::max(1, grain);
+        
+        std::vector<std::future<void>> chunks;
+        for (int start = begin; start < end; start += grain) {
+            int stop = std::min(end, start + grain);
+            chunks.push_back(enqueue([&body, start, stop]() { body(start, stop); }));
+        }
+        for (auto& chunk : chunks) {
+            helpUntilReady(chunk);
+        }
+        for (auto& chunk : chunks) {
+            chunk.get();
+        }
+    }
+
+private:
+    struct WorkQueue {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks[priorityCount];
+    };
+    
+    // Pool and queue the calling thread works from, if it is a worker
+    struct WorkerIdentity {
+        const FiberOpticThreading* pool = nullptr;
+        size_t index = 0;
+    };
+    
+    std::vector<std::unique_ptr<WorkQueue>> queues;
+    std::vector<std::thread> workers;
+    std::mutex sleepMutex;
+    std::condition_variable wakeWorkers;
+    std::atomic<long> pending;      // Tasks queued but not yet taken
+    std::atomic<uint64_t> signals;  // Bumped on new work, freed slots and cap changes
+    bool stopping;
+    std::atomic<size_t> nextQueue;
+    
+    int configuredCaps[priorityCount];
+    std::atomic<int> admissionCaps[priorityCount];
+    std::atomic<int> running[priorityCount];
+    double cpuLoad;
+    double memoryLoad;
+    
+    static int index(Priority priority) { return static_cast<int>(priority); }
+    
+    static WorkerIdentity& currentWorker() {
+        static thread_local WorkerIdentity identity;
+        return identity;
+    }
+    
+    static Priority& currentPriority() {
+        static thread_local Priority priority = Priority::Preview;
+        return priority;
+    }
+    
+    static bool& inlineOnly() {
+        static bool enabled = false;
+        return enabled;
+    }
+    
+    // Callers hold sleepMutex. Interactive and preview work is never held
+    // back. Background work drops to one task once the machine is busy, and
+    // under memory pressure export keeps fewer frames in flight.
+    void updateAdmission() {
+        bool cpuBusy = cpuLoad >= 90.0;
+        bool memoryTight = memoryLoad >= 85.0;
+        
+        admissionCaps[index(Priority::Interactive)] = configuredCaps[index(Priority::Interactive)];
+        admissionCaps[index(Priority::Preview)] = configuredCaps[index(Priority::Preview)];
+        
+        int exportCap = configuredCaps[index(Priority::Export)];
+        admissionCaps[index(Priority::Export)] = memoryTight ? std::max(1, exportCap / 2) : exportCap;
+        
+        int backgroundCap = configuredCaps[index(Priority::Background)];
+        admissionCaps[index(Priority::Background)] = (cpuBusy || memoryTight) ? 1 : backgroundCap;
+    }
+    
+    void push(Priority priority, std::function<void()> task) {
+        const WorkerIdentity& self = currentWorker();
+        size_t queue = self.pool == this ? self.index : nextQueue++ % queues.size();
+        {
+            std::lock_guard<std::mutex> lock(queues[queue]->mutex);
+            queues[queue]->tasks[index(priority)].push_back(std::move(task));
+        }
+        {
+            // Under sleepMutex so a worker about to sleep cannot miss it
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            pending++;
+            signals++;
+        }
+        wakeWorkers.notify_one();
+    }
+    
+    // Reserves a slot in the class if it is under its cap
+    bool admit(int priorityClass) {
+        int current = running[priorityClass];
+        while (current < admissionCaps[priorityClass]) {
+            if (running[priorityClass].compare_exchange_weak(current, current + 1)) {
+                return true;
+            }
+        }
+        return false;
+    }
+    
+    // Own deque newest first, then the oldest task of every other deque
+    std::function<void()> take(int priorityClass) {
+        const WorkerIdentity& self = currentWorker();
+        bool isWorker = self.pool == this;
+        size_t home = isWorker ? self.index : nextQueue.load() % queues.size();
+        
+        std::function<void()> task;
+        if (isWorker) {
+            std::lock_guard<std::mutex> lock(queues[home]->mutex);
+            auto& tasks = queues[home]->tasks[priorityClass];
+            if (!tasks.empty()) {
+                task = std::move(tasks.back());
+                tasks.pop_back();
+            }
+        }
+        for (size_t i = 1; !task && i <= queues.size(); i++) {
+            WorkQueue& victim = *queues[(home + i) % queues.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            auto& tasks = victim.tasks[priorityClass];
+            if (!tasks.empty()) {
+                task = std::move(tasks.front());
+                tasks.pop_front();
+            }
+        }
+        return task;
+    }
+    
+    // Runs the most urgent task the caps allow. A thread that is only
+    // waiting on pool work lends itself without taking a new slot, so
+    // nested tasks still finish when their class is at its cap. It only takes
+    // work at least as urgent as its own class: an interactive request
+    // waiting on its chunks must not pick up a long export frame.
+    bool tryRunOne(bool waiting) {
+        int lastClass = waiting ? index(currentPriority()) : priorityCount - 1;
+        for (int c = 0; c <= lastClass; c++) {
+            if (!waiting && !admit(c)) continue;
+            
+            std::function<void()> task = take(c);
+            if (!task) {
+                if (!waiting) running[c]--;
+                continue;
+            }
+            if (waiting) running[c]++;
+            
+            pending--;
+            Priority previous = currentPriority();
+            currentPriority() = static_cast<Priority>(c);
+            task();
+            currentPriority() = previous;
+            
+            if (running[c]-- >= admissionCaps[c]) {
+                // A capped class just freed a slot
+                {
+                    std::lock_guard<std::mutex> lock(sleepMutex);
+                    signals++;
+                }
+                wakeWorkers.notify_one();
+            }
+            return true;
+        }
+        return false;
+    }
+    
+    template <typename Result>
+    void helpUntilReady(std::future<Result>& future) {
+        while (future.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            if (!tryRunOne(true)) {
+                // Nothing left to take; the rest is already running elsewhere
+                future.wait_for(std::chrono::microseconds(200));
+            }
+        }
+    }
+    
+    void workerLoop(size_t queue) {
+        currentWorker() = WorkerIdentity{this, queue};
+        while (true) {
+            uint64_t seen = signals;
+            if (tryRunOne(false)) continue;
+            
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            if (stopping && pending <= 0) break;
+            wakeWorkers.wait(lock, [this, seen]() { return signals.load() != seen || stopping; });
+            if (stopping && pending <= 0) break;
+        }
+    }
+};
+// Commits results strictly in index order although the pool produces them in
+// any order: result N is committed only after N - 1. One thread commits at a
+// time (whichever delivered the next index), so the commit function may feed
+// a single-producer writer such as FrameSink. At most `window` results are in
+// flight ahead of the last commit, which bounds memory.
+template <typename Result>
+class OrderedSink {
+public:
+    using ProduceFunction = std::function<Result(int index)>;
+    using CommitFunction = std::function<void(int index, Result& result)>;
+    
+    OrderedSink(FiberOpticThreading& pool, int window, CommitFunction commit,
+                FiberOpticThreading::Priority priority = FiberOpticThreading::Priority::Export)
+        : pool(pool), window(std::max(1, window)), commit(std::move(commit)), priority(priority),
+          nextCommit(0), inFlight(0), committing(false) {}
+    
+    // Produces indices [0, count) on the pool and commits them in order,
+    // stopping early once stopRequested() returns true. The first exception
+    // from produce or commit is rethrown after every in-flight task has
+    // finished. Must not be called from one of the pool's workers. Returns
+    // the number of results committed.
+    int run(int count, const ProduceFunction& produce, const std::function<bool()>& stopRequested = nullptr) {
+        nextCommit = 0;
+        error = nullptr;
+        ready.clear();
+        
+        for (int index = 0; index < count; index++) {
+            if (stopRequested && stopRequested()) break;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                progress.wait(lock, [this, index]() { return index < nextCommit + window || error; });
+                if (error) break;
+                inFlight++;
+            }
+            
+            pool.enqueue(priority, [this, &produce, index]() {
+                try {
+                    deliver(index, produce(index));
+                } catch (...) {
+                    fail(std::current_exception());
+                }
+                // Notify under the lock: run() may return as soon as it is released
+                std::lock_guard<std::mutex> lock(mutex);
+                inFlight--;
+                progress.notify_all();
+            });
+        }
+        
+        std::unique_lock<std::mutex> lock(mutex);
+        progress.wait(lock, [this]() { return inFlight == 0; });
+        ready.clear();
+        if (error) {
+            std::rethrow_exception(error);
+        }
+        return nextCommit;
+    }
+
+private:
+    FiberOpticThreading& pool;
+    int window;
+    CommitFunction commit;
+    FiberOpticThreading::Priority priority;
+    
+    std::mutex mutex;
+    std::condition_variable progress;
+    std::map<int, Result> ready;
+    int nextCommit;
+    int inFlight;
+    bool committing;
+    std::exception_ptr error;
+    
+    void deliver(int index, Result result) {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (error) return;
+        ready.emplace(index, std::move(result));
+        if (committing) return; // The committing thread will pick it up
+        
+        committing = true;
+        while (!error) {
+            auto next = ready.find(nextCommit);
+            if (next == ready.end()) break;
+            Result current = std::move(next->second);
+            ready.erase(next);
+            int commitIndex = nextCommit;
+            lock.unlock();
+            
+            std::exception_ptr commitError;
+            try {
+                commit(commitIndex, current);
+            } catch (...) {
+                commitError = std::current_exception();
+            }
+            
+            lock.lock();
+            if (commitError) {
+                if (!error) error = commitError;
+                break;
+            }
+            nextCommit++;
+            progress.notify_all();
+        }
+        committing = false;
+        if (error) {
+            ready.clear();
+            progress.notify_all();
+        }
+    }
+    
+    void fail(std::exception_ptr exception) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!error) error = exception;
+        ready.clear();
+        progress.notify_all();
+    }
+};
+
+// Ring of frame slots in POSIX shared memory between the exporter and one
+// render worker process. The worker renders straight into a slot and the
+// exporter encodes straight out of it, so frames cross the process boundary
+// without being copied or serialised. Process-shared semaphores count free
+// and filled slots. The shm name is unlinked as soon as it is mapped; the
+// worker process maps the same memory from a descriptor it inherits across
+// exec and attach()es to it.
+class SharedFrameRing {
+public:
+    SharedFrameRing() : header(nullptr), mappingSize(0), slotOffset(0), slotBytes(0), slotCount(0), frameType(0),
+                        descriptor(-1), owner(false) {}
+    
+    ~SharedFrameRing() {
+        close();
+    }
+    
+    SharedFrameRing(const SharedFrameRing&) = delete;
+    SharedFrameRing& operator=(const SharedFrameRing&) = delete;
+    
+    bool create(cv::Size size, int type, int slots) {
+        close();
+        layout(size, type, slots);
+        
+        static std::atomic<int> ringCounter(0);
+        std::string name = "/tvid-ring-" + std::to_string(getpid()) + "-" + std::to_string(ringCounter++);
+        int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+        if (fd < 0) return false;
+        // Nothing is left behind in /dev/shm even if this process crashes
+        shm_unlink(name.c_str());
+        
+        if (ftruncate(fd, static_cast<off_t>(mappingSize)) < 0) {
+            ::close(fd);
+            return false;
+        }
+        void* mapping = mmap(nullptr, mappingSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (mapping == MAP_FAILED) {
+            ::close(fd);
+            return false;
+        }
+        
+        // Kept open (close-on-exec) so workers can be handed the ring
+        descriptor = fd;
+        owner = true;
+        header = static_cast<Header*>(mapping);
+        header->initialised = false;
+        return reset();
+    }
+    
+    // Worker side: maps a ring the exporter created, with the same geometry.
+    // The semaphores stay the exporter's to set up and destroy.
+    bool attach(int fd, cv::Size size, int type, int slots) {
+        close();
+        layout(size, type, slots);
+        
+        void* mapping = mmap(nullptr, mappingSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (mapping == MAP_FAILED) return false;
+        
+        header = static_cast<Header*>(mapping);
+        return header->initialised;
+    }
+    
+    // The descriptor a worker process inherits; -1 on the worker side
+    int getDescriptor() const { return descriptor; }
+    
+    // Empties the ring. Only while no worker is attached to it.
+    bool reset() {
+        destroySemaphores();
+        if (sem_init(&header->freeSlots, 1, static_cast<unsigned int>(slotCount)) < 0) return false;
+        if (sem_init(&header->filledSlots, 1, 0) < 0) {
+            sem_destroy(&header->freeSlots);
+            return false;
+        }
+        header->initialised = true;
+        header->writeCursor = 0;
+        header->readCursor = 0;
+        return true;
+    }
+    
+    void close() {
+        if (header) {
+            if (owner) destroySemaphores();
+            munmap(header, mappingSize);
+            header = nullptr;
+        }
+        if (descriptor >= 0) {
+            ::close(descriptor);
+            descriptor = -1;
+        }
+        owner = false;
+    }
+    
+    // Worker side: the next slot to render into, blocking while the ring is full
+    cv::Mat acquire() {
+        while (sem_wait(&header->freeSlots) < 0 && errno == EINTR) {}
+        return slot(header->writeCursor % slotCount);
+    }
+    
+    void publish(int64_t frameNumber) {
+        frameNumbers()[header->writeCursor % slotCount] = frameNumber;
+        header->writeCursor++;
+        sem_post(&header->filledSlots);
+    }
+    
+    // Exporter side: waits up to timeoutMs for the oldest filled slot
+    bool waitFilled(int timeoutMs) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += timeoutMs / 1000;
+        deadline.tv_nsec += static_cast<long>(timeoutMs % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        
+        while (sem_timedwait(&header->filledSlots, &deadline) < 0) {
+            if (errno != EINTR) return false;
+        }
+        return true;
+    }
+    
+    // The slot waitFilled() returned; valid until release()
+    cv::Mat filled(int64_t& frameNumber) {
+        size_t index = header->readCursor % slotCount;
+        frameNumber = frameNumbers()[index];
+        return slot(index);
+    }
+    
+    void release() {
+        header->readCursor++;
+        sem_post(&header->freeSlots);
+    }
+
+private:
+    struct Header {
+        sem_t freeSlots;
+        sem_t filledSlots;
+        uint64_t writeCursor;   // Only advanced by the worker
+        uint64_t readCursor;    // Only advanced by the exporter
+        bool initialised;
+    };
+    
+    Header* header;
+    size_t mappingSize;
+    size_t slotOffset;
+    size_t slotBytes;
+    size_t slotCount;
+    cv::Size frameSize;
+    int frameType;
+    int descriptor;
+    bool owner;
+    
+    static size_t alignUp(size_t value) {
+        return (value + 63) & ~static_cast<size_t>(63);
+    }
+    
+    void layout(cv::Size size, int type, int slots) {
+        frameSize = size;
+        frameType = type;
+        slotCount = static_cast<size_t>(std::max(1, slots));
+        slotBytes = alignUp(static_cast<size_t>(size.area()) * CV_ELEM_SIZE(type));
+        slotOffset = alignUp(sizeof(Header) + slotCount * sizeof(int64_t));
+        mappingSize = slotOffset + slotBytes * slotCount;
+    }
+    
+    int64_t* frameNumbers() {
+        return reinterpret_cast<int64_t*>(header + 1);
+    }
+    
+    cv::Mat slot(size_t index) {
+        uint8_t* base = reinterpret_cast<uint8_t*>(header) + slotOffset + index * slotBytes;
+        return cv::Mat(frameSize, frameType, base);
+    }
+    
+    void destroySemaphores() {
+        if (header && header->initialised) {
+            sem_destroy(&header->freeSlots);
+            sem_destroy(&header->filledSlots);
+            header->initialised = false;
+        }
+    }
+};
+
+// Renders frames in worker processes that feed SharedFrameRings, and commits
+// them in order on the calling thread. Worker k renders frames k, k + W,
+// k + 2W, ... so the exporter always knows which ring holds the next frame.
+// When a worker crashes (a decoder or effect fault) or stalls, only that
+// worker is lost: it is restarted from the frame the exporter is waiting on,
+// so the job resumes from its last committed frame. Workers exit when the
+// job ends, taking any heap fragmentation from large frames with them.
+//
+// The server is multithreaded, so a forked copy of it could inherit locks
+// held by other threads (the scheduler's queues, the effect caches). Each
+// worker is therefore forked and immediately exec'd as a fresh
+// `<this binary> --render-worker ...`. This file has no main(): the
+// program embedding it must hand that invocation to
+// RenderEngine::runRenderWorker() before starting anything else, and then
+// call registerEntryPoint(). Until it does, run() refuses to start workers,
+// since the exec'd binary would come up as a second server. The timeline
+// reaches a worker as a .tvproj file and its ring as an inherited
+// descriptor. Workers run the scheduler inline and OpenCV single threaded.
+//
+// Only timeline exports use the pool. The SI generators in SIMOD.cpp render
+// in the server: a worker is described by a .tvproj timeline, which cannot
+// express a generator job, and a worker's inline scheduler would run their
+// tile tasks on one thread.
+class RenderWorkerPool {
+public:
+    using RenderFunction = std::function<void(int frameNumber, cv::Mat& frame)>;
+    using CommitFunction = std::function<void(int frameNumber, const cv::Mat& frame)>;
+    
+    static constexpr const char* workerFlag = "--render-worker";
+    static constexpr int maxRestarts = 3;           // Per worker and job
+    static constexpr int pollIntervalMs = 100;
+    static constexpr int stallTimeoutMs = 60000;    // No frame for this long counts as a crash
+    
+    // What a worker process is started with
+    struct WorkerArguments {
+        std::string timelinePath;
+        double frameRate = 0.0;
+        cv::Size frameSize;
+        int frameType = 0;
+        int slots = 0;
+        int ringDescriptor = -1;
+        int firstFrame = 0;
+        int stride = 1;
+        int frameCount = 0;
+    };
+    
+    RenderWorkerPool(int workerCount, cv::Size frameSize, int frameType, int slotsPerWorker = 2)
+        : workerCount(std::max(1, workerCount)), frameSize(frameSize), frameType(frameType),
+          slotsPerWorker(std::max(1, slotsPerWorker)) {}
+    
+    ~RenderWorkerPool() {
+        stopWorkers();
+    }
+    
+    // Called by the embedding main() once it dispatches workerFlag to
+    // RenderEngine::runRenderWorker()
+    static void registerEntryPoint() {
+        entryPointRegistered() = true;
+    }
+    
+    static bool hasEntryPoint() {
+        return entryPointRegistered();
+    }
+    
+    RenderWorkerPool(const RenderWorkerPool&) = delete;
+    RenderWorkerPool& operator=(const RenderWorkerPool&) = delete;
+    
+    // Renders frames [0, frameCount) of the timeline's video at frameRate.
+    // Returns false when a worker keeps failing (see getError()) or when
+    // stopRequested() returned true. Exceptions from commit propagate after
+    // the workers are stopped.
+    bool run(const Timeline& timeline, double frameRate, int frameCount, const CommitFunction& commit,
+             const std::function<bool()>& stopRequested = nullptr) {
+        stopWorkers();
+        workers.clear();
+        if (!hasEntryPoint()) {
+            return fail("Render worker entry point is not registered; this build cannot run isolated workers");
+        }
+        
+        char path[PATH_MAX];
+        ssize_t length = readlink("/proc/self/exe", path, sizeof(path) - 1);
+        if (length <= 0) {
+            return fail("Could not locate the render worker executable: " + std::string(strerror(errno)));
+        }
+        executable.assign(path, static_cast<size_t>(length));
+        
+        // Workers only composite video, so the snapshot leaves the waveforms out
+        const char* tempDirectory = std::getenv("TMPDIR");
+        std::string jobPath = std::string(tempDirectory ? tempDirectory : "/tmp") + "/tvid-render-XXXXXX";
+        int jobDescriptor = mkstemp(&jobPath[0]);
+        if (jobDescriptor < 0) {
+            return fail("Could not create render job file: " + std::string(strerror(errno)));
+        }
+        ::close(jobDescriptor);
+        struct RemoveOnExit {
+            std::string path;
+            ~RemoveOnExit() { std::remove(path.c_str()); }
+        } jobFile{jobPath};
+        
+        Timeline videoOnly = timeline;
+        videoOnly.audioTracks.clear();
+        if (!ProjectManager::BinaryContainer::write(jobPath, videoOnly, 0, 0)) {
+            return fail("Could not write render job file: " + jobPath);
+        }
+        job.timelinePath = jobPath;
+        job.frameRate = frameRate;
+        job.frameSize = frameSize;
+        job.frameType = frameType;
+        job.slots = slotsPerWorker;
+        job.frameCount = frameCount;
+        
+        workers.resize(std::max(1, std::min(workerCount, frameCount)));
+        for (size_t k = 0; k < workers.size(); k++) {
+            workers[k].ring.reset(new SharedFrameRing());
+            if (!workers[k].ring->create(frameSize, frameType, slotsPerWorker)) {
+                return fail("Could not create shared frame ring: " + std::string(strerror(errno)));
+            }
+            if (!spawn(k, static_cast<int>(k))) {
+                return fail("Could not start render worker: " + std::string(strerror(errno)));
+            }
+        }
+        
+        int waitedMs = 0;
+        for (int next = 0; next < frameCount; ) {
+            if (stopRequested && stopRequested()) {
+                stopWorkers();
+                return false;
+            }
+            
+            size_t k = static_cast<size_t>(next) % workers.size();
+            Worker& worker = workers[k];
+            if (!worker.ring->waitFilled(pollIntervalMs)) {
+                waitedMs += pollIntervalMs;
+                bool stalled = waitedMs >= stallTimeoutMs;
+                if (stalled || workerExited(worker)) {
+                    if (!restart(k, next, stalled)) return false;
+                    waitedMs = 0;
+                }
+                continue;
+            }
+            waitedMs = 0;
+            
+            int64_t frameNumber = 0;
+            cv::Mat frame = worker.ring->filled(frameNumber);
+            if (frameNumber != next) {
+                return fail("Render worker delivered frame " + std::to_string(frameNumber) +
+                            ", expected " + std::to_string(next));
+            }
+            try {
+                commit(next, frame);
+            } catch (...) {
+                stopWorkers();
+                throw;
+            }
+            worker.ring->release();
+            next++;
+        }
+        
+        stopWorkers();
+        return true;
+    }
+    
+    std::string getError() const { return errorMessage; }
+    
+    // Worker process side. Arguments follow workerFlag as --name value pairs.
+    static bool parseWorkerArguments(int argc, char* argv[], WorkerArguments& arguments) {
+        std::unordered_map<std::string, std::string> values;
+        for (int i = 1; i < argc; i++) {
+            std::string name = argv[i];
+            if (name == workerFlag) continue;
+            if (name.compare(0, 2, "--") != 0 || i + 1 >= argc) return false;
+            values[name.substr(2)] = argv[++i];
+        }
+        
+        try {
+            arguments.timelinePath = values.at("timeline");
+            arguments.frameRate = std::stod(values.at("frame-rate"));
+            arguments.frameSize = cv::Size(std::stoi(values.at("width")), std::stoi(values.at("height")));
+            arguments.frameType = std::stoi(values.at("type"));
+            arguments.slots = std::stoi(values.at("slots"));
+            arguments.ringDescriptor = std::stoi(values.at("ring-fd"));
+            arguments.firstFrame = std::stoi(values.at("first"));
+            arguments.stride = std::stoi(values.at("stride"));
+            arguments.frameCount = std::stoi(values.at("count"));
+        } catch (const std::exception&) {
+            return false;
+        }
+        return arguments.frameRate > 0.0 && arguments.stride > 0 && arguments.ringDescriptor >= 0;
+    }
+    
+    // Renders the worker's frames into its ring. render must fill the frame
+    // it is given in place: it is a view of shared memory. Returns the
+    // process exit status.
+    static int serve(const WorkerArguments& arguments, const RenderFunction& render) {
+        SharedFrameRing ring;
+        if (!ring.attach(arguments.ringDescriptor, arguments.frameSize, arguments.frameType, arguments.slots)) {
+            return 2;
+        }
+        
+        try {
+            for (int frameNumber = arguments.firstFrame; frameNumber < arguments.frameCount;
+                 frameNumber += arguments.stride) {
+                cv::Mat slot = ring.acquire();
+                cv::Mat frame = slot;
+                render(frameNumber, frame);
+                if (frame.data != slot.data) {
+                    if (frame.size() != slot.size() || frame.type() != slot.type()) {
+                        return 2;
+                    }
+                    frame.copyTo(slot);
+                }
+                ring.publish(frameNumber);
+            }
+        } catch (...) {
+            return 1;
+        }
+        return 0;
+    }
+
+private:
+    struct Worker {
+        pid_t pid = -1;
+        int restarts = 0;
+        std::unique_ptr<SharedFrameRing> ring;
+    };
+    
+    int workerCount;
+    cv::Size frameSize;
+    int frameType;
+    int slotsPerWorker;
+    std::string executable;
+    WorkerArguments job;            // Shared by every worker of the running job
+    std::vector<Worker> workers;
+    std::string errorMessage;
+    
+    static std::atomic<bool>& entryPointRegistered() {
+        static std::atomic<bool> registered(false);
+        return registered;
+    }
+    
+    bool fail(const std::string& error) {
+        stopWorkers();
+        errorMessage = error;
+        LOG_ERROR(error);
+        return false;
+    }
+    
+    bool spawn(size_t index, int firstFrame) {
+        int ringDescriptor = workers[index].ring->getDescriptor();
+        char frameRate[32];
+        std::snprintf(frameRate, sizeof(frameRate), "%.17g", job.frameRate);
+        
+        // Everything the child needs is built before fork(): until exec it
+        // may only make async-signal-safe calls
+        std::vector<std::string> arguments = {
+            executable, workerFlag,
+            "--timeline", job.timelinePath,
+            "--frame-rate", frameRate,
+            "--width", std::to_string(job.frameSize.width),
+            "--height", std::to_string(job.frameSize.height),
+            "--type", std::to_string(job.frameType),
+            "--slots", std::to_string(job.slots),
+            "--ring-fd", std::to_string(ringDescriptor),
+            "--first", std::to_string(firstFrame),
+            "--stride", std::to_string(workers.size()),
+            "--count", std::to_string(job.frameCount)
+        };
+        std::vector<char*> argv;
+        for (auto& argument : arguments) {
+            argv.push_back(&argument[0]);
+        }
+        argv.push_back(nullptr);
+        
+        pid_t pid = fork();
+        if (pid < 0) return false;
+        if (pid == 0) {
+            // Only this worker's ring crosses exec
+            fcntl(ringDescriptor, F_SETFD, 0);
+            execv(argv[0], argv.data());
+            _exit(127);
+        }
+        
+        workers[index].pid = pid;
+        return true;
+    }
+    
+    // Reaps the worker if it has exited
+    bool workerExited(Worker& worker) {
+        if (worker.pid <= 0) return true;
+        int status = 0;
+        if (waitpid(worker.pid, &status, WNOHANG) != worker.pid) return false;
+        
+        if (WIFSIGNALED(status)) {
+            LOG_WARNING("Render worker " + std::to_string(worker.pid) + " killed by signal " +
+                        std::to_string(WTERMSIG(status)));
+        } else {
+            LOG_WARNING("Render worker " + std::to_string(worker.pid) + " exited with status " +
+                        std::to_string(WEXITSTATUS(status)));
+        }
+        worker.pid = -1;
+        return true;
+    }
+    
+    bool restart(size_t index, int nextFrame, bool stalled) {
+        Worker& worker = workers[index];
+        if (stalled) {
+            LOG_WARNING("Render worker " + std::to_string(worker.pid) + " stalled at frame " +
+                        std::to_string(nextFrame));
+        }
+        stopWorker(worker);
+        
+        if (++worker.restarts > maxRestarts) {
+            return fail("Render worker kept failing at frame " + std::to_string(nextFrame));
+        }
+        
+        // Frames the dead worker left in the ring are re-rendered from nextFrame on
+        LOG_INFO("Restarting render worker from frame " + std::to_string(nextFrame));
+        if (!worker.ring->reset()) {
+            return fail("Could not reset shared frame ring");
+        }
+        if (!spawn(index, nextFrame)) {
+            return fail("Could not restart render worker: " + std::string(strerror(errno)));
+        }
+        return true;
+    }
+    
+    void stopWorker(Worker& worker) {
+        if (worker.pid > 0) {
+            kill(worker.pid, SIGKILL);
+            waitpid(worker.pid, nullptr, 0);
+            worker.pid = -1;
+        }
+    }
+    
+    void stopWorkers() {
+        for (auto& worker : workers) {
+            stopWorker(worker);
+        }
+    }
+};
+
+// Read-only resources that effects derive from their parameters and the
+// frame size alone: vignette masks, LUTs, gradient ramps, noise textures.
+// Each is built once per key (effect, parameters, size) and shared by every
+// thread that renders with it. Entries are evicted least recently used
+// first once their footprint passes the memory budget; a resource stays
+// alive while a caller still holds it. Two threads missing the same key at
+// once may both build it, and the first one stored wins.
+class EffectResourceCache {
+public:
+    struct Stats {
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t evictions;
+        size_t entries;
+        size_t bytes;
+        size_t budget;
+    };
+    
+    explicit EffectResourceCache(size_t budgetBytes = 256 * 1024 * 1024)
+        : budget(budgetBytes), bytes(0), hits(0), misses(0), evictions(0) {}
+    
+    EffectResourceCache(const EffectResourceCache&) = delete;
+    EffectResourceCache& operator=(const EffectResourceCache&) = delete;
+    
+    static EffectResourceCache& shared() {
+        static EffectResourceCache cache;
+        return cache;
+    }
+    
+    template <typename Resource>
+    std::shared_ptr<const Resource> get(const std::string& key, const std::function<Resource()>& build) {
+        {
+            std::lock_guard<std::mutex> lock(cacheMutex);
+            auto it = index.find(key);
+            if (it != index.end() && it->second->type == std::type_index(typeid(Resource))) {
+                hits++;
+                entries.splice(entries.begin(), entries, it->second);
+                return std::static_pointer_cast<const Resource>(it->second->resource);
+            }
+            misses++;
+        }
+        
+        auto resource = std::make_shared<const Resource>(build());
+        size_t footprint = resourceBytes(*resource);
+        
+        std::lock_guard<std::mutex> lock(cacheMutex);
+        auto it = index.find(key);
+        if (it != index.end()) {
+            if (it->second->type == std::type_index(typeid(Resource))) {
+                entries.splice(entries.begin(), entries, it->second);
+                return std::static_pointer_cast<const Resource>(it->second->resource);
+            }
+            bytes -= it->second->bytes;
+            entries.erase(it->second);
+            index.erase(it);
+        }
+        
+        entries.push_front(Entry{key, std::type_index(typeid(Resource)), resource, footprint});
+        index[key] = entries.begin();
+        bytes += footprint;
+        trim();
+        return resource;
+    }
+    
+    void setBudget(size_t budgetBytes) {
+        std::lock_guard<std::mutex> lock(cacheMutex);
+        budget = budgetBytes;
+        trim();
+    }
+    
+    void clear() {
+        std::lock_guard<std::mutex> lock(cacheMutex);
+        entries.clear();
+        index.clear();
+        bytes = 0;
+    }
+    
+    Stats getStats() {
+        std::lock_guard<std::mutex> lock(cacheMutex);
+        return Stats{hits, misses, evictions, entries.size(), bytes, budget};
+    }
+    
+    // Footprints the budget is counted in
+    static size_t resourceBytes(const cv::Mat& mat) { return mat.total() * mat.elemSize(); }
+    template <typename Resource>
+    static size_t resourceBytes(const Resource& resource) { return resource.memoryFootprint(); }
+    
+private:
+    struct Entry {
+        std::string key;
+        std::type_index type;
+        std::shared_ptr<const void> resource;
+        size_t bytes;
+    };
+    
+    std::mutex cacheMutex;
+    std::list<Entry> entries;       // Most recently used first
+    std::unordered_map<std::string, std::list<Entry>::iterator> index;
+    size_t budget;
+    size_t bytes;
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    
+    // Callers hold cacheMutex
+    void trim() {
+        while (bytes > budget && !entries.empty()) {
+            bytes -= entries.back().bytes;
+            index.erase(entries.back().key);
+            entries.pop_back();
+            evictions++;
+        }
+    }
+};
+
+// 3D colour lookup table. A chain of per-pixel colour operations is baked
+// into a size^3 lattice once per parameter change, and frames then cost one
+// tetrahedral interpolation per pixel however many operations were stacked.
+// Tables also load from .cube files. apply() gathers lattice corners for a
+// whole SIMD register of pixels at a time with OpenCV universal intrinsics,
+// choosing each pixel's tetrahedron with compares and selects instead of
+// branches, and spreads rows over the shared pool.
+class ColorLUT {
+public:
+    // BGR in [0, 1] in and out
+    using ColorFunction = std::function<cv::Vec3f(const cv::Vec3f& bgr)>;
+    // An existing per-pixel CV_8UC3 operation; it must not look at neighbours
+    using FrameOperation = std::function<cv::Mat(const cv::Mat& frame)>;
+    
+    static constexpr int defaultSize = 33;
+    
+    ColorLUT() : size(0) {}
+    
+    // Bakes the functions, applied in order
+    static ColorLUT fromFunctions(const std::vector<ColorFunction>& chain, int size = defaultSize) {
+        ColorLUT lut;
+        lut.allocate(size);
+        const float step = 1.0f / (lut.size - 1);
+        for (int b = 0; b < lut.size; b++) {
+            for (int g = 0; g < lut.size; g++) {
+                for (int r = 0; r < lut.size; r++) {
+                    cv::Vec3f color(b * step, g * step, r * step);
+                    for (const auto& function : chain) {
+                        color = function(color);
+                    }
+                    lut.setNode(b, g, r, color * 255.0f);
+                }
+            }
+        }
+        lut.buildIndexTables();
+        return lut;
+    }
+    
+    // Bakes an 8-bit operation by running it once over an image of the
+    // lattice points, so the table reproduces it exactly at every node
+    static ColorLUT fromOperation(const FrameOperation& operation, int size = defaultSize) {
+        ColorLUT lut;
+        lut.allocate(size);
+        
+        cv::Mat lattice(lut.size * lut.size, lut.size, CV_8UC3);
+        for (int b = 0; b < lut.size; b++) {
+            for (int g = 0; g < lut.size; g++) {
+                cv::Vec3b* row = lattice.ptr<cv::Vec3b>(b * lut.size + g);
+                for (int r = 0; r < lut.size; r++) {
+                    row[r] = cv::Vec3b(lut.nodeValue(b), lut.nodeValue(g), lut.nodeValue(r));
+                }
+            }
+        }
+        
+        cv::Mat result = operation(lattice);
+        if (result.size() != lattice.size() || result.type() != CV_8UC3) {
+            lut.size = 0;
+            lut.errorMessage = "Colour operation changed the frame size or type";
+            return lut;
+        }
+        for (int b = 0; b < lut.size; b++) {
+            for (int g = 0; g < lut.size; g++) {
+                const cv::Vec3b* row = result.ptr<cv::Vec3b>(b * lut.size + g);
+                for (int r = 0; r < lut.size; r++) {
+                    lut.setNode(b, g, r, cv::Vec3f(row[r][0], row[r][1], row[r][2]));
+                }
+            }
+        }
+        lut.buildIndexTables();
+        return lut;
+    }
+    
+    // Adobe/Resolve .cube with a 3D table (LUT_3D_SIZE, optional DOMAIN_MIN
+    // and DOMAIN_MAX). 1D tables are not supported.
+    bool loadCube(const std::string& path) {
+        std::ifstream file(path);
+        if (!file) return fail("Cannot open LUT: " + path);
+        
+        int cubeSize = 0;
+        float domainLow[3] = {0.0f, 0.0f, 0.0f};   // File order: R G B
+        float domainHigh[3] = {1.0f, 1.0f, 1.0f};
+        std::vector<cv::Vec3f> entries;
+        
+        std::string line;
+        while (std::getline(file, line)) {
+            size_t start = line.find_first_not_of(" \t\r");
+            if (start == std::string::npos || line[start] == '#') continue;
+            std::istringstream fields(line.substr(start));
+            
+            if (std::isalpha(static_cast<unsigned char>(line[start]))) {
+                std::string keyword;
+                fields >> keyword;
+                if (keyword == "LUT_3D_SIZE") {
+                    fields >> cubeSize;
+                } else if (keyword == "DOMAIN_MIN") {
+                    fields >> domainLow[0] >> domainLow[1] >> domainLow[2];
+                } else if (keyword == "DOMAIN_MAX") {
+                    fields >> domainHigh[0] >> domainHigh[1] >> domainHigh[2];
+                } else if (keyword == "LUT_1D_SIZE") {
+                    return fail("1D LUTs are not supported: " + path);
+                }
+                // TITLE and unknown keywords are ignored
+                continue;
+            }
+            
+            float red, green, blue;
+            if (!(fields >> red >> green >> blue)) return fail("Malformed LUT entry in " + path + ": " + line);
+            entries.emplace_back(blue, green, red);
+        }
+        
+        if (cubeSize < 2 || cubeSize > 256) return fail("Missing or invalid LUT_3D_SIZE in " + path);
+        if (entries.size() != static_cast<size_t>(cubeSize) * cubeSize * cubeSize) {
+            return fail("LUT " + path + " has " + std::to_string(entries.size()) + " entries, expected " +
+                        std::to_string(cubeSize * cubeSize * cubeSize));
+        }
+        for (int c = 0; c < 3; c++) {
+            if (domainHigh[c] <= domainLow[c]) return fail("Invalid LUT domain in " + path);
+        }
+        
+        allocate(cubeSize);
+        // Red varies fastest in the file, as in the lattice
+        for (size_t i = 0; i < entries.size(); i++) {
+            for (int c = 0; c < 3; c++) {
+                planes[c][i] = entries[i][c] * 255.0f;
+            }
+        }
+        for (int c = 0; c < 3; c++) {
+            domainMin[c] = domainLow[2 - c];
+            domainMax[c] = domainHigh[2 - c];
+        }
+        buildIndexTables();
+        errorMessage.clear();
+        return true;
+    }
+    
+    // Baked tables live in the effect resource cache by key (effect and
+    // parameters), so a table is only baked when the parameters change
+    static std::shared_ptr<const ColorLUT> cached(const std::string& key, const std::function<ColorLUT()>& bake) {
+        return EffectResourceCache::shared().get<ColorLUT>("lut:" + key, bake);
+    }
+    
+    bool empty() const { return size == 0; }
+    int getSize() const { return size; }
+    size_t memoryFootprint() const { return sizeof(ColorLUT) + 3 * planes[0].size() * sizeof(float); }
+    std::string getError() const { return errorMessage; }
+    
+    // CV_8UC3 only; src and dst may be the same Mat
+    void apply(const cv::Mat& src, cv::Mat& dst) const {
+        CV_Assert(!empty() && src.type() == CV_8UC3);
+        dst.create(src.size(), src.type());
+        
+        const int grain = std::max(1, 16384 / std::max(1, src.cols));
+        FiberOpticThreading::shared().parallelFor(0, src.rows, grain, [&](int rowBegin, int rowEnd) {
+            for (int y = rowBegin; y < rowEnd; y++) {
+                applyRow(src.ptr<uchar>(y), dst.ptr<uchar>(y), src.cols);
+            }
+        });
+    }
+    
+    cv::Mat apply(const cv::Mat& src) const {
+        cv::Mat dst;
+        apply(src, dst);
+        return dst;
+    }
+    
+private:
+    int size;
+    std::vector<float> planes[3];   // Output B, G, R (0-255) per node; r + g*size + b*size^2
+    float domainMin[3];             // Input range per channel (BGR) mapped onto the lattice
+    float domainMax[3];
+    int cornerOffset[256][3];       // Per input value and channel: lower node, times the channel's stride
+    float cornerWeight[256][3];     // Per input value and channel: position between the two nodes
+    std::string errorMessage;
+    
+    bool fail(const std::string& error) {
+        errorMessage = error;
+        LOG_ERROR(error);
+        return false;
+    }
+    
+    void allocate(int latticeSize) {
+        size = std::max(2, std::min(256, latticeSize));
+        for (int c = 0; c < 3; c++) {
+            planes[c].assign(static_cast<size_t>(size) * size * size, 0.0f);
+            domainMin[c] = 0.0f;
+            domainMax[c] = 1.0f;
+        }
+    }
+    
+    uchar nodeValue(int index) const {
+        return cv::saturate_cast<uchar>(index * 255.0f / (size - 1));
+    }
+    
+    void setNode(int b, int g, int r, const cv::Vec3f& bgr) {
+        size_t index = (static_cast<size_t>(b) * size + g) * size + r;
+        for (int c = 0; c < 3; c++) {
+            planes[c][index] = bgr[c];
+        }
+    }
+    
+    void buildIndexTables() {
+        const int strides[3] = {size * size, size, 1};
+        for (int c = 0; c < 3; c++) {
+            for (int value = 0; value < 256; value++) {
+                float position = (value / 255.0f - domainMin[c]) / (domainMax[c] - domainMin[c]);
+                position = std::min(1.0f, std::max(0.0f, position)) * (size - 1);
+                int lower = std::min(static_cast<int>(position), size - 2);
+                cornerOffset[value][c] = lower * strides[c];
+                cornerWeight[value][c] = position - lower;
+            }
+        }
+    }
+    
+    // Tetrahedral interpolation. With the fractions sorted x >= y >= z, the
+    // result is (1-x)*c000 + (x-y)*c1 + (y-z)*c2 + z*c111, where c1 steps
+    // along the largest axis and c2 along the two largest.
+    void applyRow(const uchar* src, uchar* dst, int width) const {
+        const int strideB = size * size;
+        const int strideG = size;
+        const int strideR = 1;
+        const int far = strideB + strideG + strideR;
+        int x = 0;
+        
+#if CV_SIMD
+        const int lanes = cv::v_float32::nlanes;
+        const cv::v_float32 one = cv::vx_setall_f32(1.0f);
+        const cv::v_int32 stepB = cv::vx_setall_s32(strideB);
+        const cv::v_int32 stepG = cv::vx_setall_s32(strideG);
+        const cv::v_int32 stepR = cv::vx_setall_s32(strideR);
+        const cv::v_int32 stepFar = cv::vx_setall_s32(far);
+        const int* offsets = &cornerOffset[0][0];
+        const float* weights = &cornerWeight[0][0];
+        int laneIndex[3][CV_SIMD_WIDTH / sizeof(float)];
+        int laneResult[3][CV_SIMD_WIDTH / sizeof(float)];
+        
+        for (; x <= width - lanes; x += lanes) {
+            for (int i = 0; i < lanes; i++) {
+                for (int c = 0; c < 3; c++) {
+                    laneIndex[c][i] = src[(x + i) * 3 + c] * 3 + c;
+                }
+            }
+            cv::v_int32 indexB = cv::vx_load(laneIndex[0]);
+            cv::v_int32 indexG = cv::vx_load(laneIndex[1]);
+            cv::v_int32 indexR = cv::vx_load(laneIndex[2]);
+            
+            cv::v_int32 base = cv::v_lut(offsets, indexB) + cv::v_lut(offsets, indexG) + cv::v_lut(offsets, indexR);
+            cv::v_float32 fb = cv::v_lut(weights, indexB);
+            cv::v_float32 fg = cv::v_lut(weights, indexG);
+            cv::v_float32 fr = cv::v_lut(weights, indexR);
+            
+            cv::v_int32 redLargest = cv::v_reinterpret_as_s32((fr >= fg) & (fr >= fb));
+            cv::v_int32 redSmallest = cv::v_reinterpret_as_s32((fr <= fg) & (fr <= fb));
+            cv::v_int32 greenOverBlue = cv::v_reinterpret_as_s32(fg >= fb);
+            cv::v_int32 greenUnderBlue = cv::v_reinterpret_as_s32(fg <= fb);
+            cv::v_int32 first = base + cv::v_select(redLargest, stepR, cv::v_select(greenOverBlue, stepG, stepB));
+            cv::v_int32 second = base + stepFar -
+                cv::v_select(redSmallest, stepR, cv::v_select(greenUnderBlue, stepG, stepB));
+            cv::v_int32 last = base + stepFar;
+            
+            cv::v_float32 largest = cv::v_max(fr, cv::v_max(fg, fb));
+            cv::v_float32 smallest = cv::v_min(fr, cv::v_min(fg, fb));
+            cv::v_float32 middle = fr + fg + fb - largest - smallest;
+            cv::v_float32 w0 = one - largest;
+            cv::v_float32 w1 = largest - middle;
+            cv::v_float32 w2 = middle - smallest;
+            
+            for (int c = 0; c < 3; c++) {
+                const float* plane = planes[c].data();
+                cv::v_float32 value = w0 * cv::v_lut(plane, base) + w1 * cv::v_lut(plane, first) +
+                                      w2 * cv::v_lut(plane, second) + smallest * cv::v_lut(plane, last);
+                cv::v_store(laneResult[c], cv::v_round(value));
+            }
+            for (int i = 0; i < lanes; i++) {
+                for (int c = 0; c < 3; c++) {
+                    dst[(x + i) * 3 + c] = cv::saturate_cast<uchar>(laneResult[c][i]);
+                }
+            }
+        }
+#endif
+        
+        // Same arithmetic, one pixel at a time
+        for (; x < width; x++) {
+            const uchar* pixel = src + x * 3;
+            int base = cornerOffset[pixel[0]][0] + cornerOffset[pixel[1]][1] + cornerOffset[pixel[2]][2];
+            float fb = cornerWeight[pixel[0]][0];
+            float fg = cornerWeight[pixel[1]][1];
+            float fr = cornerWeight[pixel[2]][2];
+            
+            int first = base + ((fr >= fg && fr >= fb) ? strideR : (fg >= fb ? strideG : strideB));
+            int second = base + far - ((fr <= fg && fr <= fb) ? strideR : (fg <= fb ? strideG : strideB));
+            int last = base + far;
+            
+            float largest = std::max(fr, std::max(fg, fb));
+            float smallest = std::min(fr, std::min(fg, fb));
+            float middle = fr + fg + fb - largest - smallest;
+            float w0 = 1.0f - largest;
+            float w1 = largest - middle;
+            float w2 = middle - smallest;
+            
+            for (int c = 0; c < 3; c++) {
+                const float* plane = planes[c].data();
+                float value = w0 * plane[base] + w1 * plane[first] + w2 * plane[second] + smallest * plane[last];
+                dst[x * 3 + c] = cv::saturate_cast<uchar>(cvRound(value));
+            }
+        }
+    }
+};
+
+// Blur whose cost per pixel does not depend on the radius. A Gaussian of
+// the requested sigma is approximated by `passes` box blurs of matched
+// widths. Each box is a running sum, so one more pixel of radius is
+// free. Horizontal passes run over row bands and vertical passes over
+// column bands of the shared pool. The vertical pass adds whole rows into
+// per-column accumulators across SIMD lanes. Glow blurs a downsampled copy
+// (a pyramid level picked from the radius) and scales it back up.
+//
+// passes is the quality/speed knob: 1 is a plain box blur, 3 is
+// indistinguishable from a Gaussian for video, 4 is closer still.
+class FastBlur {
+public:
+    static constexpr int defaultPasses = 3;
+    
+    // sigma in pixels; 8-bit frames of any channel count
+    static void gaussian(const cv::Mat& src, cv::Mat& dst, float sigma, int passes = defaultPasses) {
+        if (sigma < 2.0f) {
+            // Small kernels are cheap as they are and boxes approximate them poorly
+            if (sigma <= 0.0f) {
+                src.copyTo(dst);
+            } else {
+                cv::GaussianBlur(src, dst, cv::Size(0, 0), sigma);
+            }
+            return;
+        }
+        
+        passes = std::max(1, std::min(4, passes));
+        cv::Mat buffer, scratch;
+        src.convertTo(buffer, CV_MAKETYPE(CV_32F, src.channels()));
+        scratch.create(buffer.size(), buffer.type());
+        
+        for (int radius : boxRadii(sigma, passes)) {
+            boxHorizontal(buffer, scratch, radius);
+            boxVertical(scratch, buffer, radius);
+        }
+        buffer.convertTo(dst, src.type());
+    }
+    
+    static cv::Mat gaussian(const cv::Mat& src, float sigma, int passes = defaultPasses) {
+        cv::Mat dst;
+        gaussian(src, dst, sigma, passes);
+        return dst;
+    }
+    
+    // Adds intensity times a blurred copy of sigma = radius to the frame.
+    // The blur runs on a level of a 2x pyramid small enough that the level's
+    // radius stays near 2 * passes pixels.
+    static cv::Mat glow(const cv::Mat& src, float intensity, float radius, int passes = defaultPasses) {
+        passes = std::max(1, std::min(4, passes));
+        int levels = 0;
+        while (radius / (1 << (levels + 1)) >= 2.0f * passes &&
+               (src.cols >> (levels + 1)) >= 16 && (src.rows >> (levels + 1)) >= 16) {
+            levels++;
+        }
+        
+        cv::Mat halo;
+        if (levels == 0) {
+            gaussian(src, halo, radius, passes);
+        } else {
+            const float scale = 1.0f / (1 << levels);
+            cv::Mat small;
+            cv::resize(src, small, cv::Size(), scale, scale, cv::INTER_AREA);
+            gaussian(small, small, radius * scale, passes);
+            cv::resize(small, halo, src.size(), 0, 0, cv::INTER_LINEAR);
+        }
+        
+        cv::Mat result;
+        cv::addWeighted(src, 1.0, halo, intensity, 0.0, result);
+        return result;
+    }
+    
+    // Sigma OpenCV derives for an n x n GaussianBlur kernel
+    static float sigmaForKernel(int kernelSize) {
+        return 0.3f * ((kernelSize - 1) * 0.5f - 1.0f) + 0.8f;
+    }
+    
+private:
+    // Box radii whose stacked variance matches sigma^2 (Kovesi's widths:
+    // m boxes of the lower odd width, the rest two wider)
+    static std::vector<int> boxRadii(float sigma, int passes) {
+        float ideal = std::sqrt(12.0f * sigma * sigma / passes + 1.0f);
+        int lower = static_cast<int>(std::floor(ideal));
+        if (lower % 2 == 0) lower--;
+        int upper = lower + 2;
+        int lowerCount = cvRound((12.0f * sigma * sigma - passes * lower * lower - 4.0f * passes * lower - 3.0f * passes) /
+                                 (-4.0f * lower - 4.0f));
+        
+        std::vector<int> radii;
+        for (int i = 0; i < passes; i++) {
+            radii.push_back(((i < lowerCount ? lower : upper) - 1) / 2);
+        }
+        return radii;
+    }
+    
+    // Edge pixels repeat beyond the border
+    static void boxHorizontal(const cv::Mat& src, cv::Mat& dst, int radius) {
+        const int width = src.cols;
+        const int channels = src.channels();
+        const float scale = 1.0f / (2 * radius + 1);
+        
+        FiberOpticThreading::shared().parallelFor(0, src.rows, 16, [&](int rowBegin, int rowEnd) {
+            for (int y = rowBegin; y < rowEnd; y++) {
+                const float* in = src.ptr<float>(y);
+                float* out = dst.ptr<float>(y);
+                for (int c = 0; c < channels; c++) {
+                    float sum = in[c] * (radius + 1);
+                    for (int i = 1; i <= radius; i++) {
+                        sum += in[std::min(i, width - 1) * channels + c];
+                    }
+                    for (int x = 0; x < width; x++) {
+                        out[x * channels + c] = sum * scale;
+                        sum += in[std::min(x + radius + 1, width - 1) * channels + c] -
+                               in[std::max(x - radius, 0) * channels + c];
+                    }
+                }
+            }
+        });
+    }
+    
+    static void boxVertical(const cv::Mat& src, cv::Mat& dst, int radius) {
+        const int height = src.rows;
+        const int rowLength = src.cols * src.channels();
+        const float scale = 1.0f / (2 * radius + 1);
+        const int band = 1024;
+        
+        FiberOpticThreading::shared().parallelFor(0, (rowLength + band - 1) / band, 1, [&](int bandBegin, int bandEnd) {
+            std::vector<float> sums(band);
+            for (int b = bandBegin; b < bandEnd; b++) {
+                const int start = b * band;
+                const int length = std::min(band, rowLength - start);
+                
+                const float* first = src.ptr<float>(0) + start;
+                for (int i = 0; i < length; i++) {
+                    sums[i] = first[i] * (radius + 1);
+                }
+                for (int y = 1; y <= radius; y++) {
+                    addRow(sums.data(), src.ptr<float>(std::min(y, height - 1)) + start, nullptr, length);
+                }
+                
+                for (int y = 0; y < height; y++) {
+                    float* out = dst.ptr<float>(y) + start;
+                    for (int i = 0; i < length; i++) {
+                        out[i] = sums[i] * scale;
+                    }
+                    addRow(sums.data(), src.ptr<float>(std::min(y + radius + 1, height - 1)) + start,
+                           src.ptr<float>(std::max(y - radius, 0)) + start, length);
+                }
+            }
+        });
+    }
+    
+    // sums += entering (- leaving)
+    static void addRow(float* sums, const float* entering, const float* leaving, int length) {
+        int i = 0;
+#if CV_SIMD
+        const int lanes = cv::v_float32::nlanes;
+        if (leaving) {
+            for (; i <= length - lanes; i += lanes) {
+                cv::v_store(sums + i, cv::vx_load(sums + i) + cv::vx_load(entering + i) - cv::vx_load(leaving + i));
+            }
+        } else {
+            for (; i <= length - lanes; i += lanes) {
+                cv::v_store(sums + i, cv::vx_load(sums + i) + cv::vx_load(entering + i));
+            }
+        }
+#endif
+        for (; i < length; i++) {
+            sums[i] += entering[i] - (leaving ? leaving[i] : 0.0f);
+        }
+    }
+};
+
+// Render engine for final video export
+class RenderEngine {
+public:
+    struct ExportSettings {
+        std::string outputPath;
+        std::string videoCodec;
+        std::string audioCodec;
+        int width;
+        int height;
+        double frameRate;
+        int videoBitrate;
+        int audioBitrate;
+        int audioSampleRate;
+        std::string preset;
+        int crf;
+        std::string pixelFormat;
+        bool hardwareAcceleration;
+        bool isolatedWorkers;   // Render in supervised worker processes
+        int workerProcesses;    // 0 = one per core, at most 4
+        
+        ExportSettings() : videoCodec("libx264"), audioCodec("aac"), width(1920), height(1080), 
+                         frameRate(30.0), videoBitrate(10000000), audioBitrate(192000), 
+                         audioSampleRate(44100), preset("medium"), crf(23), 
+                         pixelFormat("yuv420p"), hardwareAcceleration(true),
+                         isolatedWorkers(false), workerProcesses(0) {}
+    };
+    
+    struct RenderProgress {
+        int currentFrame;
+        int totalFrames;
+        double percentage;
+        double estimatedTimeRemaining;
+        std::string currentOperation;
+        bool isComplete;
+        bool hasError;
+        std::string errorMessage;
+        
+        RenderProgress() : currentFrame(0), totalFrames(0), percentage(0.0), 
+                         estimatedTimeRemaining(0.0), isComplete(false), hasError(false) {}
+    };
+    
+private:
+    VideoEngine videoEngine;
+    AudioEngine audioEngine;
+    EffectProcessor effectProcessor;
+    EffectResourceCache& effectResources;   // Process-wide, shared with the SI generators
+    std::atomic<bool> shouldCancel;
+    std::atomic<bool> exporting;            // One export at a time: progressState has a single writer
+    ProgressSeqlock progressState;
+    mutable std::mutex errorMutex;
+    std::string errorMessage;
+    std::function<void(const RenderProgress&)> progressCallback;
+    
+public:
+    RenderEngine() : effectResources(EffectResourceCache::shared()), shouldCancel(false), exporting(false) {
+        LOG_DEBUG("RenderEngine initialized");
+    }
+    
+    ~RenderEngine() {
+        LOG_DEBUG("RenderEngine destroyed");
+    }
+    
+    void setProgressCallback(std::function<void(const RenderProgress&)> callback) {
+        progressCallback = callback;
+    }
+    
+    // Entry point of a `--render-worker` process started by RenderWorkerPool.
+    // The embedding main() must call it before anything else when argv[1] is
+    // RenderWorkerPool::workerFlag, and register it with
+    // RenderWorkerPool::registerEntryPoint(). Returns the process exit status.
+    static int runRenderWorker(int argc, char* argv[]) {
+        RenderWorkerPool::WorkerArguments arguments;
+        if (!RenderWorkerPool::parseWorkerArguments(argc, argv, arguments)) {
+            LOG_ERROR("Invalid render worker arguments");
+            return 2;
+        }
+        
+        // One thread per worker process; the exporter runs several of them
+        FiberOpticThreading::runInline();
+        cv::setNumThreads(0);
+        
+        ProjectManager::BinaryContainer job;
+        Timeline timeline;
+        if (!job.open(arguments.timelinePath) || !job.readTimeline(timeline)) {
+            LOG_ERROR("Could not read render job: " + arguments.timelinePath);
+            return 2;
+        }
+        
+        RenderEngine engine;
+        double frameDuration = 1.0 / arguments.frameRate;
+        return RenderWorkerPool::serve(arguments, [&](int frameNumber, cv::Mat& frame) {
+            engine.renderVideoFrame(timeline, frameNumber * frameDuration, frame.cols, frame.rows).copyTo(frame);
+        });
+    }
+    
+    // Returns false without touching the running export's progress when
+    // another export is still in progress
+    bool exportVideo(const Timeline& timeline, const ExportSettings& settings) {
+        bool idle = false;
+        if (!exporting.compare_exchange_strong(idle, true)) {
+            LOG_WARNING("Export already in progress, not starting: " + settings.outputPath);
+            return false;
+        }
+        struct ExportSlot {
+            std::atomic<bool>& flag;
+            ~ExportSlot() { flag = false; }
+        } slot{exporting};
+        
+        LOG_INFO("Starting video export to: " + settings.outputPath);
+        
+        shouldCancel = false;
+        {
+            std::lock_guard<std::mutex> lock(errorMutex);
+            errorMessage.clear();
+        }
+        updateProgress(ProgressSeqlock::Phase::Initializing, 0, 0, 0.0);
+        
+        if (settings.isolatedWorkers && !RenderWorkerPool::hasEntryPoint()) {
+            setError("isolatedWorkers needs the render worker entry point, which this build does not register");
+            return false;
+        }
+        
+        FrameSink sink(toSinkSettings(settings));
+        if (!sink.open()) {
+            setError(sink.getError());
+            return false;
+        }
+        
+        // Calculate frame information
+        double frameDuration = 1.0 / settings.frameRate;
+        int totalFrames = static_cast<int>(timeline.duration * settings.frameRate);
+        
+        updateProgress(ProgressSeqlock::Phase::Rendering, 0, totalFrames, 0.0);
+        
+        auto startTime = std::chrono::steady_clock::now();
+        
+        // Frames are committed to the sink in order. Audio is mixed at commit
+        // time, since the sink's audio FIFO must be fed sequentially.
+        auto commitFrame = [&](int frameNumber, const cv::Mat& frame) {
+            double currentTime = frameNumber * frameDuration;
+            
+            if (!frame.empty() && !sink.writeFrame(frame)) {
+                throw std::runtime_error("Error writing video frame " + std::to_string(frameNumber) + ": " + sink.getError());
+            }
+            
+            std::vector<float> audioSamples = renderAudioSamples(timeline, currentTime, frameDuration, settings.audioSampleRate);
+            if (!audioSamples.empty() && !sink.writeAudio(audioSamples)) {
+                throw std::runtime_error("Error writing audio samples for frame " + std::to_string(frameNumber) + ": " + sink.getError());
+            }
+            
+            // Update progress
+            auto elapsed = std::chrono::steady_clock::now() - startTime;
+            double elapsedSeconds = std::chrono::duration<double>(elapsed).count();
+            double estimatedTotal = elapsedSeconds * totalFrames / (frameNumber + 1);
+            double remaining = estimatedTotal - elapsedSeconds;
+            
+            updateProgress(ProgressSeqlock::Phase::Rendering, frameNumber + 1, totalFrames, remaining);
+        };
+        auto renderFrame = [&](int frameNumber) {
+            return renderVideoFrame(timeline, frameNumber * frameDuration, settings.width, settings.height);
+        };
+        auto cancelRequested = [this]() { return shouldCancel.load(); };
+        
+        try {
+            if (settings.isolatedWorkers) {
+                // Decoding and effects run in worker processes; a crash there
+                // restarts the worker instead of taking down the server
+                int processes = settings.workerProcesses > 0 ? settings.workerProcesses :
+                    static_cast<int>(std::min(4u, std::max(1u, std::thread::hardware_concurrency())));
+                RenderWorkerPool workers(processes, cv::Size(settings.width, settings.height), CV_8UC3);
+                bool rendered = workers.run(timeline, settings.frameRate, totalFrames, commitFrame, cancelRequested);
+                if (!rendered && !shouldCancel) {
+                    throw std::runtime_error(workers.getError());
+                }
+            } else {
+                // Frames render in parallel on the shared scheduler
+                FiberOpticThreading& scheduler = FiberOpticThreading::shared();
+                OrderedSink<cv::Mat> frames(scheduler, static_cast<int>(scheduler.workerCount()) * 2, commitFrame);
+                frames.run(totalFrames, renderFrame, cancelRequested);
+            }
+        } catch (const std::exception& e) {
+            setError(e.what());
+            sink.abort();
+            return false;
+        }
+        
+        if (shouldCancel) {
+            updateProgress(ProgressSeqlock::Phase::Cancelled, 0, 0, 0.0);
+            sink.abort();
+            // Remove incomplete file
+            std::remove(settings.outputPath.c_str());
+            return false;
+        }
+        
+        updateProgress(ProgressSeqlock::Phase::Finalizing, totalFrames, totalFrames, 0.0);
+        
+        // Drain the encode thread, flush encoders and write the trailer
+        if (!sink.close()) {
+            setError("Error finishing export: " + sink.getError());
+            return false;
+        }
+        
+        updateProgress(ProgressSeqlock::Phase::Complete, totalFrames, totalFrames, 0.0);
+        
+        LOG_INFO("Video export completed successfully: " + settings.outputPath);
+        return true;
+    }
+    
+    bool isExporting() const { return exporting; }
+    
+    void cancelExport() {
+        shouldCancel = true;
+        LOG_INFO("Export cancellation requested");
+    }
+    
+    RenderProgress getProgress() const {
+        return toRenderProgress(progressState.read());
+    }
+    
+    // Changes whenever the render loop publishes; used to skip redundant pushes
+    uint32_t getProgressSequence() const {
+        return progressState.getSequence();
+    }
+    
+private:
+    // Hot path: called once per frame, so it only publishes numbers. The
+    // callback fires on phase transitions; per-frame consumers read the snapshot.
+    void updateProgress(ProgressSeqlock::Phase phase, int frame, int total, double remaining) {
+        ProgressSeqlock::Phase previous = progressState.read().phase;
+        progressState.publish(phase, frame, total, remaining);
+        
+        if (progressCallback && phase != previous) {
+            progressCallback(getProgress());
+        }
+    }
+    
+    void setError(const std::string& error) {
+        {
+            std::lock_guard<std::mutex> lock(errorMutex);
+            errorMessage = error;
+        }
+        ProgressSeqlock::Snapshot snapshot = progressState.read();
+        progressState.publish(ProgressSeqlock::Phase::Failed, snapshot.currentFrame,
+                              snapshot.totalFrames, 0.0);
+        LOG_ERROR(error);
+    }
+    
+    RenderProgress toRenderProgress(const ProgressSeqlock::Snapshot& snapshot) const {
+        RenderProgress progress;
+        progress.currentFrame = snapshot.currentFrame;
+        progress.totalFrames = snapshot.totalFrames;
+        progress.percentage = snapshot.totalFrames > 0 ?
+            (static_cast<double>(snapshot.currentFrame) / snapshot.totalFrames) * 100.0 : 0.0;
+        progress.estimatedTimeRemaining = snapshot.estimatedTimeRemaining;
+        progress.isComplete = snapshot.phase == ProgressSeqlock::Phase::Complete;
+        progress.hasError = snapshot.phase == ProgressSeqlock::Phase::Failed;
+        
+        switch (snapshot.phase) {
+            case ProgressSeqlock::Phase::Idle:
+                progress.currentOperation = "Idle";
+                break;
+            case ProgressSeqlock::Phase::Initializing:
+                progress.currentOperation = "Initializing export...";
+                break;
+            case ProgressSeqlock::Phase::Rendering:
+                progress.currentOperation = snapshot.currentFrame > 0 ?
+                    "Rendering frame " + std::to_string(snapshot.currentFrame) + "/" +
+                        std::to_string(snapshot.totalFrames) :
+                    "Rendering frames...";
+                break;
+            case ProgressSeqlock::Phase::Finalizing:
+                progress.currentOperation = "Finalizing export...";
+                break;
+            case ProgressSeqlock::Phase::Complete:
+                progress.currentOperation = "Export complete!";
+                break;
+            case ProgressSeqlock::Phase::Cancelled:
+                progress.currentOperation = "Export cancelled";
+                break;
+            case ProgressSeqlock::Phase::Failed:
+                progress.currentOperation = "Export failed";
+                break;
+        }
+        
+        if (progress.hasError) {
+            std::lock_guard<std::mutex> lock(errorMutex);
+            progress.errorMessage = errorMessage;
+        }
+        
+        return progress;
+    }
+    
+    // Sigma of the Gaussian over a kernel reaching radius pixels each way
+    static float sigmaForRadius(float radius) {
+        return FastBlur::sigmaForKernel(2 * std::max(1, cvRound(radius)) + 1);
+    }
+    
+    float getParam(const std::unordered_map<std::string, float>& params, 
+                   const std::string& key, float defaultValue) {
+        auto it = params.find(key);
+        return it != params.end() ? it->second : defaultValue;
+    }
+    
+    static FrameSink::Settings toSinkSettings(const ExportSettings& settings) {
+        FrameSink::Settings sinkSettings(settings.outputPath, cv::Size(settings.width, settings.height),
+                                         settings.frameRate);
+        sinkSettings.videoCodec = settings.videoCodec;
+        sinkSettings.audioCodec = settings.audioCodec;
+        sinkSettings.videoBitrate = settings.videoBitrate;
+        sinkSettings.audioBitrate = settings.audioBitrate;
+        sinkSettings.audioSampleRate = settings.audioSampleRate;
+        sinkSettings.preset = settings.preset;
+        sinkSettings.crf = settings.crf;
+        sinkSettings.pixelFormat = settings.pixelFormat;
+        sinkSettings.hardwareAcceleration = settings.hardwareAcceleration;
+        sinkSettings.enableAudio = true;
+        return sinkSettings;
+    }
+    
+    cv::Mat renderVideoFrame(const Timeline& timeline, double currentTime, int width, int height) {
+        cv::Mat compositeFrame = cv::Mat::zeros(height, width, CV_8UC3);
+        
+        // Sort clips by track index for proper layering
+        auto sortedClips = timeline.videoTracks;
+        std::sort(sortedClips.begin(), sortedClips.end(),
+            [](const std::shared_ptr<VideoClip>& a, const std::shared_ptr<VideoClip>& b) {
+                return a->trackIndex < b->trackIndex;
+            });
+        
+        // Process each video track
+        for (const auto& clip : sortedClips) {
+            if (!clip->enabled) continue;
+            
+            if (currentTime >= clip->startTime && 
+                currentTime < clip->startTime + clip->duration) {
+                
+                double clipTime = currentTime - clip->startTime + clip->inPoint;
+                
+                // Load frame from video file
+                VideoEngine engine;
+                if (engine.loadVideo(clip->filePath)) {
+                    cv::Mat frame = engine.getFrameAt(clipTime);
+                    
+                    if (!frame.empty()) {
+                        // Resize frame to timeline dimensions
+                        cv::resize(frame, frame, cv::Size(width, height));
+                        
+                        // Apply effects
+                        for (const auto& effectName : clip->effects) {
+                            frame = applyVideoEffect(frame, effectName, clip->properties);
+                        }
+                        
+                        // Apply opacity and composite
+                        if (clip->opacity < 1.0f) {
+                            cv::Mat temp;
+                            cv::addWeighted(compositeFrame, 1.0f - clip->opacity, frame, clip->opacity, 0, temp);
+                            compositeFrame = temp;
+                        } else {
+                            frame.copyTo(compositeFrame);
+                        }
+                    }
+                }
+            }
+        }
+        
+        return compositeFrame;
+    }
+    
+    std::vector<float> renderAudioSamples(const Timeline& timeline, double currentTime, 
+                                        double duration, int sampleRate) {
+        int sampleCount = static_cast<int>(duration * sampleRate);
+        std::vector<float> mixedAudio(sampleCount * 2, 0.0f); // Stereo
+        
+        // Process each audio track
+        for (const auto& clip : timeline.audioTracks) {
+            if (!clip->enabled || clip->muted) continue;
+            
+            if (currentTime >= clip->startTime && 
+                currentTime < clip->startTime + clip->duration) {
+                
+                double clipTime = currentTime - clip->startTime;
+                int startSample = static_cast<int>(clipTime * sampleRate);
+                
+                // Extract samples from waveform (assuming mono input)
+                for (int i = 0; i < sampleCount && startSample + i < clip->waveform.size(); i++) {
+                    float sample = clip->waveform[startSample + i] * clip->volume;
+                    
+                    // Convert mono to stereo
+                    mixedAudio[i * 2] += sample;     // Left channel
+                    mixedAudio[i * 2 + 1] += sample; // Right channel
+                }
+            }
+        }
+        
+        // Normalize to prevent clipping
+        float maxSample = 0.0f;
+        for (float sample : mixedAudio) {
+            maxSample = std::max(maxSample, std::abs(sample));
+        }
+        
+        if (maxSample > 1.0f) {
+            for (float& sample : mixedAudio) {
+                sample /= maxSample;
+            }
+        }
+        
+        return mixedAudio;
+    }
+    
+    cv::Mat applyVideoEffect(const cv::Mat& frame, const std::string& effectName, 
+                           const std::unordered_map<std::string, float>& params) {
+        if (effectName == "color_correction") {
+            float brightness = getParam(params, "brightness", 0.0f);
+            float contrast = getParam(params, "contrast", 1.0f);
+            float saturation = getParam(params, "saturation", 1.0f);
+            float hue = getParam(params, "hue", 0.0f);
+            if (frame.type() != CV_8UC3) {
+                return EffectProcessor::applyColorCorrection(frame, brightness, contrast, saturation, hue);
+            }
+            
+            // Per-pixel, so baked into a LUT once per parameter set
+            std::string key = "color_correction:" + std::to_string(brightness) + "," + std::to_string(contrast) +
+                              "," + std::to_string(saturation) + "," + std::to_string(hue);
+            auto lut = ColorLUT::cached(key, [=]() {
+                return ColorLUT::fromOperation([=](const cv::Mat& lattice) {
+                    return EffectProcessor::applyColorCorrection(lattice, brightness, contrast, saturation, hue);
+                });
+            });
+            return lut->apply(frame);
+        } else if (effectName == "blur") {
+            // FastBlur, whose cost does not grow with the radius. "strength"
+            // keeps its meaning as the kernel radius, i.e. a (2 * strength + 1)
+            // wide Gaussian with the sigma OpenCV gives that kernel; "sigma"
+            // sets the sigma directly. quality is the number of box passes
+            // (1 fastest, 4 closest to a true Gaussian); "exact" = 1 opts out
+            // to EffectProcessor's direct convolution.
+            float strength = getParam(params, "strength", 5.0f);
+            if (getParam(params, "exact", 0.0f) != 0.0f) {
+                return EffectProcessor::applyBlur(frame, strength, "gaussian");
+            }
+            float sigma = getParam(params, "sigma", sigmaForRadius(strength));
+            int quality = static_cast<int>(getParam(params, "quality", FastBlur::defaultPasses));
+            return FastBlur::gaussian(frame, sigma, quality);
+        } else if (effectName == "glow") {
+            // Same mapping as blur: "radius" is the halo's kernel radius,
+            // "sigma" overrides it and "exact" = 1 keeps EffectProcessor's glow
+            float intensity = getParam(params, "intensity", 0.5f);
+            float radius = getParam(params, "radius", 10.0f);
+            if (getParam(params, "exact", 0.0f) != 0.0f) {
+                return EffectProcessor::applyGlow(frame, intensity, radius);
+            }
+            float sigma = getParam(params, "sigma", sigmaForRadius(radius));
+            int quality = static_cast<int>(getParam(params, "quality", FastBlur::defaultPasses));
+            return FastBlur::glow(frame, intensity, sigma, quality);
+        } else if (effectName == "vignette") {
+            float strength = getParam(params, "strength", 0.5f);
+            if (frame.depth() != CV_8U) {
+                return EffectProcessor::applyVignette(frame, strength);
+            }
+            
+            // The mask depends only on the strength and the frame's shape
+            std::string key = "vignette:" + std::to_string(strength) + ":" + std::to_string(frame.cols) + "x" +
+                              std::to_string(frame.rows) + "x" + std::to_string(frame.channels());
+            auto mask = effectResources.get<cv::Mat>(key, [&]() {
+                return vignetteMask(frame.size(), frame.channels(), strength);
+            });
+            if (mask->empty()) {
+                return EffectProcessor::applyVignette(frame, strength);
+            }
+            cv::Mat result;
+            cv::multiply(frame, *mask, result, 1.0 / 255.0);
+            return result;
+        }
+        
+        return frame; // No effect applied
+    }
+    
+    // 8-bit gain (255 = unchanged) per pixel and channel. It is
+    // applyVignette's own falloff, taken by running it once over a white
+    // frame, so the cached path matches the direct one to within rounding.
+    // Alpha is never darkened. Empty if applyVignette changed the shape.
+    static cv::Mat vignetteMask(cv::Size size, int channels, float strength) {
+        cv::Mat white(size, CV_8UC(channels), cv::Scalar::all(255));
+        cv::Mat mask = EffectProcessor::applyVignette(white, strength);
+        if (mask.size() != size || mask.type() != white.type()) {
+            return cv::Mat();
+        }
+        if (channels == 4) {
+            cv::Mat alpha(size, CV_8UC1, cv::Scalar(255));
+            int fromTo[] = {0, 3};
+            cv::mixChannels(&alpha, 1, &mask, 1, fromTo, 1);
+        }
+        return mask;
+    }
+};
+
+// SI Model for Video Generation and Effects
+class SyntheticIntelligence {
+public:
+    SyntheticIntelligence() {
+        LOG_INFO("SyntheticIntelligence initialized");
+    }
+
+    // Generate a video frame procedurally
+    cv::Mat generateFrame(int width, int height, double time) {
+        cv::Mat frame(height, width, CV_8UC3, cv::Scalar(0, 0, 0));
+
+        // Example: Procedural pattern using sine waves
+        for (int y = 0; y < height; ++y) {
+            for (int x = 0; x < width; ++x) {
+                uchar value = static_cast<uchar>(
+                    (std::sin(x * 0.1 + time) + std::cos(y * 0.1 + time)) * 127 + 128);
+                frame.at<cv::Vec3b>(y, x) = cv::Vec3b(value, value, value);
+            }
+        }
+
+        return frame;
+    }
+
+    // Apply effects to a video frame
+    cv::Mat applyEffect(const cv::Mat& frame, const std::string& effect, const std::unordered_map<std::string, float>& params) {
+        cv::Mat result = frame.clone();
+
+        if (effect == "brightness") {
+            float brightness = params.at("value");
+            result += cv::Scalar(brightness, brightness, brightness);
+        } else if (effect == "contrast") {
+            float contrast = params.at("value");
+            result.convertTo(result, -1, contrast, 0);
+        } else if (effect == "blur") {
+            int kernelSize = static_cast<int>(params.at("kernelSize"));
+            auto quality = params.find("quality");
+            FastBlur::gaussian(result, result, FastBlur::sigmaForKernel(kernelSize),
+                               quality != params.end() ? static_cast<int>(quality->second) : FastBlur::defaultPasses);
+        }
+
+        return result;
+    }
+};
+
+// Contiguous, 64-byte aligned block that tensors are carved out of. Every
+// tensor is planned first and the block is allocated once, so a model's
+// weights sit together in memory and each tensor starts on a cache line.
+class TensorArena {
+public:
+    static constexpr size_t alignment = 64;
+    
+    TensorArena() : block(nullptr, &std::free), planned(0) {}
+    
+    // Reserves room for a tensor and returns the offset it will live at
+    size_t plan(size_t bytes) {
+        size_t offset = planned;
+        planned += alignUp(bytes);
+        return offset;
+    }
+    
+    // Allocates everything planned so far, zeroed
+    bool allocate() {
+        void* memory = nullptr;
+        if (posix_memalign(&memory, alignment, std::max(planned, alignment)) != 0) return false;
+        std::memset(memory, 0, planned);
+        block.reset(static_cast<uint8_t*>(memory));
+        return true;
+    }
+    
+    template <typename T>
+    T* at(size_t offset) { return reinterpret_cast<T*>(block.get() + offset); }
+    
+    template <typename T>
+    const T* at(size_t offset) const { return reinterpret_cast<const T*>(block.get() + offset); }
+    
+    size_t size() const { return planned; }
+    
+    static size_t alignUp(size_t bytes) {
+        return (bytes + alignment - 1) & ~(alignment - 1);
+    }
+
+private:
+    std::unique_ptr<uint8_t, void (*)(void*)> block;
+    size_t planned;
+};
+
+// Feed-forward network run on the CPU. Weights live in one TensorArena and
+// are never modified after load, so one model serves any number of threads.
+// Dense and convolution layers use SIMD kernels and spread their outputs
+// over the shared pool; weights may be int8 with a float scale per output,
+// either as stored or quantised at load, which quarters their memory
+// traffic. A batch of inputs runs as one forward pass: dense layers load
+// each weight register once for several inputs, and convolutions spread
+// (input, channel) pairs over the pool.
+//
+// Models use the tvnn format, the subset of ONNX the generators need
+// (little endian, tensors channels x height x width, the input a vector):
+//   "TVNN" u32 version(1) u32 inputSize u32 timeFeatures u32 layerCount
+//   then per layer a u32 type and
+//     1 Dense       u32 outputs u32 int8 weights[outputs][inputs] [f32 scales[outputs]] f32 bias[outputs]
+//     2 Conv        u32 outChannels u32 kernel u32 int8 weights[out][in][kernel][kernel] [scales] bias
+//                   (stride 1, odd kernel, zero padded to the same size)
+//     3 Activation  u32 kind (1 relu, 2 leaky relu, 3 sigmoid, 4 tanh) f32 alpha
+//     4 Reshape     u32 channels u32 height u32 width
+//     5 Upsample    nearest neighbour, 2x
+// Weights are f32, or s8 when the int8 flag is set.
+class InferenceModel {
+public:
+    struct Options {
+        bool quantise = false;      // Store float weights as int8
+    };
+    
+    struct Shape {
+        int channels = 0;
+        int height = 1;
+        int width = 1;
+        
+        size_t total() const {
+            return static_cast<size_t>(channels) * height * width;
+        }
+    };
+    
+    static constexpr size_t maxTensorElements = size_t(1) << 28;
+    
+    // Null with error set when the file cannot be read or is not a valid model
+    static std::shared_ptr<const InferenceModel> load(const std::string& path, const Options& options, std::string& error) {
+        std::ifstream file(path, std::ios::binary);
+        if (!file) {
+            error = "Cannot open " + path;
+            return nullptr;
+        }
+        std::vector<char> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        
+        std::shared_ptr<InferenceModel> model(new InferenceModel());
+        if (!model->parse(bytes, options, error)) {
+            error = path + ": " + error;
+            return nullptr;
+        }
+        return model;
+    }
+    
+    int getInputSize() const { return inputSize; }
+    int getTimeFeatures() const { return timeFeatures; }
+    Shape outputShape() const { return layers.empty() ? Shape{inputSize, 1, 1} : layers.back().output; }
+    size_t memoryFootprint() const { return weights.size(); }
+    bool isQuantised() const { return quantised; }
+    
+    // Runs the network on inputSize values and returns the output tensor
+    std::vector<float> run(const std::vector<float>& input) const {
+        return std::move(runBatch({input}).front());
+    }
+
+    // One forward pass over every input; outputs are in input order
+    std::vector<std::vector<float>> runBatch(const std::vector<std::vector<float>>& inputs) const {
+        const int batch = static_cast<int>(inputs.size());
+        if (batch == 0) return {};
+
+        // Two ping-pong activation buffers per call, so runs never share
+        // state. Each input's tensor starts on a cache line.
+        const size_t stride = TensorArena::alignUp(largestTensor * sizeof(float)) / sizeof(float);
+        TensorArena scratch;
+        size_t buffers[2] = {scratch.plan(batch * stride * sizeof(float)), scratch.plan(batch * stride * sizeof(float))};
+        if (!scratch.allocate()) {
+            throw std::bad_alloc();
+        }
+
+        float* current = scratch.at<float>(buffers[0]);
+        float* next = scratch.at<float>(buffers[1]);
+        for (int b = 0; b < batch; b++) {
+            const std::vector<float>& input = inputs[b];
+            std::copy(input.begin(), input.begin() + std::min<size_t>(input.size(), inputSize), current + b * stride);
+        }
+
+        for (const Layer& layer : layers) {
+            switch (layer.type) {
+                case LayerType::Dense:
+                    dense(layer, current, next, batch, stride);
+                    std::swap(current, next);
+                    break;
+                case LayerType::Conv:
+                    convolution(layer, current, next, batch, stride);
+                    std::swap(current, next);
+                    break;
+                case LayerType::Upsample:
+                    upsample(layer.input, current, next, batch, stride);
+                    std::swap(current, next);
+                    break;
+                case LayerType::Activation:
+                    for (int b = 0; b < batch; b++) {
+                        activate(layer, current + b * stride, layer.output.total());
+                    }
+                    break;
+                case LayerType::Reshape:
+                    break;
+            }
+        }
+
+        const size_t outputSize = outputShape().total();
+        std::vector<std::vector<float>> outputs;
+        outputs.reserve(batch);
+        for (int b = 0; b < batch; b++) {
+            outputs.emplace_back(current + b * stride, current + b * stride + outputSize);
+        }
+        return outputs;
+    }
+
+private:
+    enum class LayerType : uint32_t { Dense = 1, Conv = 2, Activation = 3, Reshape = 4, Upsample = 5 };
+    enum class ActivationKind : uint32_t { Relu = 1, LeakyRelu = 2, Sigmoid = 3, Tanh = 4 };
+    
+    struct Layer {
+        LayerType type;
+        Shape input;
+        Shape output;
+        int kernel = 0;
+        bool int8 = false;
+        ActivationKind activation = ActivationKind::Relu;
+        float alpha = 0.0f;
+        size_t rowLength = 0;       // Weights per output
+        size_t rowStride = 0;       // Weight elements between outputs, padded to a cache line
+        size_t weights = 0;         // Arena offsets
+        size_t scales = 0;
+        size_t bias = 0;
+    };
+    
+    // Bounds-checked little-endian cursor over the file
+    struct Reader {
+        const std::vector<char>& bytes;
+        size_t position;
+        
+        bool take(void* value, size_t size) {
+            if (bytes.size() - position < size) return false;
+            std::memcpy(value, bytes.data() + position, size);
+            position += size;
+            return true;
         }
         
-        // Copy audio samples to frame
-        if (codecCtx->sample_fmt == AV_SAMPLE_FMT_FLTP) {
-            float* left = (float*)avFrame->data[0];
-            float* right = (float*)avFrame->data[1];
+        const char* skip(size_t size) {
+            if (bytes.size() - position < size) return nullptr;
+            const char* data = bytes.data() + position;
+            position += size;
+            return data;
+        }
+    };
+    
+    int inputSize;
+    int timeFeatures;
+    std::vector<Layer> layers;
+    size_t largestTensor;
+    bool quantised;
+    TensorArena weights;
+    
+    InferenceModel() : inputSize(0), timeFeatures(0), largestTensor(0), quantised(false) {}
+    
+    bool parse(const std::vector<char>& bytes, const Options& options, std::string& error) {
+        Reader reader{bytes, 0};
+        char magic[4];
+        uint32_t version = 0, inputs = 0, times = 0, layerCount = 0;
+        if (!reader.take(magic, 4) || std::memcmp(magic, "TVNN", 4) != 0) {
+            error = "not a tvnn model";
+            return false;
+        }
+        if (!reader.take(&version, 4) || version != 1) {
+            error = "unsupported model version " + std::to_string(version);
+            return false;
+        }
+        if (!reader.take(&inputs, 4) || !reader.take(&times, 4) || !reader.take(&layerCount, 4) ||
+            inputs == 0 || inputs > maxTensorElements || times > inputs || times % 2 != 0) {
+            error = "invalid model header";
+            return false;
+        }
+        inputSize = static_cast<int>(inputs);
+        timeFeatures = static_cast<int>(times);
+        largestTensor = inputs;
+        
+        // First pass: shapes and where each tensor's data sits in the file
+        struct Source {
+            const char* weights = nullptr;
+            const char* scales = nullptr;
+            const char* bias = nullptr;
+        };
+        std::vector<Source> sources;
+        Shape shape{inputSize, 1, 1};
+        
+        for (uint32_t l = 0; l < layerCount; l++) {
+            Layer layer;
+            Source source;
+            uint32_t type = 0;
+            if (!reader.take(&type, 4)) {
+                error = "truncated at layer " + std::to_string(l);
+                return false;
+            }
+            layer.type = static_cast<LayerType>(type);
+            layer.input = shape;
+            
+            bool valid = true;
+            uint32_t outputs = 0, kernel = 1, int8 = 0;
+            switch (layer.type) {
+                case LayerType::Dense:
+                    valid = reader.take(&outputs, 4) && reader.take(&int8, 4) &&
+                            outputs > 0 && outputs <= maxTensorElements;
+                    layer.output = Shape{static_cast<int>(outputs), 1, 1};
+                    layer.rowLength = shape.total();
+                    break;
+                case LayerType::Conv:
+                    valid = reader.take(&outputs, 4) && reader.take(&kernel, 4) && reader.take(&int8, 4) &&
+                            outputs > 0 && outputs <= 65536 && kernel % 2 == 1 && kernel <= 15;
+                    layer.kernel = static_cast<int>(kernel);
+                    layer.output = Shape{static_cast<int>(outputs), shape.height, shape.width};
+                    layer.rowLength = shape.channels * static_cast<size_t>(kernel) * kernel;
+                    break;
+                case LayerType::Activation: {
+                    uint32_t kind = 0;
+                    valid = reader.take(&kind, 4) && reader.take(&layer.alpha, 4) && kind >= 1 && kind <= 4;
+                    layer.activation = static_cast<ActivationKind>(kind);
+                    layer.output = shape;
+                    break;
+                }
+                case LayerType::Reshape: {
+                    uint32_t dims[3] = {0, 0, 0};
+                    valid = reader.take(dims, sizeof(dims)) && dims[0] > 0 && dims[1] > 0 && dims[2] > 0 &&
+                            static_cast<size_t>(dims[0]) * dims[1] * dims[2] == shape.total();
+                    layer.output = Shape{static_cast<int>(dims[0]), static_cast<int>(dims[1]), static_cast<int>(dims[2])};
+                    break;
+                }
+                case LayerType::Upsample:
+                    layer.output = Shape{shape.channels, shape.height * 2, shape.width * 2};
+                    valid = shape.total() * 4 <= maxTensorElements;
+                    break;
+                default:
+                    valid = false;
+            }
+            if (valid && layer.output.total() > maxTensorElements) valid = false;
             
-            for (int i = 0; i < avFrame->nb_samples; i++) {
-                left[i] = samples[i * 2];
-                right[i] = samples[i * 2 + 1];
+            if (valid && (layer.type == LayerType::Dense || layer.type == LayerType::Conv)) {
+                layer.int8 = int8 != 0;
+                size_t count = static_cast<size_t>(outputs) * layer.rowLength;
+                valid = count <= maxTensorElements;
+                if (valid) {
+                    source.weights = reader.skip(count * (layer.int8 ? 1 : sizeof(float)));
+                    if (layer.int8) source.scales = reader.skip(outputs * sizeof(float));
+                    source.bias = reader.skip(outputs * sizeof(float));
+                    valid = source.weights && source.bias && (!layer.int8 || source.scales);
+                }
+                // Quantised on request; stored int8 stays int8
+                layer.int8 = layer.int8 || options.quantise;
             }
-        } else {
-            // Handle other sample formats as needed
-            memcpy(avFrame->data[0], samples.data(), samples.size() * sizeof(float));
+            if (!valid) {
+                error = "invalid or truncated layer " + std::to_string(l);
+                return false;
+            }
+            
+            shape = layer.output;
+            largestTensor = std::max(largestTensor, shape.total());
+            layers.push_back(layer);
+            sources.push_back(source);
         }
         
-        // Encode frame
-        ret = avcodec_send_frame(codecCtx, avFrame);
-        av_frame_free(&avFrame);
-        
-        if (ret < 0) return false;
+        // Second pass: lay every tensor out in one arena and fill it
+        for (Layer& layer : layers) {
+            if (layer.type != LayerType::Dense && layer.type != LayerType::Conv) continue;
+            size_t elementSize = layer.int8 ? 1 : sizeof(float);
+            size_t outputs = static_cast<size_t>(layer.output.channels);
+            layer.rowStride = TensorArena::alignUp(layer.rowLength * elementSize) / elementSize;
+            layer.weights = weights.plan(outputs * layer.rowStride * elementSize);
+            layer.scales = weights.plan(outputs * sizeof(float));
+            layer.bias = weights.plan(outputs * sizeof(float));
+        }
+        if (!weights.allocate()) {
+            error = "out of memory for " + std::to_string(weights.size()) + " bytes of weights";
+            return false;
+        }
         
-        AVPacket* packet = av_packet_alloc();
-        while (ret >= 0) {
-            ret = avcodec_receive_packet(codecCtx, packet);
-            if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
+        for (size_t l = 0; l < layers.size(); l++) {
+            const Layer& layer = layers[l];
+            const Source& source = sources[l];
+            if (!source.weights) continue;
+            size_t outputs = static_cast<size_t>(layer.output.channels);
+            float* scales = weights.at<float>(layer.scales);
+            std::memcpy(weights.at<float>(layer.bias), source.bias, outputs * sizeof(float));
+            
+            if (source.scales) {
+                std::memcpy(scales, source.scales, outputs * sizeof(float));
+                for (size_t o = 0; o < outputs; o++) {
+                    std::memcpy(weights.at<int8_t>(layer.weights) + o * layer.rowStride,
+                                source.weights + o * layer.rowLength, layer.rowLength);
+                }
+            } else if (layer.int8) {
+                std::vector<float> row(layer.rowLength);
+                for (size_t o = 0; o < outputs; o++) {
+                    std::memcpy(row.data(), source.weights + o * layer.rowLength * sizeof(float), row.size() * sizeof(float));
+                    scales[o] = quantiseRow(row, weights.at<int8_t>(layer.weights) + o * layer.rowStride);
+                }
+            } else {
+                for (size_t o = 0; o < outputs; o++) {
+                    std::memcpy(weights.at<float>(layer.weights) + o * layer.rowStride,
+                                source.weights + o * layer.rowLength * sizeof(float), layer.rowLength * sizeof(float));
+                }
+            }
+            quantised = quantised || layer.int8;
+        }
+        return true;
+    }
+    
+    // Symmetric per-output quantisation; returns the scale
+    static float quantiseRow(const std::vector<float>& row, int8_t* out) {
+        float largest = 0.0f;
+        for (float value : row) {
+            largest = std::max(largest, std::abs(value));
+        }
+        float scale = largest > 0.0f ? largest / 127.0f : 1.0f;
+        for (size_t i = 0; i < row.size(); i++) {
+            out[i] = static_cast<int8_t>(std::max(-127, std::min(127, cvRound(row[i] / scale))));
+        }
+        return scale;
+    }
+    
+    // Inputs that share each load of a weight register
+    static constexpr int inputsPerPass = 4;
+
+    void dense(const Layer& layer, const float* in, float* out, int batch, size_t stride) const {
+        const int length = static_cast<int>(layer.rowLength);
+        const float* bias = weights.at<float>(layer.bias);
+        const float* scales = weights.at<float>(layer.scales);
+
+        FiberOpticThreading::shared().parallelFor(0, layer.output.channels, 32, [&](int begin, int end) {
+            const float* rows[inputsPerPass];
+            float sums[inputsPerPass];
+            for (int o = begin; o < end; o++) {
+                for (int first = 0; first < batch; first += inputsPerPass) {
+                    const int count = std::min(inputsPerPass, batch - first);
+                    for (int j = 0; j < count; j++) {
+                        rows[j] = in + (first + j) * stride;
+                    }
+
+                    float scale = 1.0f;
+                    if (layer.int8) {
+                        dot(weights.at<int8_t>(layer.weights) + o * layer.rowStride, rows, count, length, sums);
+                        scale = scales[o];
+                    } else {
+                        dot(weights.at<float>(layer.weights) + o * layer.rowStride, rows, count, length, sums);
+                    }
+                    for (int j = 0; j < count; j++) {
+                        out[(first + j) * stride + o] = sums[j] * scale + bias[o];
+                    }
+                }
+            }
+        });
+    }
+
+    // Each output channel accumulates every (input channel, tap) pair as a
+    // scaled, shifted copy of the input plane, one row at a time
+    void convolution(const Layer& layer, const float* in, float* out, int batch, size_t stride) const {
+        const int height = layer.input.height;
+        const int width = layer.input.width;
+        const int kernel = layer.kernel;
+        const int pad = kernel / 2;
+        const size_t plane = static_cast<size_t>(height) * width;
+        const float* bias = weights.at<float>(layer.bias);
+        const float* scales = weights.at<float>(layer.scales);
+        
+        const int outChannels = layer.output.channels;
+        
+        FiberOpticThreading::shared().parallelFor(0, batch * outChannels, 1, [&](int begin, int end) {
+            for (int task = begin; task < end; task++) {
+                const int b = task / outChannels;
+                const int o = task % outChannels;
+                float* target = out + b * stride + o * plane;
+                std::fill(target, target + plane, bias[o]);
+                
+                for (int c = 0; c < layer.input.channels; c++) {
+                    const float* source = in + b * stride + c * plane;
+                    for (int ky = 0; ky < kernel; ky++) {
+                        for (int kx = 0; kx < kernel; kx++) {
+                            size_t tap = (static_cast<size_t>(c) * kernel + ky) * kernel + kx;
+                            float weight = layer.int8 ?
+                                weights.at<int8_t>(layer.weights)[o * layer.rowStride + tap] * scales[o] :
+                                weights.at<float>(layer.weights)[o * layer.rowStride + tap];
+                            if (weight == 0.0f) continue;
+                            
+                            const int dx = kx - pad;
+                            const int dy = ky - pad;
+                            const int xBegin = std::max(0, -dx);
+                            const int xEnd = std::min(width, width - dx);
+                            const int yBegin = std::max(0, -dy);
+                            const int yEnd = std::min(height, height - dy);
+                            for (int y = yBegin; y < yEnd; y++) {
+                                axpy(target + y * width + xBegin, source + (y + dy) * width + xBegin + dx,
+                                     weight, xEnd - xBegin);
+                            }
+                        }
+                    }
+                }
+            }
+        });
+    }
+    
+    static void upsample(const Shape& shape, const float* in, float* out, int batch, size_t stride) {
+        const size_t plane = static_cast<size_t>(shape.height) * shape.width;
+        FiberOpticThreading::shared().parallelFor(0, batch * shape.channels, 4, [&](int begin, int end) {
+            for (int task = begin; task < end; task++) {
+                const int b = task / shape.channels;
+                const int c = task % shape.channels;
+                cv::Mat source(shape.height, shape.width, CV_32F, const_cast<float*>(in + b * stride + c * plane));
+                cv::Mat target(shape.height * 2, shape.width * 2, CV_32F, out + b * stride + c * plane * 4);
+                cv::resize(source, target, target.size(), 0, 0, cv::INTER_NEAREST);
+            }
+        });
+    }
+    
+    static void activate(const Layer& layer, float* data, size_t count) {
+        cv::Mat values(1, static_cast<int>(count), CV_32F, data);
+        switch (layer.activation) {
+            case ActivationKind::Relu:
+                rectify(data, count, 0.0f);
                 break;
-            } else if (ret < 0) {
-                av_packet_free(&packet);
-                return false;
+            case ActivationKind::LeakyRelu:
+                rectify(data, count, layer.alpha);
+                break;
+            case ActivationKind::Sigmoid:
+                // 1 / (1 + e^-x)
+                values.convertTo(values, CV_32F, -1.0);
+                cv::exp(values, values);
+                cv::add(values, 1.0, values);
+                cv::divide(1.0, values, values);
+                break;
+            case ActivationKind::Tanh:
+                // 2 / (1 + e^-2x) - 1
+                values.convertTo(values, CV_32F, -2.0);
+                cv::exp(values, values);
+                cv::add(values, 1.0, values);
+                cv::divide(2.0, values, values);
+                cv::subtract(values, 1.0, values);
+                break;
+        }
+    }
+    
+    // x < 0 becomes slope * x
+    static void rectify(float* data, size_t count, float slope) {
+        size_t i = 0;
+#if CV_SIMD
+        const size_t lanes = cv::v_float32::nlanes;
+        const cv::v_float32 zero = cv::vx_setzero_f32();
+        const cv::v_float32 scale = cv::vx_setall_f32(slope);
+        for (; i + lanes <= count; i += lanes) {
+            cv::v_float32 value = cv::vx_load(data + i);
+            cv::v_store(data + i, cv::v_select(value > zero, value, value * scale));
+        }
+#endif
+        for (; i < count; i++) {
+            if (data[i] < 0.0f) data[i] *= slope;
+        }
+    }
+    
+#if CV_SIMD
+    static cv::v_float32 loadWeights(const float* weights) {
+        return cv::vx_load(weights);
+    }
+
+    // int8 weights are widened to float in registers; the caller applies
+    // the row's scale once
+    static cv::v_float32 loadWeights(const int8_t* weights) {
+        return cv::v_cvt_f32(cv::vx_load_expand_q(weights));
+    }
+#endif
+
+    // sums[j] = weights . inputs[j] for up to inputsPerPass inputs, loading
+    // each weight register once for all of them
+    template <typename Weight>
+    static void dot(const Weight* weights, const float* const* inputs, int count, int length, float* sums) {
+        int i = 0;
+        for (int j = 0; j < count; j++) {
+            sums[j] = 0.0f;
+        }
+#if CV_SIMD
+        const int lanes = cv::v_float32::nlanes;
+        cv::v_float32 accumulators[inputsPerPass];
+        for (int j = 0; j < count; j++) {
+            accumulators[j] = cv::vx_setzero_f32();
+        }
+        for (; i <= length - lanes; i += lanes) {
+            cv::v_float32 weight = loadWeights(weights + i);
+            for (int j = 0; j < count; j++) {
+                accumulators[j] = cv::v_fma(weight, cv::vx_load(inputs[j] + i), accumulators[j]);
+            }
+        }
+        for (int j = 0; j < count; j++) {
+            sums[j] = cv::v_reduce_sum(accumulators[j]);
+        }
+#endif
+        for (; i < length; i++) {
+            for (int j = 0; j < count; j++) {
+                sums[j] += weights[i] * inputs[j][i];
+            }
+        }
+    }
+
+    // y += a * x
+    static void axpy(float* y, const float* x, float a, int length) {
+        int i = 0;
+#if CV_SIMD
+        const int lanes = cv::v_float32::nlanes;
+        const cv::v_float32 factor = cv::vx_setall_f32(a);
+        for (; i <= length - lanes; i += lanes) {
+            cv::v_store(y + i, cv::v_fma(factor, cv::vx_load(x + i), cv::vx_load(y + i)));
+        }
+#endif
+        for (; i < length; i++) {
+            y[i] += a * x[i];
+        }
+    }
+};
+
+// Dynamic batching in front of one model. Requests from any thread queue up
+// until maxBatchSize are waiting or the oldest has waited maxDelay, then run
+// as one forward pass, and each caller's future gets its own output. Under
+// load, batches fill up and each weight is read once per batch instead of
+// once per request. A lone request only pays the delay.
+class InferenceBatcher {
+public:
+    struct Settings {
+        int maxBatchSize = 8;
+        std::chrono::microseconds maxDelay = std::chrono::microseconds(2000);
+        
+        // The defaults, overridden by $TVID_INFERENCE_MAX_BATCH and
+        // $TVID_INFERENCE_MAX_DELAY_US where those hold a number
+        static Settings fromEnvironment() {
+            Settings settings;
+            char* end = nullptr;
+            if (const char* batch = std::getenv("TVID_INFERENCE_MAX_BATCH")) {
+                long value = std::strtol(batch, &end, 10);
+                if (end != batch && *end == '\0' && value > 0) settings.maxBatchSize = static_cast<int>(value);
+            }
+            if (const char* delay = std::getenv("TVID_INFERENCE_MAX_DELAY_US")) {
+                long value = std::strtol(delay, &end, 10);
+                if (end != delay && *end == '\0' && value >= 0) settings.maxDelay = std::chrono::microseconds(value);
+            }
+            return settings;
+        }
+    };
+    
+    struct Stats {
+        uint64_t requests;
+        uint64_t batches;
+        int largestBatch;
+    };
+    
+    InferenceBatcher(std::shared_ptr<const InferenceModel> model, const Settings& settings)
+        : model(std::move(model)), stopping(false), requests(0), batches(0), largestBatch(0) {
+        setSettings(settings);
+        worker = std::thread([this]() { batchLoop(); });
+    }
+    
+    // Runs whatever is still queued, then stops
+    ~InferenceBatcher() {
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        worker.join();
+    }
+    
+    InferenceBatcher(const InferenceBatcher&) = delete;
+    InferenceBatcher& operator=(const InferenceBatcher&) = delete;
+    
+    std::shared_ptr<const InferenceModel> getModel() const { return model; }
+    
+    void setSettings(const Settings& newSettings) {
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            settings = newSettings;
+            settings.maxBatchSize = std::max(1, settings.maxBatchSize);
+            settings.maxDelay = std::max(std::chrono::microseconds(0), settings.maxDelay);
+        }
+        wake.notify_all();
+    }
+    
+    Settings getSettings() {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        return settings;
+    }
+    
+    // The output for input, once its batch has run. Errors from the forward
+    // pass are rethrown by get().
+    std::future<std::vector<float>> submit(std::vector<float> input) {
+        Request request;
+        request.input = std::move(input);
+        request.queued = std::chrono::steady_clock::now();
+        std::future<std::vector<float>> future = request.output.get_future();
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            queue.push_back(std::move(request));
+        }
+        wake.notify_all();
+        return future;
+    }
+    
+    Stats getStats() {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        return Stats{requests, batches, largestBatch};
+    }
+
+private:
+    struct Request {
+        std::vector<float> input;
+        std::promise<std::vector<float>> output;
+        std::chrono::steady_clock::time_point queued;
+    };
+    
+    std::shared_ptr<const InferenceModel> model;
+    Settings settings;
+    std::mutex queueMutex;
+    std::condition_variable wake;
+    std::deque<Request> queue;
+    bool stopping;
+    std::thread worker;
+    uint64_t requests;
+    uint64_t batches;
+    int largestBatch;
+    
+    void batchLoop() {
+        // Callers are waiting on the answer; the forward pass's pool work
+        // runs ahead of previews and exports
+        FiberOpticThreading::PriorityScope priority(FiberOpticThreading::Priority::Interactive);
+        
+        std::unique_lock<std::mutex> lock(queueMutex);
+        while (true) {
+            wake.wait(lock, [this]() { return !queue.empty() || stopping; });
+            if (queue.empty()) break;
+            
+            // Let the batch fill until the oldest request's budget is spent
+            while (!stopping && queue.size() < static_cast<size_t>(settings.maxBatchSize)) {
+                auto deadline = queue.front().queued + settings.maxDelay;
+                if (wake.wait_until(lock, deadline) == std::cv_status::timeout) break;
             }
             
-            packet->stream_index = stream->index;
-            av_packet_rescale_ts(packet, codecCtx->time_base, stream->time_base);
+            std::vector<Request> batch;
+            while (!queue.empty() && batch.size() < static_cast<size_t>(settings.maxBatchSize)) {
+                batch.push_back(std::move(queue.front()));
+                queue.pop_front();
+            }
+            requests += batch.size();
+            batches++;
+            largestBatch = std::max(largestBatch, static_cast<int>(batch.size()));
             
-            ret = av_interleaved_write_frame(formatCtx, packet);
-            av_packet_unref(packet);
+            lock.unlock();
+            run(batch);
+            lock.lock();
         }
-        
-        av_packet_free(&packet);
-        return true;
     }
     
-    void flushEncoder(AVFormatContext* formatCtx, AVCodecContext* codecCtx, AVStream* stream) {
-        avcodec_send_frame(codecCtx, nullptr); // Flush
+    void run(std::vector<Request>& batch) {
+        std::vector<std::vector<float>> inputs;
+        inputs.reserve(batch.size());
+        for (auto& request : batch) {
+            inputs.push_back(std::move(request.input));
+        }
         
-        AVPacket* packet = av_packet_alloc();
-        int ret;
-        while ((ret = avcodec_receive_packet(codecCtx, packet)) >= 0) {
-            packet->stream_index = stream->index;
-            av_packet_rescale_ts(packet, codecCtx->time_base, stream->time_base);
-            av_interleaved_write_frame(formatCtx, packet);
-            av_packet_unref(packet);
+        std::vector<std::vector<float>> outputs;
+        try {
+            outputs = model->runBatch(inputs);
+        } catch (...) {
+            for (auto& request : batch) {
+                request.output.set_exception(std::current_exception());
+            }
+            return;
         }
-        av_packet_free(&packet);
+        for (size_t i = 0; i < batch.size(); i++) {
+            batch[i].output.set_value(std::move(outputs[i]));
+        }
+    }
+};
+
+// Models loaded once and kept warm for every request that uses them, each
+// with its own InferenceBatcher. A model is reloaded when its file changes;
+// requests still running on the old one keep it alive until they finish.
+class InferenceModelRegistry {
+public:
+    static InferenceModelRegistry& shared() {
+        static InferenceModelRegistry registry;
+        return registry;
+    }
+
+    std::shared_ptr<const InferenceModel> get(const std::string& path, const InferenceModel::Options& options,
+                                              std::string& error) {
+        std::shared_ptr<InferenceBatcher> stale;
+        std::lock_guard<std::mutex> lock(registryMutex);
+        Entry* entry = find(path, options, error, stale);
+        return entry ? entry->model : nullptr;
+    }
+
+    // The model's batcher, started on first use
+    std::shared_ptr<InferenceBatcher> batcher(const std::string& path, const InferenceModel::Options& options,
+                                              std::string& error) {
+        std::shared_ptr<InferenceBatcher> stale;
+        std::lock_guard<std::mutex> lock(registryMutex);
+        Entry* entry = find(path, options, error, stale);
+        if (!entry) return nullptr;
+        if (!entry->batcher) {
+            entry->batcher = std::make_shared<InferenceBatcher>(entry->model, batchSettings);
+        }
+        return entry->batcher;
+    }
+
+    InferenceBatcher::Settings getBatchSettings() {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        return batchSettings;
     }
     
-    void cleanup(AVFormatContext* formatCtx, AVCodecContext* videoCtx, AVCodecContext* audioCtx) {
-        if (videoCtx) avcodec_free_context(&videoCtx);
-        if (audioCtx) avcodec_free_context(&audioCtx);
-        if (formatCtx) {
-            if (!(formatCtx->oformat->flags & AVFMT_NOFILE))
-                avio_closep(&formatCtx->pb);
-            avformat_free_context(formatCtx);
+    // Applies to every batcher, running or not yet started
+    void setBatchSettings(const InferenceBatcher::Settings& settings) {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        batchSettings = settings;
+        for (auto& entry : models) {
+            if (entry.second.batcher) {
+                entry.second.batcher->setSettings(settings);
+            }
+        }
+    }
+
+    void unload(const std::string& path) {
+        std::vector<Entry> removed;
+        std::lock_guard<std::mutex> lock(registryMutex);
+        for (const std::string& key : {path, path + "#int8"}) {
+            auto it = models.find(key);
+            if (it != models.end()) {
+                removed.push_back(std::move(it->second));
+                models.erase(it);
+            }
+        }
+    }
+
+    Json::Value getStats() {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        size_t bytes = 0;
+        uint64_t requests = 0;
+        uint64_t batches = 0;
+        for (const auto& entry : models) {
+            bytes += entry.second.model->memoryFootprint();
+            if (entry.second.batcher) {
+                InferenceBatcher::Stats batching = entry.second.batcher->getStats();
+                requests += batching.requests;
+                batches += batching.batches;
+            }
+        }
+        Json::Value stats;
+        stats["models"] = static_cast<Json::UInt64>(models.size());
+        stats["bytes"] = static_cast<Json::UInt64>(bytes);
+        stats["loads"] = static_cast<Json::UInt64>(loads);
+        stats["hits"] = static_cast<Json::UInt64>(hits);
+        stats["batchedRequests"] = static_cast<Json::UInt64>(requests);
+        stats["batches"] = static_cast<Json::UInt64>(batches);
+        return stats;
+    }
+
+private:
+    struct Entry {
+        int64_t modified;           // st_mtim in nanoseconds
+        std::shared_ptr<const InferenceModel> model;
+        std::shared_ptr<InferenceBatcher> batcher;
+    };
+
+    std::mutex registryMutex;
+    std::unordered_map<std::string, Entry> models;
+    InferenceBatcher::Settings batchSettings;
+    uint64_t loads;
+    uint64_t hits;
+
+    InferenceModelRegistry() : batchSettings(InferenceBatcher::Settings::fromEnvironment()), loads(0), hits(0) {}
+
+    // Callers hold registryMutex. Loads under it, so concurrent first
+    // requests for a large model wait for one load instead of each reading
+    // it. A replaced batcher is handed back in stale so the caller drains
+    // it after unlocking.
+    Entry* find(const std::string& path, const InferenceModel::Options& options, std::string& error,
+                std::shared_ptr<InferenceBatcher>& stale) {
+        struct stat st;
+        if (::stat(path.c_str(), &st) < 0) {
+            error = "Cannot access " + path + ": " + std::string(strerror(errno));
+            return nullptr;
+        }
+        int64_t modified = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000LL + st.st_mtim.tv_nsec;
+        std::string key = path + (options.quantise ? "#int8" : "");
+
+        auto it = models.find(key);
+        if (it != models.end() && it->second.modified == modified) {
+            hits++;
+            return &it->second;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        std::shared_ptr<const InferenceModel> model = InferenceModel::load(path, options, error);
+        if (!model) {
+            LOG_ERROR("Failed to load model: " + error);
+            return nullptr;
         }
+        double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        LOG_INFO("Loaded model " + key + " (" + std::to_string(model->memoryFootprint() / 1024) + " KB) in " +
+                 std::to_string(milliseconds) + " ms");
+
+        loads++;
+        Entry& entry = models[key];
+        stale = std::move(entry.batcher);
+        entry = Entry{modified, model, nullptr};
+        return &entry;
     }
 };
 
-// SI Model for Video Generation and Effects
-class SyntheticIntelligence {
+// AI Model Integration for Video Creation. The prompt is hashed into the
+// model's conditioning vector (each lowercase word adds +-1 to one slot,
+// then the slots are normalised), followed by sin/cos pairs of the time at
+// doubling frequencies. The model's output is an RGB image in [0, 1],
+// scaled to the requested size. Inference goes through the model's shared
+// InferenceBatcher, so frames of one clip and requests from other clients
+// run in the same forward passes.
+class VideoCreationAI {
+private:
+    std::string modelPath;
+    std::shared_ptr<InferenceBatcher> batcher;
+    std::shared_ptr<const InferenceModel> model;
+    std::string error;
+
 public:
-    SyntheticIntelligence() {
-        LOG_INFO("SyntheticIntelligence initialized");
+    explicit VideoCreationAI(const std::string& path, bool quantise = false) : modelPath(path) {
+        InferenceModel::Options options;
+        options.quantise = quantise;
+        batcher = InferenceModelRegistry::shared().batcher(modelPath, options, error);
+        model = batcher ? batcher->getModel() : nullptr;
+        if (model && model->outputShape().channels != 3) {
+            error = modelPath + ": model output has " + std::to_string(model->outputShape().channels) +
+                    " channels, expected 3";
+            batcher.reset();
+            model.reset();
+        }
+    }
+    
+    // $TVID_MODEL_PATH, else the bundled model
+    static std::string defaultModelPath() {
+        const char* path = std::getenv("TVID_MODEL_PATH");
+        return path && *path ? std::string(path) : std::string("models/video_creation.tvnn");
+    }
+    
+    bool isReady() const { return model != nullptr; }
+    std::string getError() const { return error; }
+    
+    // Empty when no model is loaded
+    cv::Mat generateVideoFrame(const std::string& prompt, int width, int height, double time = 0.0) {
+        if (!model || width <= 0 || height <= 0) return cv::Mat();
+        
+        std::future<std::vector<float>> pending = batcher->submit(conditioning(prompt, time));
+        std::vector<float> output = FiberOpticThreading::shared().wait(pending);
+        return toFrame(output, width, height);
+    }
+    
+    // A frame per entry of times, handed to commit in order. Two batches'
+    // worth of frames are kept in flight, so a clip fills whole batches.
+    // Stops and returns false as soon as commit does.
+    bool generateVideoFrames(const std::string& prompt, int width, int height, const std::vector<double>& times,
+                             const std::function<bool(int index, const cv::Mat& frame)>& commit) {
+        if (!model || width <= 0 || height <= 0) return false;
+        
+        const size_t window = 2 * static_cast<size_t>(batcher->getSettings().maxBatchSize);
+        std::deque<std::future<std::vector<float>>> pending;
+        size_t submitted = 0;
+        for (size_t index = 0; index < times.size(); index++) {
+            while (submitted < times.size() && submitted < index + window) {
+                pending.push_back(batcher->submit(conditioning(prompt, times[submitted])));
+                submitted++;
+            }
+            std::vector<float> output = FiberOpticThreading::shared().wait(pending.front());
+            pending.pop_front();
+            if (!commit(static_cast<int>(index), toFrame(output, width, height))) {
+                return false;
+            }
+        }
+        return true;
     }
 
-    // Generate a video frame procedurally
-    cv::Mat generateFrame(int width, int height, double time) {
-        cv::Mat frame(height, width, CV_8UC3, cv::Scalar(0, 0, 0));
-
-        // Example: Procedural pattern using sine waves
-        for (int y = 0; y < height; ++y) {
-            for (int x = 0; x < width; ++x) {
-                uchar value = static_cast<uchar>(
-                    (std::sin(x * 0.1 + time) + std::cos(y * 0.1 + time)) * 127 + 128);
-                frame.at<cv::Vec3b>(y, x) = cv::Vec3b(value, value, value);
+private:
+    cv::Mat toFrame(std::vector<float>& output, int width, int height) const {
+        InferenceModel::Shape shape = model->outputShape();
+        size_t plane = static_cast<size_t>(shape.height) * shape.width;
+        
+        // Planes are R, G, B
+        std::vector<cv::Mat> planes;
+        for (int c = 2; c >= 0; c--) {
+            planes.emplace_back(shape.height, shape.width, CV_32F, output.data() + c * plane);
+        }
+        cv::Mat image, frame;
+        cv::merge(planes, image);
+        image.convertTo(image, CV_8UC3, 255.0);
+        
+        bool enlarging = width > shape.width || height > shape.height;
+        cv::resize(image, frame, cv::Size(width, height), 0, 0, enlarging ? cv::INTER_CUBIC : cv::INTER_AREA);
+        return frame;
+    }
+    
+    std::vector<float> conditioning(const std::string& prompt, double time) const {
+        std::vector<float> input(model->getInputSize(), 0.0f);
+        const size_t slots = input.size() - model->getTimeFeatures();
+        
+        if (slots > 0) {
+            std::string word;
+            auto addWord = [&]() {
+                if (word.empty()) return;
+                uint32_t hash = 2166136261u;    // FNV-1a
+                for (char ch : word) {
+                    hash = (hash ^ static_cast<uint8_t>(ch)) * 16777619u;
+                }
+                input[hash % slots] += (hash & 0x80000000u) ? -1.0f : 1.0f;
+                word.clear();
+            };
+            for (char ch : prompt) {
+                if (std::isalnum(static_cast<unsigned char>(ch))) {
+                    word += static_cast<char>(std::tolower(static_cast<unsigned char>(ch)));
+                } else {
+                    addWord();
+                }
+            }
+            addWord();
+            
+            double norm = 0.0;
+            for (size_t i = 0; i < slots; i++) {
+                norm += input[i] * input[i];
+            }
+            if (norm > 0.0) {
+                float scale = static_cast<float>(1.0 / std::sqrt(norm));
+                for (size_t i = 0; i < slots; i++) {
+                    input[i] *= scale;
+                }
             }
         }
-
-        return frame;
-    }
-
-    // Apply effects to a video frame
-    cv::Mat applyEffect(const cv::Mat& frame, const std::string& effect, const std::unordered_map<std::string, float>& params) {
-        cv::Mat result = frame.clone();
-
-        if (effect == "brightness") {
-            float brightness = params.at("value");
-            result += cv::Scalar(brightness, brightness, brightness);
-        } else if (effect == "contrast") {
-            float contrast = params.at("value");
-            result.convertTo(result, -1, contrast, 0);
-        } else if (effect == "blur") {
-            int kernelSize = static_cast<int>(params.at("kernelSize"));
-            cv::GaussianBlur(result, result, cv::Size(kernelSize, kernelSize), 0);
+        
+        for (int k = 0; k < model->getTimeFeatures() / 2; k++) {
+            double phase = time * std::ldexp(1.0, k);
+            input[slots + 2 * k] = static_cast<float>(std::sin(phase));
+            input[slots + 2 * k + 1] = static_cast<float>(std::cos(phase));
         }
-
-        return result;
+        return input;
     }
 };
 
@@ -777,6 +6335,16 @@ private:
     std::atomic<bool> running;
     std::mutex clientsMutex;
     std::set<websocketpp::connection_hdl, std::owner_less<websocketpp::connection_hdl>> clients;
+    std::set<websocketpp::connection_hdl, std::owner_less<websocketpp::connection_hdl>> progressSubscribers;
+    std::set<websocketpp::connection_hdl, std::owner_less<websocketpp::connection_hdl>> binaryClients;
+    std::set<websocketpp::connection_hdl, std::owner_less<websocketpp::connection_hdl>> timelineSubscribers;
+    
+    // Export progress push notifications
+    std::thread progressThread;
+    std::atomic<double> progressPushRate;
+    std::mutex progressWakeMutex;
+    std::condition_variable progressWake;   // Rate changes and stop() cut the current wait short
+    bool progressRateChanged = false;
     
     ProjectManager* projectManager;
     RenderEngine* renderEngine;
@@ -784,7 +6352,7 @@ private:
     AudioEngine* audioEngine;
     
 public:
-    WebSocketServer(int port = 9002) : running(false), projectManager(nullptr), 
+    WebSocketServer(int port = 9002) : running(false), progressPushRate(4.0), projectManager(nullptr), 
                                       renderEngine(nullptr), videoEngine(nullptr), audioEngine(nullptr) {
         server.set_access_channels(websocketpp::log::alevel::all);
         server.clear_access_channels(websocketpp::log::alevel::frame_payload);
@@ -804,6 +6372,9 @@ public:
         server.set_close_handler([this](websocketpp::connection_hdl hdl) {
             std::lock_guard<std::mutex> lock(clientsMutex);
             clients.erase(hdl);
+            progressSubscribers.erase(hdl);
+            binaryClients.erase(hdl);
+            timelineSubscribers.erase(hdl);
             LOG_INFO("Client disconnected. Total clients: " + std::to_string(clients.size()));
         });
         
@@ -817,17 +6388,37 @@ public:
         stop();
     }
     
-    void setProjectManager(ProjectManager* pm) { projectManager = pm; }
+    void setProjectManager(ProjectManager* pm) {
+        projectManager = pm;
+        if (projectManager) {
+            projectManager->setChangeListener([this](const ProjectManager::TimelineChange& change) {
+                broadcastTimelineChange(change);
+            });
+        }
+    }
     void setRenderEngine(RenderEngine* re) { renderEngine = re; }
     void setVideoEngine(VideoEngine* ve) { videoEngine = ve; }
     void setAudioEngine(AudioEngine* ae) { audioEngine = ae; }
     
+    // Rate (Hz) at which export progress is pushed to subscribed clients
+    void setProgressPushRate(double hz) {
+        progressPushRate = std::max(0.1, hz);
+        {
+            std::lock_guard<std::mutex> lock(progressWakeMutex);
+            progressRateChanged = true;
+        }
+        progressWake.notify_all();
+    }
+    
     bool start() {
         try {
             running = true;
             serverThread = std::thread([this]() {
                 server.run();
             });
+            progressThread = std::thread([this]() {
+                progressNotifierLoop();
+            });
             LOG_INFO("WebSocket server started successfully");
             return true;
         } catch (const std::exception& e) {
@@ -838,11 +6429,18 @@ public:
     
     void stop() {
         if (running) {
-            running = false;
+            {
+                std::lock_guard<std::mutex> lock(progressWakeMutex);
+                running = false;
+            }
+            progressWake.notify_all();
             server.stop();
             if (serverThread.joinable()) {
                 serverThread.join();
             }
+            if (progressThread.joinable()) {
+                progressThread.join();
+            }
             LOG_INFO("WebSocket server stopped");
         }
     }
@@ -862,6 +6460,16 @@ public:
     }
     
 private:
+    // Raw payload that travels alongside a JSON response. Clients that
+    // negotiated binary frames receive it verbatim; others get it inlined
+    // into the JSON exactly as before (base64 data URL or number array).
+    struct BinaryAttachment {
+        std::string path;           // Location inside response["data"], e.g. "audioTracks/2/waveform"
+        std::string contentType;    // "image/jpeg", "image/x-bgr24" or "float32"
+        std::vector<uint8_t> bytes;
+        Json::Value meta;           // Extra description (width, height, stride, count...)
+    };
+    
     void handleMessage(websocketpp::connection_hdl hdl, websocketpp::server<websocketpp::config::asio>::message_ptr msg) {
         try {
             std::string payload = msg->get_payload();
@@ -879,11 +6487,15 @@ private:
             Json::Value response;
             response["id"] = request.get("id", "");
             response["command"] = command;
+            std::vector<BinaryAttachment> attachments;
             
             if (command == "ping") {
                 response["status"] = "success";
                 response["data"] = "pong";
             }
+            else if (command == "negotiate") {
+                handleNegotiate(hdl, request, response);
+            }
             else if (command == "create_project") {
                 handleCreateProject(request, response);
             }
@@ -905,8 +6517,17 @@ private:
             else if (command == "update_clip") {
                 handleUpdateClip(request, response);
             }
+            else if (command == "batch_edit") {
+                handleBatchEdit(request, response);
+            }
             else if (command == "get_timeline") {
-                handleGetTimeline(request, response);
+                handleGetTimeline(request, response, attachments);
+            }
+            else if (command == "subscribe_timeline") {
+                handleSubscribeTimeline(hdl, request, response, attachments);
+            }
+            else if (command == "unsubscribe_timeline") {
+                handleUnsubscribeTimeline(hdl, request, response);
             }
             else if (command == "export_video") {
                 handleExportVideo(request, response);
@@ -917,11 +6538,17 @@ private:
             else if (command == "get_export_progress") {
                 handleGetExportProgress(request, response);
             }
+            else if (command == "subscribe_export_progress") {
+                handleSubscribeExportProgress(hdl, request, response);
+            }
+            else if (command == "unsubscribe_export_progress") {
+                handleUnsubscribeExportProgress(hdl, request, response);
+            }
             else if (command == "generate_thumbnail") {
-                handleGenerateThumbnail(request, response);
+                handleGenerateThumbnail(request, response, attachments);
             }
             else if (command == "analyze_audio") {
-                handleAnalyzeAudio(request, response);
+                handleAnalyzeAudio(request, response, attachments);
             }
             else if (command == "apply_effect") {
                 handleApplyEffect(request, response);
@@ -929,15 +6556,42 @@ private:
             else if (command == "generate_video") {
                 handleGenerateVideo(request, response);
             }
+            else if (command == "create_ai_video") {
+                // Answered from the pool when done, so requests from several
+                // clients reach the model's batcher at the same time. A single
+                // frame is interactive; a clip is a batch render and must not
+                // hold an interactive slot for its whole length.
+                bool clip = request["params"].get("duration", 0.0).asDouble() > 0.0;
+                FiberOpticThreading::shared().enqueue(clip ? FiberOpticThreading::Priority::Export :
+                                                             FiberOpticThreading::Priority::Interactive,
+                                                      [this, hdl, request, response]() mutable {
+                    try {
+                        handleCreateAIVideo(request, response);
+                    } catch (const std::exception& e) {
+                        LOG_ERROR("AI video generation failed: " + std::string(e.what()));
+                        response["status"] = "error";
+                        response["error"] = "Internal server error";
+                    }
+                    sendResponse(hdl, response);
+                });
+                return;
+            }
             else if (command == "get_project_info") {
                 handleGetProjectInfo(request, response);
             }
+            else if (command == "set_inference_batching") {
+                handleSetInferenceBatching(request, response);
+            }
             else {
                 response["status"] = "error";
                 response["error"] = "Unknown command: " + command;
             }
             
-            sendResponse(hdl, response);
+            if (attachments.empty()) {
+                sendResponse(hdl, response);
+            } else {
+                sendResponseWithAttachments(hdl, response, attachments);
+            }
             
         } catch (const std::exception& e) {
             LOG_ERROR("Error handling WebSocket message: " + std::string(e.what()));
@@ -945,6 +6599,32 @@ private:
         }
     }
     
+    void handleNegotiate(websocketpp::connection_hdl hdl, const Json::Value& request, Json::Value& response) {
+        bool binaryFrames = request["params"].get("binaryFrames", false).asBool();
+        
+        {
+            std::lock_guard<std::mutex> lock(clientsMutex);
+            if (binaryFrames) {
+                binaryClients.insert(hdl);
+            } else {
+                binaryClients.erase(hdl);
+            }
+        }
+        
+        response["status"] = "success";
+        response["data"]["binaryFrames"] = binaryFrames;
+        if (binaryFrames) {
+            // Frame layout: uint32 little-endian header length, compact JSON
+            // header, then the attachment payloads back to back
+            response["data"]["frameLayout"] = "u32le-header-length,json-header,payload";
+            Json::Value types(Json::arrayValue);
+            types.append("image/jpeg");
+            types.append("image/x-bgr24");
+            types.append("float32");
+            response["data"]["contentTypes"] = types;
+        }
+    }
+    
     void handleCreateProject(const Json::Value& request, Json::Value& response) {
         if (!projectManager) {
             response["status"] = "error";
@@ -958,6 +6638,7 @@ private:
         double fps = request["params"].get("frameRate", 30.0).asDouble();
         
         if (projectManager->createNewProject(name, width, height, fps)) {
+            projectManager->markTimelineReplaced();
             response["status"] = "success";
             response["data"] = projectManager->getProjectInfo();
         } else {
@@ -980,7 +6661,11 @@ private:
             return;
         }
         
-        if (projectManager->loadProject(filePath)) {
+        bool loaded = ProjectManager::isBinaryProjectPath(filePath) ?
+            projectManager->loadProjectBinary(filePath) : projectManager->loadProject(filePath);
+        
+        if (loaded) {
+            projectManager->markTimelineReplaced(filePath);
             response["status"] = "success";
             response["data"] = projectManager->getProjectInfo();
         } else {
@@ -1003,7 +6688,16 @@ private:
             return;
         }
         
-        if (projectManager->saveProject(filePath)) {
+        bool saved;
+        if (ProjectManager::isBinaryProjectPath(filePath)) {
+            saved = projectManager->saveProjectBinary(filePath);
+        } else {
+            // JSON interchange needs every waveform in memory
+            projectManager->loadDeferredBlobs();
+            saved = projectManager->saveProject(filePath);
+        }
+        
+        if (saved) {
             response["status"] = "success";
             response["data"]["saved"] = true;
         } else {
@@ -1114,16 +6808,104 @@ private:
         }
     }
     
-    void handleGetTimeline(const Json::Value& request, Json::Value& response) {
+    // params.operations: ordered add/remove/update list (see ProjectManager::batchEdit).
+    // params.atomic (default true) rolls everything back if any operation fails.
+    void handleBatchEdit(const Json::Value& request, Json::Value& response) {
         if (!projectManager) {
             response["status"] = "error";
             response["error"] = "Project manager not available";
             return;
         }
         
-        Timeline& timeline = projectManager->getTimeline();
+        const Json::Value& operations = request["params"]["operations"];
+        if (!operations.isArray()) {
+            response["status"] = "error";
+            response["error"] = "Operations array is required";
+            return;
+        }
+        
+        bool allOrNothing = request["params"].get("atomic", true).asBool();
+        Json::Value results;
+        bool ok = projectManager->batchEdit(operations, allOrNothing, results);
+        
+        response["status"] = ok ? "success" : "error";
+        if (!ok) {
+            response["error"] = allOrNothing ? "Batch rolled back" : "Some operations failed";
+        }
+        response["data"]["results"] = results;
+        response["data"]["revision"] = static_cast<Json::UInt64>(projectManager->getRevision());
+    }
+    
+    // Full snapshot, or with params.sinceRevision only the changes after it
+    // (falls back to a snapshot when the change log no longer covers the gap)
+    void handleGetTimeline(const Json::Value& request, Json::Value& response,
+                           std::vector<BinaryAttachment>& attachments) {
+        if (!projectManager) {
+            response["status"] = "error";
+            response["error"] = "Project manager not available";
+            return;
+        }
+        
+        if (request["params"].isMember("sinceRevision")) {
+            uint64_t sinceRevision = request["params"]["sinceRevision"].asUInt64();
+            if (appendTimelineDelta(sinceRevision, response)) return;
+        }
+        
+        appendTimelineSnapshot(response, attachments);
+    }
+    
+    void handleSubscribeTimeline(websocketpp::connection_hdl hdl, const Json::Value& request, Json::Value& response,
+                                 std::vector<BinaryAttachment>& attachments) {
+        if (!projectManager) {
+            response["status"] = "error";
+            response["error"] = "Project manager not available";
+            return;
+        }
+        
+        // Subscribe first so no change can fall between the reply and the
+        // first broadcast; clients drop broadcasts at or below their revision
+        {
+            std::lock_guard<std::mutex> lock(clientsMutex);
+            timelineSubscribers.insert(hdl);
+        }
+        
+        handleGetTimeline(request, response, attachments);
+    }
+    
+    void handleUnsubscribeTimeline(websocketpp::connection_hdl hdl, const Json::Value& request, Json::Value& response) {
+        std::lock_guard<std::mutex> lock(clientsMutex);
+        timelineSubscribers.erase(hdl);
+        
+        response["status"] = "success";
+        response["data"]["unsubscribed"] = true;
+    }
+    
+    bool appendTimelineDelta(uint64_t sinceRevision, Json::Value& response) {
+        std::vector<ProjectManager::TimelineChange> changes;
+        if (!projectManager->getChangesSince(sinceRevision, changes)) return false;
+        
+        Json::Value ops(Json::arrayValue);
+        uint64_t revision = sinceRevision;
+        for (const auto& change : changes) {
+            ops.append(change.op);
+            revision = change.revision;
+        }
+        
+        response["status"] = "success";
+        response["data"]["delta"] = true;
+        response["data"]["baseRevision"] = static_cast<Json::UInt64>(sinceRevision);
+        response["data"]["revision"] = static_cast<Json::UInt64>(revision);
+        response["data"]["changes"] = ops;
+        return true;
+    }
+    
+    void appendTimelineSnapshot(Json::Value& response, std::vector<BinaryAttachment>& attachments) {
+        auto snapshot = projectManager->getTimelineSnapshot();
+        const Timeline& timeline = snapshot->timeline;
         Json::Value timelineData;
         
+        timelineData["delta"] = false;
+        timelineData["revision"] = static_cast<Json::UInt64>(snapshot->revision);
         timelineData["name"] = timeline.name;
         timelineData["duration"] = timeline.duration;
         timelineData["width"] = timeline.width;
@@ -1133,42 +6915,17 @@ private:
         // Serialize video tracks
         Json::Value videoTracks(Json::arrayValue);
         for (const auto& clip : timeline.videoTracks) {
-            Json::Value clipData;
-            clipData["id"] = clip->id;
-            clipData["filePath"] = clip->filePath;
-            clipData["startTime"] = clip->startTime;
-            clipData["duration"] = clip->duration;
-            clipData["inPoint"] = clip->inPoint;
-            clipData["outPoint"] = clip->outPoint;
-            clipData["trackIndex"] = clip->trackIndex;
-            clipData["enabled"] = clip->enabled;
-            clipData["opacity"] = clip->opacity;
-            
-            videoTracks.append(clipData);
+            videoTracks.append(ProjectManager::serializeVideoClip(*clip));
         }
         timelineData["videoTracks"] = videoTracks;
         
         // Serialize audio tracks
         Json::Value audioTracks(Json::arrayValue);
         for (const auto& clip : timeline.audioTracks) {
-            Json::Value clipData;
-            clipData["id"] = clip->id;
-            clipData["filePath"] = clip->filePath;
-            clipData["startTime"] = clip->startTime;
-            clipData["duration"] = clip->duration;
-            clipData["volume"] = clip->volume;
-            clipData["trackIndex"] = clip->trackIndex;
-            clipData["enabled"] = clip->enabled;
-            clipData["muted"] = clip->muted;
-            
-            // Include waveform data (sample every 10th point to reduce size)
-            Json::Value waveform(Json::arrayValue);
-            for (size_t i = 0; i < clip->waveform.size(); i += 10) {
-                waveform.append(clip->waveform[i]);
-            }
-            clipData["waveform"] = waveform;
-            
-            audioTracks.append(clipData);
+            attachments.push_back(makeFloatAttachment(
+                "audioTracks/" + std::to_string(audioTracks.size()) + "/waveform",
+                projectManager->waveformPreview(*clip)));
+            audioTracks.append(ProjectManager::serializeAudioClip(*clip));
         }
         timelineData["audioTracks"] = audioTracks;
         
@@ -1176,12 +6933,39 @@ private:
         response["data"] = timelineData;
     }
     
+    // Runs with projectMutex held (see ProjectManager::setChangeListener)
+    void broadcastTimelineChange(const ProjectManager::TimelineChange& change) {
+        Json::Value notification;
+        notification["type"] = "timeline_changes";
+        notification["baseRevision"] = static_cast<Json::UInt64>(change.revision - 1);
+        notification["revision"] = static_cast<Json::UInt64>(change.revision);
+        notification["changes"].append(change.op);
+        
+        Json::StreamWriterBuilder builder;
+        builder["indentation"] = "";
+        std::string messageStr = Json::writeString(builder, notification);
+        
+        std::lock_guard<std::mutex> lock(clientsMutex);
+        for (auto hdl : timelineSubscribers) {
+            try {
+                server.send(hdl, messageStr, websocketpp::frame::opcode::text);
+            } catch (const std::exception& e) {
+                LOG_WARNING("Failed to send timeline change to client: " + std::string(e.what()));
+            }
+        }
+    }
+    
     void handleExportVideo(const Json::Value& request, Json::Value& response) {
         if (!renderEngine || !projectManager) {
             response["status"] = "error";
             response["error"] = "Render engine or project manager not available";
             return;
         }
+        if (renderEngine->isExporting()) {
+            response["status"] = "error";
+            response["error"] = "An export is already in progress";
+            return;
+        }
         
         RenderEngine::ExportSettings settings;
         const Json::Value& params = request["params"];
@@ -1196,11 +6980,22 @@ private:
         settings.audioBitrate = params.get("audioBitrate", 192000).asInt();
         settings.preset = params.get("preset", "medium").asString();
         settings.crf = params.get("crf", 23).asInt();
+        settings.isolatedWorkers = params.get("isolatedWorkers", false).asBool();
+        settings.workerProcesses = params.get("workerProcesses", 0).asInt();
+        if (settings.isolatedWorkers && !RenderWorkerPool::hasEntryPoint()) {
+            response["status"] = "error";
+            response["error"] = "isolatedWorkers is not supported: the render worker entry point is not registered";
+            return;
+        }
+        
+        // Pin the version the export starts from; later edits publish new
+        // versions and never touch this one
+        auto snapshot = projectManager->getCompleteSnapshot();
+        response["data"]["revision"] = static_cast<Json::UInt64>(snapshot->revision);
         
         // Start export in a separate thread
-        std::thread exportThread([this, settings]() {
-            Timeline& timeline = projectManager->getTimeline();
-            bool success = renderEngine->exportVideo(timeline, settings);
+        std::thread exportThread([this, settings, snapshot]() {
+            bool success = renderEngine->exportVideo(snapshot->timeline, settings);
             
             // Broadcast completion status
             Json::Value notification;
@@ -1234,8 +7029,36 @@ private:
             return;
         }
         
-        RenderEngine::RenderProgress progress = renderEngine->getProgress();
+        response["status"] = "success";
+        response["data"] = progressToJson(renderEngine->getProgress());
+    }
+    
+    void handleSubscribeExportProgress(websocketpp::connection_hdl hdl, const Json::Value& request, Json::Value& response) {
+        if (!renderEngine) {
+            response["status"] = "error";
+            response["error"] = "Render engine not available";
+            return;
+        }
+        
+        {
+            std::lock_guard<std::mutex> lock(clientsMutex);
+            progressSubscribers.insert(hdl);
+        }
+        
+        // Subscribers get the current state immediately, then pushed updates
+        response["status"] = "success";
+        response["data"] = progressToJson(renderEngine->getProgress());
+    }
+    
+    void handleUnsubscribeExportProgress(websocketpp::connection_hdl hdl, const Json::Value& request, Json::Value& response) {
+        std::lock_guard<std::mutex> lock(clientsMutex);
+        progressSubscribers.erase(hdl);
         
+        response["status"] = "success";
+        response["data"]["unsubscribed"] = true;
+    }
+    
+    Json::Value progressToJson(const RenderEngine::RenderProgress& progress) {
         Json::Value progressData;
         progressData["currentFrame"] = progress.currentFrame;
         progressData["totalFrames"] = progress.totalFrames;
@@ -1245,12 +7068,58 @@ private:
         progressData["isComplete"] = progress.isComplete;
         progressData["hasError"] = progress.hasError;
         progressData["errorMessage"] = progress.errorMessage;
+        return progressData;
+    }
+    
+    // Pushes progress to subscribers at progressPushRate, and only when the
+    // render loop has published something new since the last push
+    void progressNotifierLoop() {
+        uint32_t lastSequence = 0;
         
-        response["status"] = "success";
-        response["data"] = progressData;
+        while (running) {
+            {
+                auto interval = std::chrono::duration<double>(1.0 / progressPushRate.load());
+                std::unique_lock<std::mutex> lock(progressWakeMutex);
+                progressWake.wait_for(lock, interval, [this]() { return !running || progressRateChanged; });
+                if (!running) break;
+                if (progressRateChanged) {
+                    // Start over with the new interval
+                    progressRateChanged = false;
+                    continue;
+                }
+            }
+            
+            if (!renderEngine) continue;
+            
+            uint32_t sequence = renderEngine->getProgressSequence();
+            if (sequence == lastSequence) continue;
+            
+            {
+                std::lock_guard<std::mutex> lock(clientsMutex);
+                if (progressSubscribers.empty()) continue;
+            }
+            lastSequence = sequence;
+            
+            Json::Value notification;
+            notification["type"] = "export_progress";
+            notification["data"] = progressToJson(renderEngine->getProgress());
+            
+            Json::StreamWriterBuilder builder;
+            std::string messageStr = Json::writeString(builder, notification);
+            
+            std::lock_guard<std::mutex> lock(clientsMutex);
+            for (auto hdl : progressSubscribers) {
+                try {
+                    server.send(hdl, messageStr, websocketpp::frame::opcode::text);
+                } catch (const std::exception& e) {
+                    LOG_WARNING("Failed to push progress to client: " + std::string(e.what()));
+                }
+            }
+        }
     }
     
-    void handleGenerateThumbnail(const Json::Value& request, Json::Value& response) {
+    void handleGenerateThumbnail(const Json::Value& request, Json::Value& response,
+                                 std::vector<BinaryAttachment>& attachments) {
         if (!videoEngine) {
             response["status"] = "error";
             response["error"] = "Video engine not available";
@@ -1261,6 +7130,7 @@ private:
         double timeSeconds = request["params"].get("timeSeconds", 5.0).asDouble();
         int width = request["params"].get("width", 160).asInt();
         int height = request["params"].get("height", 90).asInt();
+        std::string format = request["params"].get("format", "jpeg").asString();
         
         if (filePath.empty()) {
             response["status"] = "error";
@@ -1268,23 +7138,37 @@ private:
             return;
         }
         
+        // A client is waiting on this; pool work it starts jumps the queue
+        FiberOpticThreading::PriorityScope priority(FiberOpticThreading::Priority::Interactive);
         cv::Mat thumbnail = videoEngine->generateThumbnail(filePath, timeSeconds, cv::Size(width, height));
         
         if (!thumbnail.empty()) {
-            // Convert to base64 for transmission
-            std::vector<uchar> buffer;
-            cv::imencode(".jpg", thumbnail, buffer);
-            std::string encoded = base64_encode(buffer.data(), buffer.size());
+            BinaryAttachment attachment;
+            attachment.path = "thumbnail";
+            attachment.meta["width"] = thumbnail.cols;
+            attachment.meta["height"] = thumbnail.rows;
+            
+            if (format == "raw") {
+                // Uncompressed frame data, tightly packed BGR rows
+                cv::Mat packed = thumbnail.isContinuous() ? thumbnail : thumbnail.clone();
+                attachment.contentType = "image/x-bgr24";
+                attachment.meta["stride"] = static_cast<int>(packed.cols * packed.elemSize());
+                attachment.bytes.assign(packed.data, packed.data + packed.total() * packed.elemSize());
+            } else {
+                attachment.contentType = "image/jpeg";
+                cv::imencode(".jpg", thumbnail, attachment.bytes);
+            }
+            attachments.push_back(std::move(attachment));
             
             response["status"] = "success";
-            response["data"]["thumbnail"] = "data:image/jpeg;base64," + encoded;
         } else {
             response["status"] = "error";
             response["error"] = "Failed to generate thumbnail";
         }
     }
     
-    void handleAnalyzeAudio(const Json::Value& request, Json::Value& response) {
+    void handleAnalyzeAudio(const Json::Value& request, Json::Value& response,
+                            std::vector<BinaryAttachment>& attachments) {
         if (!audioEngine) {
             response["status"] = "error";
             response["error"] = "Audio engine not available";
@@ -1300,43 +7184,36 @@ private:
             return;
         }
         
+        FiberOpticThreading::PriorityScope priority(FiberOpticThreading::Priority::Background);
         Json::Value analysisData;
         
         if (analysisType == "waveform") {
             int sampleCount = request["params"].get("sampleCount", 1000).asInt();
             std::vector<float> waveform = audioEngine->generateWaveform(filePath, sampleCount);
-            
-            Json::Value waveformArray(Json::arrayValue);
-            for (float sample : waveform) {
-                waveformArray.append(sample);
-            }
-            analysisData["waveform"] = waveformArray;
+            attachments.push_back(makeFloatAttachment("waveform", waveform));
             
         } else if (analysisType == "beats") {
             std::vector<float> audioData = audioEngine->generateWaveform(filePath, -1); // Full resolution
             std::vector<float> beats = audioEngine->detectBeats(audioData);
-            
-            Json::Value beatsArray(Json::arrayValue);
-            for (float beatTime : beats) {
-                beatsArray.append(beatTime);
-            }
-            analysisData["beats"] = beatsArray;
+            attachments.push_back(makeFloatAttachment("beats", beats));
             
         } else if (analysisType == "spectrum") {
             // Simplified spectrum analysis
             std::vector<float> audioData = audioEngine->generateWaveform(filePath, -1);
             if (!audioData.empty()) {
                 std::vector<float> spectrum = audioEngine->analyzeFrequencySpectrum(audioData, 0);
-                
-                Json::Value spectrumArray(Json::arrayValue);
-                for (float magnitude : spectrum) {
-                    spectrumArray.append(magnitude);
-                }
-                analysisData["spectrum"] = spectrumArray;
+                attachments.push_back(makeFloatAttachment("spectrum", spectrum));
             }
         }
         
-        analysisData["duration"] = audioEngine->getAudioDuration(filePath);
+        // Duration and stream details come from the probe cache, not the decoder
+        MediaProbe::MediaInfo media = MediaProbe::shared().probe(filePath);
+        analysisData["duration"] = media.duration;
+        if (media.valid) {
+            // Analysis decodes the whole file anyway, so counting keyframes costs little here
+            media.keyframeCount = MediaProbe::shared().keyframeCount(filePath);
+            analysisData["media"] = media.toJson();
+        }
         
         response["status"] = "success";
         response["data"] = analysisData;
@@ -1360,6 +7237,25 @@ private:
         response["data"] = projectManager->getProjectInfo();
     }
     
+    // Batching of every model's requests; omitted parameters keep their value
+    void handleSetInferenceBatching(const Json::Value& request, Json::Value& response) {
+        const Json::Value& params = request["params"];
+        InferenceModelRegistry& registry = InferenceModelRegistry::shared();
+        InferenceBatcher::Settings settings = registry.getBatchSettings();
+        
+        if (params.isMember("maxBatchSize")) {
+            settings.maxBatchSize = std::max(1, params["maxBatchSize"].asInt());
+        }
+        if (params.isMember("maxDelayUs")) {
+            settings.maxDelay = std::chrono::microseconds(std::max<Json::Int64>(0, params["maxDelayUs"].asInt64()));
+        }
+        registry.setBatchSettings(settings);
+        
+        response["status"] = "success";
+        response["data"]["maxBatchSize"] = settings.maxBatchSize;
+        response["data"]["maxDelayUs"] = static_cast<Json::Int64>(settings.maxDelay.count());
+    }
+    
     void handleCreateAIVideo(const Json::Value& request, Json::Value& response) {
         if (!videoEngine) {
             response["status"] = "error";
@@ -1377,12 +7273,60 @@ private:
             return;
         }
         
-        VideoCreationAI aiModel("/path/to/model");
-        cv::Mat frame = aiModel.generateVideoFrame(prompt, width, height);
+        std::string modelPath = request["params"].get("modelPath", VideoCreationAI::defaultModelPath()).asString();
+        bool quantise = request["params"].get("quantise", false).asBool();
+        double time = request["params"].get("time", 0.0).asDouble();
+        
+        double duration = request["params"].get("duration", 0.0).asDouble();
+        
+        VideoCreationAI aiModel(modelPath, quantise);
+        if (!aiModel.isReady()) {
+            response["status"] = "error";
+            response["error"] = "Failed to load model: " + aiModel.getError();
+            return;
+        }
+        
+        if (duration > 0.0) {
+            // A clip: every frame goes through the model's batcher
+            double frameRate = request["params"].get("frameRate", 30.0).asDouble();
+            std::string outputPath = request["params"].get("outputPath", "ai_generated_video.mp4").asString();
+            FrameSink::Settings sinkSettings(outputPath, cv::Size(width, height), frameRate);
+            sinkSettings.applyParams(request["params"]);
+            FrameSink writer(sinkSettings);
+            if (!writer.open()) {
+                response["status"] = "error";
+                response["error"] = "Failed to open video writer: " + writer.getError();
+                return;
+            }
+            
+            std::vector<double> times;
+            for (int frameNumber = 0; frameNumber < duration * frameRate; ++frameNumber) {
+                times.push_back(time + frameNumber / frameRate);
+            }
+            bool written = aiModel.generateVideoFrames(prompt, width, height, times,
+                [&writer](int, const cv::Mat& frame) { return writer.writeFrame(frame); });
+            if (!written) {
+                response["status"] = "error";
+                response["error"] = "Failed to write video frame: " + writer.getError();
+                writer.abort();
+                return;
+            }
+            
+            if (!writer.close()) {
+                response["status"] = "error";
+                response["error"] = "Failed to finish video: " + writer.getError();
+                return;
+            }
+            response["status"] = "success";
+            response["data"]["outputPath"] = outputPath;
+            response["data"]["frameCount"] = static_cast<int>(times.size());
+            return;
+        }
+        
+        cv::Mat frame = aiModel.generateVideoFrame(prompt, width, height, time);
         
         if (!frame.empty()) {
-            // Save the frame as a video clip or return it as a response
-            std::string outputPath = "ai_generated_frame.jpg";
+            std::string outputPath = request["params"].get("outputPath", "ai_generated_frame.jpg").asString();
             cv::imwrite(outputPath, frame);
             
             response["status"] = "success";
@@ -1400,22 +7344,28 @@ private:
         double frameRate = request["params"].get("frameRate", 30.0).asDouble();
 
         SyntheticIntelligence si;
-        std::string outputPath = "generated_video.avi";
-        cv::VideoWriter writer(outputPath, cv::VideoWriter::fourcc('M', 'J', 'P', 'G'), frameRate, cv::Size(width, height));
+        std::string outputPath = "generated_video.mp4";
+        FrameSink::Settings sinkSettings(outputPath, cv::Size(width, height), frameRate);
+        sinkSettings.applyParams(request["params"]);
+        FrameSink writer(sinkSettings);
 
-        if (!writer.isOpened()) {
+        if (!writer.open()) {
             response["status"] = "error";
-            response["error"] = "Failed to open video writer";
+            response["error"] = "Failed to open video writer: " + writer.getError();
             return;
         }
 
         for (int frameNumber = 0; frameNumber < duration * frameRate; ++frameNumber) {
             double time = frameNumber / frameRate;
             cv::Mat frame = si.generateFrame(width, height, time);
-            writer.write(frame);
+            writer.writeFrame(frame);
         }
 
-        writer.release();
+        if (!writer.close()) {
+            response["status"] = "error";
+            response["error"] = "Failed to finish video: " + writer.getError();
+            return;
+        }
 
         response["status"] = "success";
         response["data"]["outputPath"] = outputPath;
@@ -1423,7 +7373,7 @@ private:
     
     void handleApplyEffect(const Json::Value& request, Json::Value& response) {
         std::string inputPath = request["params"].get("inputPath", "").asString();
-        std::string outputPath = request["params"].get("outputPath", "output_effect.avi").asString();
+        std::string outputPath = request["params"].get("outputPath", "output_effect.mp4").asString();
         std::string effect = request["params"].get("effect", "").asString();
 
         if (inputPath.empty() || effect.empty()) {
@@ -1443,10 +7393,12 @@ private:
         int height = static_cast<int>(capture.get(cv::CAP_PROP_FRAME_HEIGHT));
         double frameRate = capture.get(cv::CAP_PROP_FPS);
 
-        cv::VideoWriter writer(outputPath, cv::VideoWriter::fourcc('M', 'J', 'P', 'G'), frameRate, cv::Size(width, height));
-        if (!writer.isOpened()) {
+        FrameSink::Settings sinkSettings(outputPath, cv::Size(width, height), frameRate);
+        sinkSettings.applyParams(request["params"]);
+        FrameSink writer(sinkSettings);
+        if (!writer.open()) {
             response["status"] = "error";
-            response["error"] = "Failed to open video writer";
+            response["error"] = "Failed to open video writer: " + writer.getError();
             return;
         }
 
@@ -1459,11 +7411,15 @@ private:
             }
 
             cv::Mat processedFrame = si.applyEffect(frame, effect, params);
-            writer.write(processedFrame);
+            writer.writeFrame(processedFrame);
         }
 
         capture.release();
-        writer.release();
+        if (!writer.close()) {
+            response["status"] = "error";
+            response["error"] = "Failed to finish video: " + writer.getError();
+            return;
+        }
 
         response["status"] = "success";
         response["data"]["outputPath"] = outputPath;
@@ -1487,70 +7443,127 @@ private:
         sendResponse(hdl, response);
     }
     
-    // Base64 encoding utility
-    std::string base64_encode(unsigned char const* bytes_to_encode, unsigned int in_len) {
-        std::string ret;
-        int i = 0;
-        int j = 0;
-        unsigned char char_array_3[3];
-        unsigned char char_array_4[4];
-        
-        const std::string chars = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
-        
-        while (in_len--) {
-            char_array_3[i++] = *(bytes_to_encode++);
-            if (i == 3) {
-                char_array_4[0] = (char_array_3[0] & 0xfc) >> 2;
-                char_array_4[1] = ((char_array_3[0] & 0x03) << 4) + ((char_array_3[1] & 0xf0) >> 4);
-                char_array_4[2] = ((char_array_3[1] & 0x0f) << 2) + ((char_array_3[2] & 0xc0) >> 6);
-                char_array_4[3] = char_array_3[2] & 0x3f;
-                
-                for(i = 0; (i <4) ; i++)
-                    ret += chars[char_array_4[i]];
-                i = 0;
+    void sendResponseWithAttachments(websocketpp::connection_hdl hdl, Json::Value& response,
+                                     const std::vector<BinaryAttachment>& attachments) {
+        bool binary;
+        {
+            std::lock_guard<std::mutex> lock(clientsMutex);
+            binary = binaryClients.count(hdl) > 0;
+        }
+        
+        if (!binary) {
+            for (const auto& attachment : attachments) {
+                inlineAttachment(response["data"], attachment);
             }
+            sendResponse(hdl, response);
+            return;
         }
         
-        if (i) {
-            for(j = i; j < 3; j++)
-                char_array_3[j] = '\0';
-                
-            char_array_4[0] = (char_array_3[0] & 0xfc) >> 2;
-            char_array_4[1] = ((char_array_3[0] & 0x03) << 4) + ((char_array_3[1] & 0xf0) >> 4);
-            char_array_4[2] = ((char_array_3[1] & 0x0f) << 2) + ((char_array_3[2] & 0xc0) >> 6);
-            char_array_4[3] = char_array_3[2] & 0x3f;
-            
-            for (j = 0; (j < i + 1); j++)
-                ret += chars[char_array_4[j]];
-                
-            while((i++ < 3))
-                ret += '=';
+        // Describe each payload in the header, then append the payloads in order
+        size_t payloadSize = 0;
+        Json::Value descriptors(Json::arrayValue);
+        for (const auto& attachment : attachments) {
+            Json::Value descriptor;
+            descriptor["path"] = attachment.path;
+            descriptor["contentType"] = attachment.contentType;
+            descriptor["offset"] = static_cast<Json::UInt64>(payloadSize);
+            descriptor["length"] = static_cast<Json::UInt64>(attachment.bytes.size());
+            if (!attachment.meta.isNull()) descriptor["meta"] = attachment.meta;
+            descriptors.append(descriptor);
+            payloadSize += attachment.bytes.size();
         }
+        response["attachments"] = descriptors;
         
-        return ret;
+        Json::StreamWriterBuilder builder;
+        builder["indentation"] = "";
+        std::string header = Json::writeString(builder, response);
+        
+        uint32_t headerLength = static_cast<uint32_t>(header.size());
+        std::string frame;
+        frame.reserve(4 + header.size() + payloadSize);
+        for (int shift = 0; shift < 32; shift += 8) {
+            frame.push_back(static_cast<char>((headerLength >> shift) & 0xff));
+        }
+        frame.append(header);
+        for (const auto& attachment : attachments) {
+            frame.append(reinterpret_cast<const char*>(attachment.bytes.data()), attachment.bytes.size());
+        }
+        
+        try {
+            server.send(hdl, frame.data(), frame.size(), websocketpp::frame::opcode::binary);
+        } catch (const std::exception& e) {
+            LOG_ERROR("Failed to send binary response: " + std::string(e.what()));
+        }
     }
-};
-
-// AI Model Integration for Video Creation
-class VideoCreationAI {
-private:
-    std::string modelPath;
-    std::mutex aiMutex;
-
-public:
-    VideoCreationAI(const std::string& path) : modelPath(path) {
-        LOG_INFO("VideoCreationAI initialized with model path: " + modelPath);
+    
+    // JSON fallback for clients that did not negotiate binary frames. The
+    // description an encoded payload needs to be decoded (a raw frame's
+    // width, height and stride) goes next to it as "<key>Meta".
+    void inlineAttachment(Json::Value& data, const BinaryAttachment& attachment) {
+        Json::Value* parent = &data;
+        Json::Value* node = &data;
+        std::istringstream segments(attachment.path);
+        std::string key, leaf;
+        bool leafIsIndex = false;
+        while (std::getline(segments, key, '/')) {
+            parent = node;
+            leaf = key;
+            leafIsIndex = !key.empty() && std::all_of(key.begin(), key.end(), ::isdigit);
+            node = leafIsIndex ? &(*node)[static_cast<Json::ArrayIndex>(std::stoul(key))] : &(*node)[key];
+        }
+        if (attachment.contentType != "float32" && !attachment.meta.isNull() && !leafIsIndex) {
+            (*parent)[leaf + "Meta"] = attachment.meta;
+        }
+        
+        if (attachment.contentType == "float32") {
+            const float* values = reinterpret_cast<const float*>(attachment.bytes.data());
+            size_t count = attachment.bytes.size() / sizeof(float);
+            *node = Json::Value(Json::arrayValue);
+            for (size_t i = 0; i < count; i++) {
+                node->append(values[i]);
+            }
+        } else {
+            *node = "data:" + attachment.contentType + ";base64," +
+                    base64_encode(attachment.bytes.data(), attachment.bytes.size());
+        }
     }
-
-    cv::Mat generateVideoFrame(const std::string& prompt, int width, int height) {
-        std::lock_guard<std::mutex> lock(aiMutex);
-
-        // Placeholder for AI model inference logic
-        // Load the model and generate a frame based on the prompt
-        cv::Mat frame = cv::Mat::zeros(height, width, CV_8UC3);
-        cv::putText(frame, "AI Frame: " + prompt, cv::Point(50, 50), cv::FONT_HERSHEY_SIMPLEX, 1.0, cv::Scalar(255, 255, 255), 2);
-
-        return frame;
+    
+    // Float arrays go over the wire as little-endian float32
+    BinaryAttachment makeFloatAttachment(const std::string& path, const std::vector<float>& values) {
+        BinaryAttachment attachment;
+        attachment.path = path;
+        attachment.contentType = "float32";
+        attachment.meta["count"] = static_cast<Json::UInt64>(values.size());
+        const uint8_t* raw = reinterpret_cast<const uint8_t*>(values.data());
+        attachment.bytes.assign(raw, raw + values.size() * sizeof(float));
+        return attachment;
+    }
+    
+    // Base64 encoding utility (output sized up front, three bytes per step)
+    std::string base64_encode(unsigned char const* bytes_to_encode, size_t in_len) {
+        static const char chars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+        
+        std::string ret(((in_len + 2) / 3) * 4, '=');
+        char* out = &ret[0];
+        
+        size_t i = 0;
+        for (; i + 2 < in_len; i += 3) {
+            uint32_t triple = (bytes_to_encode[i] << 16) | (bytes_to_encode[i + 1] << 8) | bytes_to_encode[i + 2];
+            *out++ = chars[(triple >> 18) & 0x3f];
+            *out++ = chars[(triple >> 12) & 0x3f];
+            *out++ = chars[(triple >> 6) & 0x3f];
+            *out++ = chars[triple & 0x3f];
+        }
+        
+        if (i < in_len) {
+            uint32_t triple = bytes_to_encode[i] << 16;
+            if (i + 1 < in_len) triple |= bytes_to_encode[i + 1] << 8;
+            *out++ = chars[(triple >> 18) & 0x3f];
+            *out++ = chars[(triple >> 12) & 0x3f];
+            if (i + 1 < in_len) *out++ = chars[(triple >> 6) & 0x3f];
+        }
+        
+        return ret;
     }
 };
 
@@ -1580,6 +7593,7 @@ public:
         std::string gpuName;
         size_t gpuMemoryTotal;
         size_t gpuMemoryUsed;
+        EffectResourceCache::Stats effectCache;
     };
     
     PerformanceMonitor() : memoryUsage(0), cpuUsage(0.0), gpuUsage(0.0), activeThreads(0), running(false) {
@@ -1629,6 +7643,7 @@ public:
         
         stats.processorCount = std::thread::hardware_concurrency();
         stats.frameRate = calculateFrameRate();
+        stats.effectCache = EffectResourceCache::shared().getStats();
         
 #ifdef USE_CUDA
         // Get GPU stats if CUDA is available
@@ -1678,6 +7693,14 @@ private:
         gpuUsage = getCurrentGPUUsage();
 #endif
         
+        // Drive the scheduler's admission control. CPU usage is summed over
+        // cores, so scale it back to a share of the whole machine.
+        unsigned int processors = std::max(1u, std::thread::hardware_concurrency());
+        size_t totalMemory = getTotalSystemMemory();
+        double memoryPercentage = totalMemory > 0 ?
+            (1.0 - static_cast<double>(getAvailableMemory()) / totalMemory) * 100.0 : 0.0;
+        FiberOpticThreading::shared().updateSystemLoad(cpuUsage / processors, memoryPercentage);
+        
         lastUpdate = std::chrono::steady_clock::now();
     }
     